@@ -0,0 +1,262 @@
+//Write combining color buffer and depth cache in front of an AXI4 master, so the frame buffers and z buffer can live
+//in external memory (DDR through the MIG) instead of BRAM.
+//Both client ports behave like the BRAMs they replace: an access is taken on any cycle where stall is low, and a
+//depth read comes back the cycle after. While stall is high the client has to hold its request.
+//Color is write only since the rasterizer never reads it back. Writes to the same 32 byte line are gathered and go
+//out as one burst with byte strobes when a write to another line comes in, or on flush.
+//Depth is a direct mapped write back cache of 32 byte lines. A write miss takes over the line without reading it
+//and only the written bytes are sent back, so the epoch sweep and CLEAR never read memory.
+module axi_pixel_cache#(
+    parameter integer C_M_AXI_ADDR_WIDTH = 32,
+    parameter integer Z_LINES = 16
+)(
+    input logic clk,
+    input logic rst,
+
+    //Color, one byte per pixel.
+    input logic c_we,
+    input logic [C_M_AXI_ADDR_WIDTH-1:0] c_addr,
+    input logic [7:0] c_din,
+
+    //Depth, 16 bits per entry.
+    input logic z_re,
+    input logic z_we,
+    input logic [C_M_AXI_ADDR_WIDTH-1:0] z_addr,
+    input logic [15:0] z_din,
+    output logic [15:0] z_dout,
+
+    //Write dirty lines back on idle cycles while flush is high. clean is high once nothing is left to write.
+    input logic flush,
+    output logic clean,
+    output logic stall,
+
+    //AXI4 master, 32 bit data, 8 beat bursts.
+    output logic [C_M_AXI_ADDR_WIDTH-1:0] M_AXI_AWADDR,
+    output logic [7:0] M_AXI_AWLEN,
+    output logic [2:0] M_AXI_AWSIZE,
+    output logic [1:0] M_AXI_AWBURST,
+    output logic [3:0] M_AXI_AWCACHE,
+    output logic [2:0] M_AXI_AWPROT,
+    output logic M_AXI_AWVALID,
+    input logic M_AXI_AWREADY,
+    output logic [31:0] M_AXI_WDATA,
+    output logic [3:0] M_AXI_WSTRB,
+    output logic M_AXI_WLAST,
+    output logic M_AXI_WVALID,
+    input logic M_AXI_WREADY,
+    input logic [1:0] M_AXI_BRESP,
+    input logic M_AXI_BVALID,
+    output logic M_AXI_BREADY,
+    output logic [C_M_AXI_ADDR_WIDTH-1:0] M_AXI_ARADDR,
+    output logic [7:0] M_AXI_ARLEN,
+    output logic [2:0] M_AXI_ARSIZE,
+    output logic [1:0] M_AXI_ARBURST,
+    output logic [3:0] M_AXI_ARCACHE,
+    output logic [2:0] M_AXI_ARPROT,
+    output logic M_AXI_ARVALID,
+    input logic M_AXI_ARREADY,
+    input logic [31:0] M_AXI_RDATA,
+    input logic [1:0] M_AXI_RRESP,
+    input logic M_AXI_RLAST,
+    input logic M_AXI_RVALID,
+    output logic M_AXI_RREADY
+);
+
+localparam integer LINE_WORDS = 8;
+localparam integer INDEX_BITS = $clog2(Z_LINES);
+localparam integer C_TAG_BITS = C_M_AXI_ADDR_WIDTH - 5;
+localparam integer Z_TAG_BITS = C_M_AXI_ADDR_WIDTH - 5 - INDEX_BITS;
+
+//Color line being gathered, with a strobe bit per byte.
+logic [C_TAG_BITS-1:0] c_tag;
+logic [31:0] c_data[LINE_WORDS];
+logic [LINE_WORDS*4-1:0] c_mask;
+
+//Depth lines. A line is valid once it belongs to a tag, filled once it holds a full copy of memory, and dirty per byte.
+logic [31:0] z_data[Z_LINES*LINE_WORDS];
+logic [Z_TAG_BITS-1:0] z_tag[Z_LINES];
+logic [Z_LINES-1:0] z_valid;
+logic [Z_LINES-1:0] z_filled;
+logic [LINE_WORDS*4-1:0] z_dirty[Z_LINES];
+logic [Z_LINES-1:0] z_line_dirty;
+logic [INDEX_BITS-1:0] z_flush_idx;
+
+//Request decode.
+logic [C_TAG_BITS-1:0] c_req_tag;
+logic [2:0] c_word;
+logic [INDEX_BITS-1:0] z_idx;
+logic [Z_TAG_BITS-1:0] z_req_tag;
+logic [2:0] z_word;
+logic z_line_hit;
+logic c_miss;
+logic z_miss;
+logic any_req;
+
+assign c_req_tag = c_addr[C_M_AXI_ADDR_WIDTH-1:5];
+assign c_word = c_addr[4:2];
+assign z_idx = z_addr[5 +: INDEX_BITS];
+assign z_req_tag = z_addr[C_M_AXI_ADDR_WIDTH-1:5+INDEX_BITS];
+assign z_word = z_addr[4:2];
+assign z_line_hit = z_valid[z_idx] && z_tag[z_idx] == z_req_tag;
+//A color write to another line has to wait for the gathered one to go out.
+assign c_miss = c_we && c_mask != 0 && c_tag != c_req_tag;
+//Reads need the whole line from memory, writes only need the line to be ours.
+assign z_miss = (z_re && !(z_line_hit && z_filled[z_idx])) || (z_we && !z_line_hit);
+assign any_req = c_we || z_re || z_we;
+
+always_comb begin
+    z_flush_idx = 0;
+    for (int i = Z_LINES - 1; i >= 0; i--) begin
+        z_line_dirty[i] = |z_dirty[i];
+        if (z_line_dirty[i])
+            z_flush_idx = i;
+    end
+end
+
+//Burst in flight. Only one at a time.
+enum logic [2:0] {
+    s_idle,
+    s_aw,
+    s_w,
+    s_b,
+    s_ar,
+    s_r
+} state;
+logic wb_color;
+logic [INDEX_BITS-1:0] line_idx;
+logic [2:0] beat;
+
+assign stall = any_req && (state != s_idle || c_miss || z_miss);
+assign clean = state == s_idle && c_mask == 0 && z_line_dirty == 0;
+
+assign M_AXI_AWLEN = LINE_WORDS - 1;
+assign M_AXI_AWSIZE = 3'b010;
+assign M_AXI_AWBURST = 2'b01;
+assign M_AXI_AWCACHE = 4'b0011;
+assign M_AXI_AWPROT = 3'b000;
+assign M_AXI_ARLEN = LINE_WORDS - 1;
+assign M_AXI_ARSIZE = 3'b010;
+assign M_AXI_ARBURST = 2'b01;
+assign M_AXI_ARCACHE = 4'b0011;
+assign M_AXI_ARPROT = 3'b000;
+
+assign M_AXI_WVALID = state == s_w;
+assign M_AXI_WDATA = wb_color ? c_data[beat] : z_data[{line_idx, beat}];
+assign M_AXI_WSTRB = wb_color ? c_mask[beat*4 +: 4] : z_dirty[line_idx][beat*4 +: 4];
+assign M_AXI_WLAST = beat == LINE_WORDS - 1;
+assign M_AXI_BREADY = state == s_b;
+assign M_AXI_RREADY = state == s_r;
+
+always_ff @(posedge clk) begin
+    if (rst) begin
+        state <= s_idle;
+        M_AXI_AWVALID <= 0;
+        M_AXI_ARVALID <= 0;
+        c_mask <= 0;
+        z_valid <= 0;
+        z_filled <= 0;
+        for (int i = 0; i < Z_LINES; i++)
+            z_dirty[i] <= 0;
+    end else begin
+        case (state)
+            s_idle: begin
+                if (c_miss) begin
+                    wb_color <= 1;
+                    M_AXI_AWADDR <= {c_tag, 5'b00000};
+                    M_AXI_AWVALID <= 1;
+                    state <= s_aw;
+                end else if (z_miss) begin
+                    if (z_valid[z_idx] && z_line_dirty[z_idx]) begin
+                        //Whatever is in the line goes back first, even a partial copy of the line we want.
+                        wb_color <= 0;
+                        line_idx <= z_idx;
+                        M_AXI_AWADDR <= {z_tag[z_idx], z_idx, 5'b00000};
+                        M_AXI_AWVALID <= 1;
+                        state <= s_aw;
+                    end else if (z_re) begin
+                        line_idx <= z_idx;
+                        z_tag[z_idx] <= z_req_tag;
+                        z_valid[z_idx] <= 0;
+                        M_AXI_ARADDR <= {z_req_tag, z_idx, 5'b00000};
+                        M_AXI_ARVALID <= 1;
+                        state <= s_ar;
+                    end else begin
+                        //Write miss on a clean line, just take it over.
+                        z_tag[z_idx] <= z_req_tag;
+                        z_valid[z_idx] <= 1;
+                        z_filled[z_idx] <= 0;
+                    end
+                end else if (any_req) begin
+                    if (c_we) begin
+                        c_tag <= c_req_tag;
+                        c_data[c_word][8*c_addr[1:0] +: 8] <= c_din;
+                        c_mask[c_word*4 + c_addr[1:0]] <= 1;
+                    end
+                    if (z_we) begin
+                        z_data[{z_idx, z_word}][16*z_addr[1] +: 16] <= z_din;
+                        z_dirty[z_idx][z_word*4 + 2*z_addr[1] +: 2] <= 2'b11;
+                    end
+                    if (z_re)
+                        z_dout <= z_data[{z_idx, z_word}][16*z_addr[1] +: 16];
+                end else if (flush) begin
+                    //Nothing asked for, use the time to write dirty lines back.
+                    if (c_mask != 0) begin
+                        wb_color <= 1;
+                        M_AXI_AWADDR <= {c_tag, 5'b00000};
+                        M_AXI_AWVALID <= 1;
+                        state <= s_aw;
+                    end else if (z_line_dirty != 0) begin
+                        wb_color <= 0;
+                        line_idx <= z_flush_idx;
+                        M_AXI_AWADDR <= {z_tag[z_flush_idx], z_flush_idx, 5'b00000};
+                        M_AXI_AWVALID <= 1;
+                        state <= s_aw;
+                    end
+                end
+            end
+            s_aw: begin
+                if (M_AXI_AWREADY) begin
+                    M_AXI_AWVALID <= 0;
+                    beat <= 0;
+                    state <= s_w;
+                end
+            end
+            s_w: begin
+                if (M_AXI_WREADY) begin
+                    beat <= beat + 1;
+                    if (M_AXI_WLAST)
+                        state <= s_b;
+                end
+            end
+            s_b: begin
+                if (M_AXI_BVALID) begin
+                    if (wb_color)
+                        c_mask <= 0;
+                    else
+                        z_dirty[line_idx] <= 0;
+                    state <= s_idle;
+                end
+            end
+            s_ar: begin
+                if (M_AXI_ARREADY) begin
+                    M_AXI_ARVALID <= 0;
+                    beat <= 0;
+                    state <= s_r;
+                end
+            end
+            s_r: begin
+                if (M_AXI_RVALID) begin
+                    z_data[{line_idx, beat}] <= M_AXI_RDATA;
+                    beat <= beat + 1;
+                    if (M_AXI_RLAST) begin
+                        z_valid[line_idx] <= 1;
+                        z_filled[line_idx] <= 1;
+                        state <= s_idle;
+                    end
+                end
+            end
+            default: state <= s_idle;
+        endcase
+    end
+end
+endmodule
@@ -0,0 +1,128 @@
+//Scanout from a frame buffer in external memory. Each row of the displayed buffer is prefetched into one of two line
+//buffers while the row before it is on screen (row 0 during vertical blanking), so the pixel path never waits on
+//memory. A row stays on screen for 2 or 4 VGA lines, thousands of cycles, and a 320 byte row is 10 bursts.
+module axi_scanout_reader#(
+    parameter integer C_M_AXI_ADDR_WIDTH = 32,
+    //Row stride and the widest row, in bytes. Must be a multiple of 32.
+    parameter integer FB_WIDTH = 320
+)(
+    input logic clk,
+    input logic rst,
+
+    //Byte address of the displayed buffer, and the size of the frame in it. width must be a multiple of 32.
+    input logic [C_M_AXI_ADDR_WIDTH-1:0] base,
+    input logic [8:0] width,
+    input logic [7:0] height,
+
+    //Pixel being scanned, in frame buffer pixels. pixel is valid the cycle after, like a BRAM read.
+    input logic [8:0] scan_x,
+    input logic [7:0] scan_y,
+    input logic vblank,
+    output logic [7:0] pixel,
+    //High while the row on screen hasn't finished loading.
+    output logic underrun,
+
+    //AXI4 master, read only, 8 beat bursts.
+    output logic [C_M_AXI_ADDR_WIDTH-1:0] M_AXI_ARADDR,
+    output logic [7:0] M_AXI_ARLEN,
+    output logic [2:0] M_AXI_ARSIZE,
+    output logic [1:0] M_AXI_ARBURST,
+    output logic [3:0] M_AXI_ARCACHE,
+    output logic [2:0] M_AXI_ARPROT,
+    output logic M_AXI_ARVALID,
+    input logic M_AXI_ARREADY,
+    input logic [31:0] M_AXI_RDATA,
+    input logic [1:0] M_AXI_RRESP,
+    input logic M_AXI_RLAST,
+    input logic M_AXI_RVALID,
+    output logic M_AXI_RREADY
+);
+
+localparam integer LINE_WORDS = FB_WIDTH / 4;
+
+//Two rows, the one on screen and the next one.
+logic [31:0] line_buf[2*LINE_WORDS];
+logic [7:0] row_tag[2];
+logic [1:0] row_ok;
+
+//Row we want loaded next. Rows after the last one are never fetched.
+logic [7:0] want_row;
+logic want_loaded;
+assign want_row = vblank ? 8'd0 : scan_y + 1;
+assign want_loaded = row_ok[want_row[0]] && row_tag[want_row[0]] == want_row;
+
+logic [C_M_AXI_ADDR_WIDTH-1:0] last_base;
+logic [C_M_AXI_ADDR_WIDTH-1:0] fetch_base;
+logic [7:0] fetch_row;
+logic [6:0] fetch_word;
+
+enum logic [1:0] {
+    f_idle,
+    f_ar,
+    f_r
+} state;
+
+assign M_AXI_ARLEN = 8'd7;
+assign M_AXI_ARSIZE = 3'b010;
+assign M_AXI_ARBURST = 2'b01;
+assign M_AXI_ARCACHE = 4'b0011;
+assign M_AXI_ARPROT = 3'b000;
+assign M_AXI_RREADY = state == f_r;
+
+assign underrun = !vblank && !(row_ok[scan_y[0]] && row_tag[scan_y[0]] == scan_y);
+
+always_ff @(posedge clk) begin
+    pixel <= line_buf[scan_y[0]*LINE_WORDS + scan_x[8:2]][8*scan_x[1:0] +: 8];
+end
+
+always_ff @(posedge clk) begin
+    if (rst) begin
+        state <= f_idle;
+        M_AXI_ARVALID <= 0;
+        row_ok <= 0;
+        last_base <= 0;
+    end else begin
+        //The buffers flipped, nothing we hold is on screen any more.
+        last_base <= base;
+        if (base != last_base)
+            row_ok <= 0;
+        case (state)
+            f_idle: begin
+                if (want_row < height && !want_loaded) begin
+                    fetch_row <= want_row;
+                    fetch_base <= base;
+                    fetch_word <= 0;
+                    row_ok[want_row[0]] <= 0;
+                    M_AXI_ARADDR <= base + want_row*FB_WIDTH;
+                    M_AXI_ARVALID <= 1;
+                    state <= f_ar;
+                end
+            end
+            f_ar: begin
+                if (M_AXI_ARREADY) begin
+                    M_AXI_ARVALID <= 0;
+                    state <= f_r;
+                end
+            end
+            f_r: begin
+                if (M_AXI_RVALID) begin
+                    line_buf[fetch_row[0]*LINE_WORDS + fetch_word] <= M_AXI_RDATA;
+                    fetch_word <= fetch_word + 1;
+                    if (M_AXI_RLAST) begin
+                        if (fetch_word + 1 == width[8:2]) begin
+                            row_tag[fetch_row[0]] <= fetch_row;
+                            row_ok[fetch_row[0]] <= fetch_base == base;
+                            state <= f_idle;
+                        end else begin
+                            M_AXI_ARADDR <= M_AXI_ARADDR + 32;
+                            M_AXI_ARVALID <= 1;
+                            state <= f_ar;
+                        end
+                    end
+                end
+            end
+            default: state <= f_idle;
+        endcase
+    end
+end
+endmodule
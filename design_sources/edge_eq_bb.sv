@@ -2,20 +2,22 @@ module edge_eq_bb(
     input logic clk,
     input logic rst,
 
-    //Triangle vertices.
-    input logic [8:0] v1x_in, v2x_in, v3x_in,
-    input logic [7:0] v1y_in, v2y_in, v3y_in,
+    //Triangle vertices. v4 is the fourth corner of a quad v1, v2, v3, v4, for a triangle it is the same as v1.
+    input logic [8:0] v1x_in, v2x_in, v3x_in, v4x_in,
+    input logic [7:0] v1y_in, v2y_in, v3y_in, v4y_in,
 
     //Handshaking signals.
     input logic edge_start,
     output logic edge_done,
+    //The bounding box and the a, b coefficients are ready a cycle before the c's.
+    output logic bbox_done,
 
     //Edge equation coefficients.
     //Need to be signed because the coefficients could be negative.
-    output logic signed [9:0] a1,b1,a2,b2,a3,b3,
+    output logic signed [9:0] a1,b1,a2,b2,a3,b3,a4,b4,a5,b5,
     
     //These require more bits bc they are products of 8 bit vertices.
-    output logic signed [17:0] c1, c2, c3,
+    output logic signed [17:0] c1, c2, c3, c4, c5,
 
     //Bounding box dimensions.
     //X initial, 9 bit coordinate
@@ -29,8 +31,8 @@ module edge_eq_bb(
 );
 
 //Triangle vertices in x and y.
-logic [8:0] v1x, v2x, v3x;
-logic [7:0] v1y, v2y, v3y;
+logic [8:0] v1x, v2x, v3x, v4x;
+logic [7:0] v1y, v2y, v3y, v4y;
 
 //Latch the inputs. Since v1, v2, v3 inputs technically COULD change between the start and when our final output is computed and some things in the design are combinational, we should use latched versions.
 //Not sure if this will cause bugs, but taking some useful advice from AMD forums.
@@ -39,9 +41,11 @@ always_ff @(posedge clk) begin
         v1x <= v1x_in;
         v2x <= v2x_in;
         v3x <= v3x_in;
+        v4x <= v4x_in;
         v1y <= v1y_in;
         v2y <= v2y_in;
         v3y <= v3y_in;
+        v4y <= v4y_in;
     end
 end
 
@@ -52,25 +56,33 @@ logic [8:0] temp1;
 logic [8:0] temp2;
 logic [7:0] temp3;
 logic [7:0] temp4;
-assign temp1 = (v1x < v2x) ? v1x : v2x;
-assign bbxi = (temp1 < v3x) ? temp1 : v3x;
+logic [8:0] temp5;
+logic [8:0] temp6;
+logic [7:0] temp7;
+logic [7:0] temp8;
+assign temp5 = (v1x < v2x) ? v1x : v2x;
+assign temp1 = (v3x < v4x) ? v3x : v4x;
+assign bbxi = (temp1 < temp5) ? temp1 : temp5;
 assign bbxi = (bbxi > 'd320) ? 'd320 : bbxi;
 assign bbxi = (bbxi < 'd0) ? 'd0 : bbxi;
 
-assign temp2 = (v1x > v2x) ? v1x : v2x;
-assign bbxf = (temp2 > v3x) ? temp2 : v3x;
+assign temp6 = (v1x > v2x) ? v1x : v2x;
+assign temp2 = (v3x > v4x) ? v3x : v4x;
+assign bbxf = (temp2 > temp6) ? temp2 : temp6;
 assign bbxf = (bbxf > 'd320) ? 'd320 : bbxf;
 assign bbxf = (bbxf < 'd0) ? 'd0 : bbxf;
 
 
-assign temp3 = (v1y < v2y) ? v1y : v2y;
-assign bbyi = (temp3 < v3y) ? temp3 : v3y;
+assign temp7 = (v1y < v2y) ? v1y : v2y;
+assign temp3 = (v3y < v4y) ? v3y : v4y;
+assign bbyi = (temp3 < temp7) ? temp3 : temp7;
 assign bbyi = (bbyi > 'd255) ? 'd255 : bbyi;
 assign bbyi = (bbyi < 'd0) ? 'd0 : bbyi;
 
 
-assign temp4 = (v1y > v2y) ? v1y : v2y;
-assign bbyf = (temp4 > v3y) ? temp4 : v3y;
+assign temp8 = (v1y > v2y) ? v1y : v2y;
+assign temp4 = (v3y > v4y) ? v3y : v4y;
+assign bbyf = (temp4 > temp8) ? temp4 : temp8;
 assign bbyf = (bbyf > 'd255) ? 'd255 : bbyf;
 assign bbyf = (bbyf < 'd0) ? 'd0 : bbyf;
 
@@ -101,6 +113,10 @@ assign bbyf = (bbyf < 'd0) ? 'd0 : bbyf;
 // b3 = v1x - v3x, Takes 1 clock cycle. We do it combinationally after latching the inputs.
 // c3 = v3x*v1y - v1x*v3y, Takes 2 clock cycles. We do it in 2 stages & handshake.
 
+// Quads add edges v3 to v4 (a4, b4, c4) and v4 to v1 (a5, b5, c5) the same way. The inside test of a quad is
+// edges 1, 2, 4 and 5, edge 3 is its diagonal and only used for the depth. For a triangle v4 = v1, so edge 4 is
+// edge 3 again and edge 5 is all zeros, which always passes.
+
 
 assign a1 = v1y - v2y;
 assign b1 = v2x - v1x;
@@ -111,7 +127,13 @@ assign b2 = v3x - v2x;
 assign a3 = v3y - v1y;
 assign b3 = v1x - v3x;
 
-logic signed [16:0] prod1, prod2, prod3, prod4, prod5, prod6;
+assign a4 = v3y - v4y;
+assign b4 = v4x - v3x;
+
+assign a5 = v4y - v1y;
+assign b5 = v1x - v4x;
+
+logic signed [16:0] prod1, prod2, prod3, prod4, prod5, prod6, prod7, prod8, prod9, prod10;
 //Stage 1: We calculate A & B which are only additions. We also begin our multiplications, which if we use the DSP slices will be done in 1 cycle before the second stage.
 always_ff @(posedge clk) begin
     prod1 <= v1x*v2y;
@@ -120,6 +142,10 @@ always_ff @(posedge clk) begin
     prod4 <= v3x*v2y;
     prod5 <= v3x*v1y;
     prod6 <= v1x*v3y;
+    prod7 <= v3x*v4y;
+    prod8 <= v4x*v3y;
+    prod9 <= v4x*v1y;
+    prod10 <= v1x*v4y;
 end
 
 //Stage 2: Complete our calculations by performing the subtractions.
@@ -127,6 +153,8 @@ always_ff @(posedge clk) begin
     c1 <= prod1 - prod2;
     c2 <= prod3 - prod4;
     c3 <= prod5 - prod6;
+    c4 <= prod7 - prod8;
+    c5 <= prod9 - prod10;
 end
 
 logic ready_s1, ready_s2;
@@ -140,4 +168,5 @@ always_ff @(posedge clk) begin
     end
 end
 assign edge_done = ready_s2;
+assign bbox_done = ready_s1;
 endmodule
\ No newline at end of file
@@ -1,9 +1,23 @@
 module framebuffer#(
-    parameter ADDR_WIDTH = 17
+    parameter ADDR_WIDTH = 17,
+    //2 for double buffering. 3 adds a third buffer for triple buffering (see below).
+    //Each buffer is 76800 x 8 bits, about 17 36Kb BRAMs, so 3 buffers plus the z buffer need roughly 68 of the
+    //75 BRAMs on the Urbana board's XC7S50. Leave it at 2 if the command ring or FIFO need the room.
+    parameter NUM_BUFFERS = 2,
+    //0 when the buffers live in external memory, then this only keeps track of which buffer is which.
+    parameter USE_BRAM = 1
 )(
     input logic clk,
     input logic vsync,
     input logic rst,
+    //Double buffering: the buffers only flip on a falling vsync while this is high. Tie high to flip every frame.
+    input logic swap_en,
+    //Triple buffering: pulse when the draw buffer is finished. It is queued for display at the next vsync and drawing
+    //moves to a free buffer right away. If another frame finishes before that vsync it replaces the queued one.
+    input logic frame_done,
+    //Tag of the frame being finished, and the tag of the frame on screen.
+    input logic [31:0] swap_tag,
+    output logic [31:0] frame_tag,
 
     //GPU side
     input logic wea,
@@ -13,129 +27,110 @@ module framebuffer#(
     //VGA side
     input logic [ADDR_WIDTH-1:0] addrb,
     output logic [7:0] doutb,
-    output logic front
+    //Clear on scanout. Writes into the display buffer through its port A, which the GPU never uses.
+    input logic scan_we,
+    input logic [ADDR_WIDTH-1:0] scan_addr,
+    input logic [7:0] scan_din,
+    //Toggles every time the GPU side moves to a different buffer.
+    output logic front,
+    //Which buffer the GPU draws into and which one the VGA side reads.
+    output logic [1:0] draw_buf,
+    output logic [1:0] disp_buf,
+    //Triple buffering: a finished frame is queued and goes on screen at the next vsync.
+    output logic ready_valid
 );
 
 //logic front;
 logic prev_vsync_sync;
 logic vsync_sync1;
 logic vsync_sync2;
+logic vsync_fall;
 always_ff @(posedge clk) begin
     vsync_sync1 <= vsync;
     vsync_sync2 <= vsync_sync1;
 end
+assign vsync_fall = prev_vsync_sync & ~vsync_sync2;
+
+//Triple buffering: finished frame waiting for vsync.
+logic [1:0] ready_buf;
+logic [31:0] ready_tag;
 
 //Used to prevent clock domain crossing since the memory runs at 100 MHz and vsync is at 25 MHz, causes front to trigger multiple times.
 always_ff @(posedge clk) begin
     if (rst) begin
         front           <= 1'b0;
         prev_vsync_sync <= 1'b0;
+        draw_buf        <= 2'd1;
+        disp_buf        <= 2'd0;
+        ready_buf       <= 2'd2;
+        ready_valid     <= 1'b0;
+        ready_tag       <= 0;
+        frame_tag       <= 0;
     end 
     else begin
         prev_vsync_sync <= vsync_sync2;
-        if (prev_vsync_sync & ~vsync_sync2) begin
-            front <= ~front;
+        if (NUM_BUFFERS == 2) begin
+            if (vsync_fall & swap_en) begin
+                front <= ~front;
+                draw_buf <= disp_buf;
+                disp_buf <= draw_buf;
+                frame_tag <= swap_tag;
+            end
+        end else begin
+            if (frame_done) begin
+                front <= ~front;
+                if (vsync_fall) begin
+                    //Straight to the screen, the old display buffer is free now.
+                    disp_buf <= draw_buf;
+                    draw_buf <= disp_buf;
+                    frame_tag <= swap_tag;
+                    ready_valid <= 1'b0;
+                end else begin
+                    //Queue it, and draw into whichever buffer is neither on screen nor the one just queued.
+                    ready_buf <= draw_buf;
+                    ready_tag <= swap_tag;
+                    ready_valid <= 1'b1;
+                    draw_buf <= ready_valid ? ready_buf : 2'd3 - draw_buf - disp_buf;
+                end
+            end else if (vsync_fall & ready_valid) begin
+                disp_buf <= ready_buf;
+                frame_tag <= ready_tag;
+                ready_valid <= 1'b0;
+            end
         end
     end
 end
 
-logic frontbuf_ena;
-logic frontbuf_enb;
-logic frontbuf_wea;
-logic frontbuf_web;
-logic [ADDR_WIDTH-1:0] frontbuf_addra; // MIGHT HAVE TO CHANGE WIDTH
-logic [ADDR_WIDTH-1:0] frontbuf_addrb;
-logic [7:0] frontbuf_dina;
-logic [7:0] frontbuf_dinb;
-logic [7:0] frontbuf_douta;
-logic [7:0] frontbuf_doutb; 
-
-logic backbuf_ena;
-logic backbuf_enb;
-logic backbuf_wea;
-logic backbuf_web;
-logic [ADDR_WIDTH-1:0] backbuf_addra; // MIGHT HAVE TO CHANGE WIDTH
-logic [ADDR_WIDTH-1:0] backbuf_addrb;
-logic [7:0] backbuf_dina;
-logic [7:0] backbuf_dinb;
-logic [7:0] backbuf_douta;
-logic [7:0] backbuf_doutb; 
-
-assign frontbuf_web = 'b0;
-assign backbuf_web = 'b0;
-assign frontbuf_dinb = 'b0;
-assign backbuf_dinb = 'b0;
-assign frontbuf_ena = 'b1;
-assign backbuf_ena = 'b1;
-assign frontbuf_enb = 'b1;
-assign backbuf_enb = 'b1;
-
-//Make frame buffer here.
+//Make frame buffers here.
 //True Dual Port
 //Byte Write Enable (8 bit bytes)
 //Write width: 8
 //Write depth: >= 768000
 //320 * 240 * 1 B = 76.8 kB
 //width: 8 bits (8-bit colorspace)
-blk_mem_gen_0 front_buffer(
-    .clka(clk),
-    .clkb(clk),
-    .ena(frontbuf_ena),
-    .enb(frontbuf_enb),
-    .wea(frontbuf_wea),
-    .web(frontbuf_web),
-    .addra(frontbuf_addra),
-    .addrb(frontbuf_addrb),
-    .dina(frontbuf_dina),
-    .dinb(frontbuf_dinb),
-    .douta(frontbuf_douta),
-    .doutb(frontbuf_doutb)
-);
-
-// Double buffering
-blk_mem_gen_0 back_buffer(
-    .clka(clk),
-    .clkb(clk),
-    .ena(backbuf_ena),
-    .enb(backbuf_enb),
-    .wea(backbuf_wea),
-    .web(backbuf_web),
-    .addra(backbuf_addra),
-    .addrb(backbuf_addrb),
-    .dina(backbuf_dina),
-    .dinb(backbuf_dinb),
-    .douta(backbuf_douta),
-    .doutb(backbuf_doutb)
-);
-
-
-always_comb begin
-    if(front) begin
-        //front is write buffer
-        frontbuf_wea   = wea;
-        frontbuf_addra = addra;
-        frontbuf_dina  = dina;
-        frontbuf_addrb = 'b0;
+//Port A is the GPU side and only writes the draw buffer. Port B is the VGA side and is read from the display buffer.
+//Port A of the display buffer is free, so the scanout clear uses it. Writing through port B would collide with the read.
+logic [7:0] buf_doutb[NUM_BUFFERS];
 
-        // BACK is read buffer
-        backbuf_wea   = 'b0;
-        backbuf_addra = 'b0;
-        backbuf_dina  = 'b0;
-        backbuf_addrb = addrb;
-        doutb = backbuf_doutb;
-    end else begin
-        //back is write buffer
-        backbuf_wea   = wea;
-        backbuf_addra = addra;
-        backbuf_dina  = dina;
-        backbuf_addrb = 'b0;
-
-        // FRONT is read buffer
-        frontbuf_wea   = 'b0;
-        frontbuf_addra = 'b0;
-        frontbuf_dina  = 'b0;
-        frontbuf_addrb = addrb;
-        doutb = frontbuf_doutb;
+genvar i;
+generate
+    for (i = 0; i < NUM_BUFFERS * USE_BRAM; i++) begin: buffers
+        blk_mem_gen_0 buffer(
+            .clka(clk),
+            .clkb(clk),
+            .ena(1'b1),
+            .enb(1'b1),
+            .wea(draw_buf == i ? wea : (scan_we && disp_buf == i)),
+            .web(1'b0),
+            .addra(draw_buf == i ? addra : scan_addr),
+            .addrb(addrb),
+            .dina(draw_buf == i ? dina : scan_din),
+            .dinb(8'b0),
+            .douta(),
+            .doutb(buf_doutb[i])
+        );
     end
-end
-endmodule
\ No newline at end of file
+endgenerate
+
+assign doutb = USE_BRAM ? buf_doutb[disp_buf] : 8'h00;
+endmodule
@@ -15,7 +15,18 @@ module hdmi_text_controller_v1_0 #
     // Modify parameters as necessary for access of full VRAM range
 
     parameter integer C_AXI_DATA_WIDTH	= 32,
-    parameter integer C_AXI_ADDR_WIDTH	= 5
+    parameter integer C_AXI_ADDR_WIDTH	= 14,
+
+    // 2 for double buffering, 3 for triple buffering
+    parameter integer NUM_FRAME_BUFFERS = 2,
+
+    // 1 to keep the frame buffers and z buffer in external memory (e.g. DDR3 through the MIG) via m_axi and m_axi_scan
+    parameter integer FB_EXTERNAL = 0,
+    parameter integer C_M_AXI_ADDR_WIDTH = 32,
+    parameter logic [31:0] FB_BASE_ADDR = 32'h8000_0000,
+
+    // 1 to record a per-triangle trace readable at 0x1000 (2 more BRAMs)
+    parameter integer TRACE_ENABLE = 0
 )
 (
     // Users to add ports here
@@ -25,6 +36,58 @@ module hdmi_text_controller_v1_0 #
     output logic [2:0] hdmi_tx_n,
     output logic [2:0] hdmi_tx_p,
 
+    // AXI4-Stream triangle packets, e.g. from an AXI DMA MM2S channel clocked by axi_aclk
+    input logic [31:0] axis_tdata,
+    input logic  axis_tvalid,
+    output logic  axis_tready,
+    input logic  axis_tlast,
+
+    // AXI4 master for drawing into external memory, only used with FB_EXTERNAL
+    output logic [C_M_AXI_ADDR_WIDTH-1 : 0] m_axi_awaddr,
+    output logic [7 : 0] m_axi_awlen,
+    output logic [2 : 0] m_axi_awsize,
+    output logic [1 : 0] m_axi_awburst,
+    output logic [3 : 0] m_axi_awcache,
+    output logic [2 : 0] m_axi_awprot,
+    output logic  m_axi_awvalid,
+    input logic  m_axi_awready,
+    output logic [31 : 0] m_axi_wdata,
+    output logic [3 : 0] m_axi_wstrb,
+    output logic  m_axi_wlast,
+    output logic  m_axi_wvalid,
+    input logic  m_axi_wready,
+    input logic [1 : 0] m_axi_bresp,
+    input logic  m_axi_bvalid,
+    output logic  m_axi_bready,
+    output logic [C_M_AXI_ADDR_WIDTH-1 : 0] m_axi_araddr,
+    output logic [7 : 0] m_axi_arlen,
+    output logic [2 : 0] m_axi_arsize,
+    output logic [1 : 0] m_axi_arburst,
+    output logic [3 : 0] m_axi_arcache,
+    output logic [2 : 0] m_axi_arprot,
+    output logic  m_axi_arvalid,
+    input logic  m_axi_arready,
+    input logic [31 : 0] m_axi_rdata,
+    input logic [1 : 0] m_axi_rresp,
+    input logic  m_axi_rlast,
+    input logic  m_axi_rvalid,
+    output logic  m_axi_rready,
+
+    // AXI4 read only master for scanout from external memory, only used with FB_EXTERNAL
+    output logic [C_M_AXI_ADDR_WIDTH-1 : 0] m_axi_scan_araddr,
+    output logic [7 : 0] m_axi_scan_arlen,
+    output logic [2 : 0] m_axi_scan_arsize,
+    output logic [1 : 0] m_axi_scan_arburst,
+    output logic [3 : 0] m_axi_scan_arcache,
+    output logic [2 : 0] m_axi_scan_arprot,
+    output logic  m_axi_scan_arvalid,
+    input logic  m_axi_scan_arready,
+    input logic [31 : 0] m_axi_scan_rdata,
+    input logic [1 : 0] m_axi_scan_rresp,
+    input logic  m_axi_scan_rlast,
+    input logic  m_axi_scan_rvalid,
+    output logic  m_axi_scan_rready,
+
     // User ports ends
     // Do not modify the ports beyond this line
 
@@ -72,10 +135,15 @@ assign reset_ah = ~axi_aresetn;
 // Instantiation of Axi Bus Interface AXI
 hdmi_text_controller_v1_0_AXI # ( 
     .C_S_AXI_DATA_WIDTH(C_AXI_DATA_WIDTH),
-    .C_S_AXI_ADDR_WIDTH(C_AXI_ADDR_WIDTH)
+    .C_S_AXI_ADDR_WIDTH(C_AXI_ADDR_WIDTH),
+    .NUM_FRAME_BUFFERS(NUM_FRAME_BUFFERS),
+    .FB_EXTERNAL(FB_EXTERNAL),
+    .C_M_AXI_ADDR_WIDTH(C_M_AXI_ADDR_WIDTH),
+    .FB_BASE_ADDR(FB_BASE_ADDR),
+    .TRACE_ENABLE(TRACE_ENABLE)
 ) hdmi_text_controller_v1_0_AXI_inst (
-    //We only use write ports on AXI. We still have them coming into the top level module since we need to build the AXI interface correctly in the IP packager. 
-    //But sending these signals internally is not required.
+    //The read ports are used to poll RING_TAIL. PROT and WSTRB still come into the top level module since we need to build the AXI interface correctly in the IP packager,
+    //but sending these signals internally is not required.
     .S_AXI_ACLK(axi_aclk),
     .S_AXI_ARESETN(axi_aresetn),
     .S_AXI_AWADDR(axi_awaddr),
@@ -89,14 +157,60 @@ hdmi_text_controller_v1_0_AXI # (
     .S_AXI_BRESP(axi_bresp),
     .S_AXI_BVALID(axi_bvalid),
     .S_AXI_BREADY(axi_bready),
-    // .S_AXI_ARADDR(axi_araddr),
+    .S_AXI_ARADDR(axi_araddr),
     // .S_AXI_ARPROT(axi_arprot),
-    // .S_AXI_ARVALID(axi_arvalid),
-    // .S_AXI_ARREADY(axi_arready),
-    // .S_AXI_RDATA(axi_rdata),
-    // .S_AXI_RRESP(axi_rresp),
-    // .S_AXI_RVALID(axi_rvalid),
-    // .S_AXI_RREADY(axi_rready),
+    .S_AXI_ARVALID(axi_arvalid),
+    .S_AXI_ARREADY(axi_arready),
+    .S_AXI_RDATA(axi_rdata),
+    .S_AXI_RRESP(axi_rresp),
+    .S_AXI_RVALID(axi_rvalid),
+    .S_AXI_RREADY(axi_rready),
+    .S_AXIS_TDATA(axis_tdata),
+    .S_AXIS_TVALID(axis_tvalid),
+    .S_AXIS_TREADY(axis_tready),
+    .S_AXIS_TLAST(axis_tlast),
+    .M_AXI_AWADDR(m_axi_awaddr),
+    .M_AXI_AWLEN(m_axi_awlen),
+    .M_AXI_AWSIZE(m_axi_awsize),
+    .M_AXI_AWBURST(m_axi_awburst),
+    .M_AXI_AWCACHE(m_axi_awcache),
+    .M_AXI_AWPROT(m_axi_awprot),
+    .M_AXI_AWVALID(m_axi_awvalid),
+    .M_AXI_AWREADY(m_axi_awready),
+    .M_AXI_WDATA(m_axi_wdata),
+    .M_AXI_WSTRB(m_axi_wstrb),
+    .M_AXI_WLAST(m_axi_wlast),
+    .M_AXI_WVALID(m_axi_wvalid),
+    .M_AXI_WREADY(m_axi_wready),
+    .M_AXI_BRESP(m_axi_bresp),
+    .M_AXI_BVALID(m_axi_bvalid),
+    .M_AXI_BREADY(m_axi_bready),
+    .M_AXI_ARADDR(m_axi_araddr),
+    .M_AXI_ARLEN(m_axi_arlen),
+    .M_AXI_ARSIZE(m_axi_arsize),
+    .M_AXI_ARBURST(m_axi_arburst),
+    .M_AXI_ARCACHE(m_axi_arcache),
+    .M_AXI_ARPROT(m_axi_arprot),
+    .M_AXI_ARVALID(m_axi_arvalid),
+    .M_AXI_ARREADY(m_axi_arready),
+    .M_AXI_RDATA(m_axi_rdata),
+    .M_AXI_RRESP(m_axi_rresp),
+    .M_AXI_RLAST(m_axi_rlast),
+    .M_AXI_RVALID(m_axi_rvalid),
+    .M_AXI_RREADY(m_axi_rready),
+    .M_AXI_SCAN_ARADDR(m_axi_scan_araddr),
+    .M_AXI_SCAN_ARLEN(m_axi_scan_arlen),
+    .M_AXI_SCAN_ARSIZE(m_axi_scan_arsize),
+    .M_AXI_SCAN_ARBURST(m_axi_scan_arburst),
+    .M_AXI_SCAN_ARCACHE(m_axi_scan_arcache),
+    .M_AXI_SCAN_ARPROT(m_axi_scan_arprot),
+    .M_AXI_SCAN_ARVALID(m_axi_scan_arvalid),
+    .M_AXI_SCAN_ARREADY(m_axi_scan_arready),
+    .M_AXI_SCAN_RDATA(m_axi_scan_rdata),
+    .M_AXI_SCAN_RRESP(m_axi_scan_rresp),
+    .M_AXI_SCAN_RLAST(m_axi_scan_rlast),
+    .M_AXI_SCAN_RVALID(m_axi_scan_rvalid),
+    .M_AXI_SCAN_RREADY(m_axi_scan_rready),
     .vsync(vsync),
     .drawX(drawX),
     .drawY(drawY),
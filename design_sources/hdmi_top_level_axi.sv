@@ -34,7 +34,22 @@ module hdmi_text_controller_v1_0_AXI #
     // Width of S_AXI data bus
     parameter integer C_S_AXI_DATA_WIDTH	= 32,
     // Width of S_AXI address bus
-    parameter integer C_S_AXI_ADDR_WIDTH	= 5
+    // Address map (byte offsets):
+    //   0x0000 - 0x00FF  registers, see the register list above the read mux
+    //   0x2000 - 0x3FFF  command ring, 256 slots of 8 words. Words 0-5 of a slot hold one triangle packet.
+    parameter integer C_S_AXI_ADDR_WIDTH	= 14,
+
+    // 2 for double buffering, 3 for triple buffering (uses more BRAM, see framebuffer.sv)
+    parameter integer NUM_FRAME_BUFFERS = 2,
+
+    // 1 keeps the frame buffers and z buffer in external memory through the M_AXI ports instead of BRAM.
+    // Color buffer i is at FB_BASE_ADDR + i * 0x20000 and the z buffer (16 bits per entry) at FB_BASE_ADDR + 0x60000.
+    parameter integer FB_EXTERNAL = 0,
+    parameter integer C_M_AXI_ADDR_WIDTH = 32,
+    parameter logic [31:0] FB_BASE_ADDR = 32'h8000_0000,
+
+    // 1 adds the per-triangle trace buffer at 0x1000, see TRIANGLE TRACE. Takes 2 BRAMs.
+    parameter integer TRACE_ENABLE = 0
 )
 (
     // Users to add ports here
@@ -43,7 +58,60 @@ module hdmi_text_controller_v1_0_AXI #
     input logic [9:0] drawY,
     
     output logic [3:0] red, green, blue,
-    
+
+    // AXI4-Stream slave for triangle packets. Same 6 word packets as slv_regs 0-5, low word first.
+    // Meant to be fed by an AXI DMA (MM2S) running on S_AXI_ACLK. TLAST is only used to resync after
+    // a short packet, so a DMA that asserts it once at the end of the whole buffer is fine.
+    input logic [31:0] S_AXIS_TDATA,
+    input logic S_AXIS_TVALID,
+    output logic S_AXIS_TREADY,
+    input logic S_AXIS_TLAST,
+
+    // AXI4 master for drawing into external memory (FB_EXTERNAL only), see axi_pixel_cache.sv
+    output logic [C_M_AXI_ADDR_WIDTH-1:0] M_AXI_AWADDR,
+    output logic [7:0] M_AXI_AWLEN,
+    output logic [2:0] M_AXI_AWSIZE,
+    output logic [1:0] M_AXI_AWBURST,
+    output logic [3:0] M_AXI_AWCACHE,
+    output logic [2:0] M_AXI_AWPROT,
+    output logic M_AXI_AWVALID,
+    input logic M_AXI_AWREADY,
+    output logic [31:0] M_AXI_WDATA,
+    output logic [3:0] M_AXI_WSTRB,
+    output logic M_AXI_WLAST,
+    output logic M_AXI_WVALID,
+    input logic M_AXI_WREADY,
+    input logic [1:0] M_AXI_BRESP,
+    input logic M_AXI_BVALID,
+    output logic M_AXI_BREADY,
+    output logic [C_M_AXI_ADDR_WIDTH-1:0] M_AXI_ARADDR,
+    output logic [7:0] M_AXI_ARLEN,
+    output logic [2:0] M_AXI_ARSIZE,
+    output logic [1:0] M_AXI_ARBURST,
+    output logic [3:0] M_AXI_ARCACHE,
+    output logic [2:0] M_AXI_ARPROT,
+    output logic M_AXI_ARVALID,
+    input logic M_AXI_ARREADY,
+    input logic [31:0] M_AXI_RDATA,
+    input logic [1:0] M_AXI_RRESP,
+    input logic M_AXI_RLAST,
+    input logic M_AXI_RVALID,
+    output logic M_AXI_RREADY,
+
+    // AXI4 read only master for scanout from external memory (FB_EXTERNAL only), see axi_scanout_reader.sv
+    output logic [C_M_AXI_ADDR_WIDTH-1:0] M_AXI_SCAN_ARADDR,
+    output logic [7:0] M_AXI_SCAN_ARLEN,
+    output logic [2:0] M_AXI_SCAN_ARSIZE,
+    output logic [1:0] M_AXI_SCAN_ARBURST,
+    output logic [3:0] M_AXI_SCAN_ARCACHE,
+    output logic [2:0] M_AXI_SCAN_ARPROT,
+    output logic M_AXI_SCAN_ARVALID,
+    input logic M_AXI_SCAN_ARREADY,
+    input logic [31:0] M_AXI_SCAN_RDATA,
+    input logic [1:0] M_AXI_SCAN_RRESP,
+    input logic M_AXI_SCAN_RLAST,
+    input logic M_AXI_SCAN_RVALID,
+    output logic M_AXI_SCAN_RREADY,
 
     // User ports ends
 
@@ -123,6 +191,10 @@ logic  axi_bvalid;
 
 
 //Recieve Triangles into FIFO.
+//The FIFO is written either by the AXI-Lite staging registers or by the AXI4-Stream port.
+logic lite_fifo_wr_en;
+logic [191:0] lite_fifo_din;
+logic lite_push_now;
 logic fifo_full;
 logic [191:0] fifo_din;
 logic fifo_wr_en;
@@ -131,6 +203,169 @@ logic [191:0] fifo_dout;
 logic fifo_rd_en;
 logic fifo_srst;
 
+//Command ring. Software copies packets into ring slots at its own pace, then writes RING_HEAD (the doorbell).
+//The ring fetcher walks from RING_TAIL up to RING_HEAD and moves one slot at a time into the FIFO,
+//only when the FIFO has room, so nothing submitted this way is ever dropped.
+localparam integer RING_SLOTS = 256;
+localparam integer RING_SLOT_WORDS = 8;
+logic [31:0] ring_mem[RING_SLOTS * RING_SLOT_WORDS];
+logic ring_we;
+logic [10:0] ring_waddr;
+logic [10:0] ring_raddr;
+logic [31:0] ring_rdata;
+logic [31:0] ring_head;
+logic [31:0] ring_tail;
+logic [159:0] ring_words;
+logic [2:0] ring_word_idx;
+logic ring_push;
+
+//Value of the last FENCE command reached, readable by software.
+logic [31:0] fence_value;
+
+//Buffer swap control. In manual mode the buffers only flip at a vsync after a swap has been requested
+//(SWAP_REQ register or SWAP command) and everything submitted before it has been drawn.
+logic manual_swap;
+logic swap_pending;
+logic swap_req_wr;
+logic swap_req_cmd;
+logic [31:0] swap_tag;
+logic [31:0] frame_tag;
+//Resolution the next draw buffer gets in clear_buf. Set by RENDER_RES writes, and by a SWAP command that carries one
+//for the frame after it, so software can switch exactly at a frame it builds for the new size.
+logic render_res_next;
+logic pipeline_drained;
+logic swap_en;
+logic frame_done;
+logic prev_front;
+logic front;
+logic [1:0] draw_buf;
+logic [1:0] disp_buf;
+
+//Buffer geometry. Every buffer is FB_WIDTH x FB_HEIGHT with a row stride of FB_WIDTH, whatever the render resolution.
+localparam integer FB_WIDTH = 320;
+localparam integer FB_HEIGHT = 240;
+localparam integer TILES_X = FB_WIDTH / 8;
+localparam integer NUM_TILES = FB_WIDTH * FB_HEIGHT / 64;
+
+//Render resolution, 0 = 320x240 (2x upscale), 1 = 160x120 (4x upscale). Lower resolutions use the top left corner
+//of the buffer. Each buffer remembers the resolution it was drawn at so scanout upscales it to match.
+logic buf_res[NUM_FRAME_BUFFERS];
+logic draw_res;
+logic disp_res;
+logic [8:0] render_x1;
+logic [7:0] render_y1;
+logic [8:0] scissor_x1_eff;
+logic [7:0] scissor_y1_eff;
+logic [8:0] scan_x;
+logic [7:0] scan_y;
+
+//Lazy clear. The screen is split into 40x30 tiles of 8x8 pixels and each buffer keeps a bit per tile that is set
+//once the tile has been cleared since the buffer became the draw target. Clearing a frame just resets the bits.
+//A tile's color is really cleared by the tile engine the first time the rasterizer or a CLEAR command touches it,
+//and scanout shows the clear color for tiles that were never touched.
+logic [NUM_TILES-1:0] tile_valid_bits[NUM_FRAME_BUFFERS];
+logic [7:0] clear_color;
+logic tile_busy;
+logic tile_start;
+logic [5:0] tile_px;
+logic [10:0] tile_cur;
+logic [8:0] tile_x0;
+logic [7:0] tile_y0;
+logic [16:0] addr_tile;
+logic [5:0] req_tile_x;
+logic [4:0] req_tile_y;
+logic [5:0] raster_tile_x;
+logic [4:0] raster_tile_y;
+logic raster_tile_valid;
+logic raster_tile_miss;
+logic clr_tile_valid;
+logic disp_tile_valid;
+
+//Clear on scanout. Each pixel is written back with the clear color right after its last read of the frame, so a
+//buffer leaving the screen is already clear and the tile engine has nothing to do.
+logic scan_clear_en;
+logic scan_will_flip;
+logic scan_frame_ok;
+logic scan_last_read;
+logic [16:0] scan_prev_addr;
+logic scan_we;
+logic [16:0] scan_addr;
+logic [7:0] scan_din;
+logic ready_valid;
+logic [1:0] prev_draw_buf;
+logic [1:0] prev_disp_buf;
+logic [NUM_FRAME_BUFFERS-1:0] color_clean;
+
+//Z buffer entries are {epoch, depth}. A depth only counts if its epoch is the current one, so the z buffer never
+//has to be cleared per frame. Epochs 1-3 are used in turn and epoch 0 marks swept entries. Going from 3 back to 1
+//needs one full sweep so that depths from 3 frames ago can't come back.
+logic [1:0] zbuf_epoch;
+logic [16:0] clear_addr;
+
+//Depth bound per tile, {epoch, zmin} like the z buffer entries: every depth written to the tile this epoch is at
+//least zmin, and one from another epoch reads as 0xFF. Each z buffer write lowers it. The rasterizer writes span
+//pixels nearer than their tile's bound without reading the z buffer.
+logic [9:0] tile_zmin_mem[NUM_TILES];
+logic [10:0] zmin_tile;
+logic [7:0] zmin_cur;
+logic [7:0] raster_tile_zmin;
+
+//External memory (FB_EXTERNAL). mem_stall holds off every writer while the cache talks to memory, and mem_clean
+//says everything drawn so far has reached memory. Both are constant with BRAM.
+localparam logic [31:0] FB_BUF_BYTES = 32'h2_0000;
+localparam logic [31:0] FB_Z_OFFSET = 32'h6_0000;
+logic mem_stall;
+logic mem_clean;
+logic mem_flush;
+logic zbuf_re;
+logic zbuf_re_raster;
+logic [7:0] ext_pixel;
+logic scan_underrun;
+
+//Performance counters, registers 16-31. The counters run all the time and reads return the copy taken by the last
+//snapshot, so software sees one consistent set. See PERF COUNTERS below for what each one counts.
+localparam integer PERF_BASE = 16;
+localparam integer NUM_PERF = 16;
+localparam integer PERF_CYC_CLEAR_BUF = 1;
+localparam integer PERF_CYC_WAIT_TRI = 2;
+localparam integer PERF_CYC_CALC_EDGE = 3;
+localparam integer PERF_CYC_RASTERIZE = 4;
+localparam integer PERF_CYC_OTHER = 5;
+localparam integer PERF_TRI_ACCEPTED = 6;
+localparam integer PERF_TRI_DROPPED = 7;
+localparam integer PERF_PIX_VISITED = 8;
+localparam integer PERF_PIX_INSIDE = 9;
+localparam integer PERF_PIX_ZPASS = 10;
+localparam integer PERF_PIX_ZFAIL = 11;
+localparam integer PERF_FIFO_HWM = 12;
+localparam integer PERF_FRAME_CYCLES = 13;
+localparam integer PERF_CYCLES_LO = 14;
+localparam integer PERF_CYCLES_HI = 15;
+logic [31:0] perf_live[NUM_PERF];
+logic [31:0] perf_snap[NUM_PERF];
+logic [31:0] frame_cycle_count;
+logic [5:0] fifo_level;
+logic perf_ctrl_wr;
+logic px_visit;
+logic px_inside;
+logic px_zpass;
+logic px_zfail;
+
+//Per-triangle trace, one 16 byte entry per triangle that reaches the edge stage. Entry n is at 0x1000 + (n % 256) * 16.
+localparam integer TRACE_ENTRIES = 256;
+logic trace_on;
+logic trace_fire;
+logic [127:0] trace_entry;
+logic [127:0] trace_rdata;
+logic [31:0] trace_count;
+logic [31:0] trace_pop_time;
+logic [15:0] trace_setup;
+logic [31:0] trace_raster;
+logic [15:0] trace_visited;
+logic [15:0] trace_written;
+logic [11:0] trace_frame;
+logic [3:0] trace_flags;
+
 logic triangle_ready;
 logic triangle_valid;
 
@@ -189,7 +424,8 @@ logic douta;
 // ADDR_LSB = 2 for 32 bits (n downto 2)
 // ADDR_LSB = 3 for 64 bits (n downto 3)
 localparam integer ADDR_LSB = 2;
-localparam integer OPT_MEM_ADDR_BITS = 2;
+localparam integer OPT_MEM_ADDR_BITS = 5;
+localparam integer NUM_REGS = 2 ** (OPT_MEM_ADDR_BITS + 1);
 //----------------------------------------------
 //-- Signals for user logic register space example
 //------------------------------------------------
@@ -202,9 +438,13 @@ localparam integer OPT_MEM_ADDR_BITS = 2;
 //Note: the provided Verilog template had the registered declared as above, but in order to give 
 //students a hint we have replaced the 4 individual registers with an unpacked array of packed logic. 
 //Note that you as the student will still need to extend this to the full register set needed for the lab.
-logic [C_S_AXI_DATA_WIDTH-1:0] slv_regs[2 ** (C_S_AXI_ADDR_WIDTH - 2)];
+logic [C_S_AXI_DATA_WIDTH-1:0] slv_regs[NUM_REGS];
 logic	 slv_reg_rden;
 logic	 slv_reg_wren;
+logic	 wr_in_regs;
+logic	 wr_in_ring;
+logic [OPT_MEM_ADDR_BITS:0] wr_reg;
+logic [OPT_MEM_ADDR_BITS:0] rd_reg;
 logic [C_S_AXI_DATA_WIDTH-1:0]	 reg_data_out;
 integer	 byte_index;
 logic	 aw_en;
@@ -312,29 +552,34 @@ end
 // and the slave is ready to accept the write address and write data.
 
 assign slv_reg_wren = axi_wready && S_AXI_WVALID && axi_awready && S_AXI_AWVALID;
+assign wr_reg = axi_awaddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB];
+assign wr_in_regs = axi_awaddr[13:12] == 2'b00;
+assign wr_in_ring = axi_awaddr[13];
+assign lite_push_now = slv_reg_wren && wr_in_regs && wr_reg == 5;
 always_ff @( posedge S_AXI_ACLK )
 begin
  if ( S_AXI_ARESETN == 1'b0 )
    begin
-       fifo_wr_en <= 1'b0;
-       for (integer i = 0; i < 2 ** (C_S_AXI_ADDR_WIDTH - 2); i++)
+       lite_fifo_wr_en <= 1'b0;
+       for (integer i = 0; i < NUM_REGS; i++)
        begin
            slv_regs[i] <= 0;
        end
    end
  else begin
-   if (slv_reg_wren)
+   if (slv_reg_wren && wr_in_regs)
      begin
        for ( byte_index = 0; byte_index <= (C_S_AXI_DATA_WIDTH/8)-1; byte_index = byte_index+1 )
          //if ( S_AXI_WSTRB[byte_index] == 1 ) begin
            // Respective byte enables are asserted as per write strobes, note the use of the index part select operator
            // '+:', you will need to understand how this operator works.
-         slv_regs[axi_awaddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB]][(byte_index*8) +: 8] <= S_AXI_WDATA[(byte_index*8) +: 8];
+         slv_regs[wr_reg][(byte_index*8) +: 8] <= S_AXI_WDATA[(byte_index*8) +: 8];
          //end
-         fifo_wr_en <= 1'b0;
-         if (axi_awaddr[4:2] == 3'd5 && !fifo_full) begin
-           fifo_wr_en <= 1'b1;
-           fifo_din <= {
+         lite_fifo_wr_en <= 1'b0;
+         //Legacy path: the packet is dropped if the FIFO is full. Use the command ring to avoid this.
+         if (wr_reg == 5 && !fifo_full) begin
+           lite_fifo_wr_en <= 1'b1;
+           lite_fifo_din <= {
                S_AXI_WDATA,  // r_area
                slv_regs[4],  // color + v3z
                slv_regs[3],  // v3y + v3x
@@ -344,11 +589,113 @@ begin
            };
        end
     end else begin
-        fifo_wr_en <= 'b0;
+        lite_fifo_wr_en <= 'b0;
     end
  end
 end    
 
+//AXI4-Stream triangle ingest.
+//Words 0-4 of a packet are collected in axis_words, and the 6th beat completes the packet into axis_pkt.
+//Only the 6th beat can stall, so the port takes one beat per clock as long as the FIFO keeps up.
+//A TLAST before the 6th beat means a short packet, which we drop and resync on.
+logic [2:0] axis_beat;
+logic [159:0] axis_words;
+logic [191:0] axis_pkt;
+logic axis_pkt_valid;
+logic axis_push;
+
+//The AXI-Lite path can't be stalled, so it gets priority. We also hold off on the cycle it checks fifo_full so both don't take the last slot.
+assign axis_push = axis_pkt_valid && !fifo_full && !lite_fifo_wr_en && !lite_push_now;
+assign S_AXIS_TREADY = (axis_beat != 3'd5) || !axis_pkt_valid || axis_push;
+
+always_ff @(posedge S_AXI_ACLK) begin
+  if (~S_AXI_ARESETN) begin
+    axis_beat <= 0;
+    axis_pkt_valid <= 1'b0;
+  end else begin
+    if (axis_push)
+      axis_pkt_valid <= 1'b0;
+    if (S_AXIS_TVALID && S_AXIS_TREADY) begin
+      if (axis_beat == 3'd5) begin
+        axis_pkt <= {S_AXIS_TDATA, axis_words};
+        axis_pkt_valid <= 1'b1;
+        axis_beat <= 0;
+      end else if (S_AXIS_TLAST) begin
+        axis_beat <= 0;
+      end else begin
+        axis_words[axis_beat*32 +: 32] <= S_AXIS_TDATA;
+        axis_beat <= axis_beat + 1;
+      end
+    end
+  end
+end
+
+//Command ring memory. Port A is written from AXI, port B is read by the fetcher. Vivado infers a simple dual port BRAM.
+assign ring_we = slv_reg_wren && wr_in_ring;
+assign ring_waddr = axi_awaddr[12:2];
+assign ring_raddr = {ring_tail[7:0], ring_word_idx};
+
+always_ff @(posedge S_AXI_ACLK) begin
+  if (ring_we)
+    ring_mem[ring_waddr] <= S_AXI_WDATA;
+  ring_rdata <= ring_mem[ring_raddr];
+end
+
+//RING_HEAD is register 6, written by software once it has filled the slots.
+assign ring_head = slv_regs[6];
+
+//Ring fetcher. Reads words 0-5 of the tail slot (one cycle BRAM latency, so word n arrives while n+1 is addressed),
+//then waits for its turn at the FIFO. The ring has the lowest priority, behind AXI-Lite and the stream port.
+enum logic [1:0] {
+  ring_idle,
+  ring_read,
+  ring_wait_fifo
+} ring_state;
+
+assign ring_push = (ring_state == ring_wait_fifo) && !fifo_full && !lite_fifo_wr_en && !lite_push_now && !axis_push;
+
+always_ff @(posedge S_AXI_ACLK) begin
+  if (~S_AXI_ARESETN) begin
+    ring_state <= ring_idle;
+    ring_tail <= 0;
+    ring_word_idx <= 0;
+  end else begin
+    case (ring_state)
+      ring_idle: begin
+        ring_word_idx <= 0;
+        if (ring_head != ring_tail)
+          ring_state <= ring_read;
+      end
+      ring_read: begin
+        if (ring_word_idx != 0)
+          ring_words[(ring_word_idx - 1)*32 +: 32] <= ring_rdata;
+        if (ring_word_idx == 3'd5)
+          ring_state <= ring_wait_fifo;
+        else
+          ring_word_idx <= ring_word_idx + 1;
+      end
+      ring_wait_fifo: begin
+        //Word 5 (r_area) is on ring_rdata while we are in this state, since the address does not move.
+        if (ring_push) begin
+          ring_tail <= ring_tail + 1;
+          ring_state <= ring_idle;
+        end
+      end
+      default: ring_state <= ring_idle;
+    endcase
+  end
+end
+
+assign fifo_wr_en = lite_fifo_wr_en | axis_push | ring_push;
+always_comb begin
+  if (lite_fifo_wr_en)
+    fifo_din = lite_fifo_din;
+  else if (axis_push)
+    fifo_din = axis_pkt;
+  else
+    fifo_din = {ring_rdata, ring_words};
+end
+
 // Implement write response logic generation
 // The write response and response valid signals are asserted by the slave 
 // when axi_wready, S_AXI_WVALID, axi_wready and S_AXI_WVALID are asserted.  
@@ -452,10 +799,44 @@ end
 // and the slave is ready to accept the read address.
 // assign slv_reg_rden = axi_arready & S_AXI_ARVALID & ~axi_rvalid;////////////////////////////////////////////////3
 assign slv_reg_rden = axi_arready & S_AXI_ARVALID & ~axi_rvalid;
+//Registers:
+//  0-5  triangle staging, writing 5 pushes the packet
+//  6    RING_HEAD (doorbell), number of slots software has filled. Slot n lives at 0x2000 + (n % 256) * 32.
+//  7    RING_TAIL (read only), number of slots moved into the FIFO. Slots between tail and head must not be rewritten.
+//  8    CTRL, bit 0 = MANUAL_SWAP, bit 1 = SCANOUT_CLEAR, bit 2 = TRACE (needs TRACE_ENABLE)
+//  9    STATUS (read only), bit 0 = front, bit 1 = swap pending, bit 2 = pipeline drained
+//  10   FENCE (read only), payload of the last FENCE command the controller reached.
+//  11   SWAP_REQ, writing requests a swap at the next vsync once the pipeline drains. The value is the frame tag.
+//  12   FRAME_TAG (read only), tag of the frame on screen (with triple buffering a finished frame may still be queued).
+//  13   CLEAR_COLOR, bits 7:0 are the color untouched tiles are cleared to (default 0x00)
+//  14   RENDER_RES, 0 = 320x240, 1 = 160x120. Takes effect when the draw buffer next changes. A SWAP command can set
+//       it too (see the command decoder), reads return the last value written here.
+//  15   TRACE_COUNT, number of trace entries written. Writing restarts the trace at entry 0.
+//  16   PERF_CTRL, writing bit 0 snapshots the counters into 17-31, bit 1 resets them. Both at once for per-interval counts.
+//  17-31 performance counters (read only, snapshot), see PERF COUNTERS.
+assign rd_reg = axi_araddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB];
 always_comb
 begin
       // Address decoding for reading registers
-     reg_data_out = slv_regs[axi_araddr[ADDR_LSB+OPT_MEM_ADDR_BITS:ADDR_LSB]];
+     reg_data_out = 0;
+     if (axi_araddr[13:12] == 2'b00) begin
+       case (rd_reg)
+         7: reg_data_out = ring_tail;
+         9: reg_data_out = {29'd0, pipeline_drained, swap_pending, front};
+         10: reg_data_out = fence_value;
+         12: reg_data_out = frame_tag;
+         15: reg_data_out = trace_count;
+         default: begin
+           if (rd_reg > PERF_BASE && rd_reg < PERF_BASE + NUM_PERF)
+             reg_data_out = perf_snap[rd_reg - PERF_BASE];
+           else
+             reg_data_out = slv_regs[rd_reg];
+         end
+       endcase
+     end else if (axi_araddr[13:12] == 2'b01) begin
+       //Trace window, the entry was read out of BRAM while the address was being latched.
+       reg_data_out = trace_rdata[32*axi_araddr[3:2] +: 32];
+     end
 end
 
 // Output register or memory read data
@@ -537,11 +918,16 @@ end
 
 
 //Triangle controller states:
-enum logic [1:0] {
+enum logic [3:0] {
   clear_buf,
   wait_tri,
+  decode,
   calc_edge,
-  rasterize
+  rasterize,
+  load_verts,
+  fetch_verts,
+  clear_rect,
+  wait_swap
 } controller_state;
 
 
@@ -556,17 +942,21 @@ logic write_enable_gpu;
 logic [7:0] data_in_gpu;
 logic [16:0] addr_gpu;
 
-//Buffer signals from clear buffer.
-logic wea_clear_buf;
-logic [16:0] addra_clear_buf;
-logic [7:0] dina_clear_buf;
+//Buffer signals from the CLEAR command.
+logic wea_clear_rect;
+logic [16:0] addr_clear_rect;
+logic [7:0] color_clear_rect;
 
 //MUX to switch between.
 always_comb begin
-  if(controller_state == clear_buf) begin
-    wea = wea_clear_buf;
-    addra = addra_clear_buf;
-    dina = dina_clear_buf;
+  if(tile_busy) begin
+    wea = 1;
+    addra = addr_tile;
+    dina = clear_color;
+  end else if(controller_state == clear_rect) begin
+    wea = wea_clear_rect;
+    addra = addr_clear_rect;
+    dina = color_clear_rect;
   end else begin 
     wea = write_enable_gpu;
     addra = addr_gpu;
@@ -577,10 +967,11 @@ end
 //Buffer signals for the VGA side
 logic [7:0] doutb;
 logic [16:0] addrb;
-logic prev_front;
-logic front;
 
-framebuffer fb(
+framebuffer #(
+  .NUM_BUFFERS(NUM_FRAME_BUFFERS),
+  .USE_BRAM(FB_EXTERNAL == 0)
+) fb(
   .clk(S_AXI_ACLK),
   .rst(~S_AXI_ARESETN),
   .*
@@ -591,71 +982,188 @@ framebuffer fb(
 
 ////////////////////ZBUFFER
 //Zbuffer signals
-logic [7:0] zbuf_dout;
+logic [9:0] zbuf_dout;
 logic [16:0] zbuf_addr;
-logic [7:0] zbuf_din;
+logic [9:0] zbuf_din;
 logic zbuf_we;
 logic zbuf_en;
 assign zbuf_en = 1;
 
 //Zbuffer signals from rasterizer
-logic [7:0] zbuf_dout_raster;
+logic [9:0] zbuf_dout_raster;
 logic [16:0] zbuf_addr_raster;
-logic [7:0] zbuf_din_raster;
+logic [9:0] zbuf_din_raster;
 logic zbuf_we_raster;
 
 assign zbuf_dout_raster = zbuf_dout;
 
-//Zbuffer signals from buffer clear.
-logic [16:0] zbuf_addr_buf_clear;
-logic [7:0] zbuf_din_buf_clear;
-logic zbuf_we_buf_clear;
-logic zbuf_en_buf_clear;
+//Zbuffer signals from the CLEAR command.
+logic zbuf_we_clear_rect;
+logic [9:0] zbuf_din_clear_rect;
 
-//MUX to switch between clear buffer control and 
+//MUX to switch between the epoch wrap sweep, the CLEAR command and the rasterizer.
 always_comb begin
+  zbuf_re = 0;
   if(controller_state == clear_buf) begin
-    zbuf_addr = zbuf_addr_buf_clear;
-    zbuf_din = zbuf_din_buf_clear;
-    zbuf_we = zbuf_we_buf_clear;
+    zbuf_addr = clear_addr;
+    zbuf_din = {2'b00, 8'hFF};
+    zbuf_we = zbuf_epoch == 3;
+  end else if(controller_state == clear_rect) begin
+    zbuf_addr = addr_clear_rect;
+    zbuf_din = zbuf_din_clear_rect;
+    zbuf_we = zbuf_we_clear_rect;
   end else begin
     zbuf_addr = zbuf_addr_raster;
     zbuf_din = zbuf_din_raster;
     zbuf_we = zbuf_we_raster;
+    zbuf_re = zbuf_re_raster;
   end
 end
 
 //Single Port
-//Byte Write Enable (8 bit bytes)
-//Write width: 8
+//Write width: 10
 //Write depth: >= 768000
-// 320 * 240 * 1 B = 76.8 kB
-// width: 8 bits
+// FB_WIDTH * FB_HEIGHT * 10 bits
+// width: 10 bits, {epoch[1:0], depth[7:0]}
 // Make sure to initialize each cell to the maximum integer
 // This can either be done once on initialization through vivado
 // with a .mif or .coe file
 // OR
 // make our own reset logic
 // & also make it single port.
-blk_mem_gen_1 z_buf(
-  .clka(S_AXI_ACLK),
-  .addra(zbuf_addr),
-  .dina(zbuf_din),
-  .douta(zbuf_dout),
-  .wea(zbuf_we),
-  .ena(zbuf_en)
-);
+generate
+  if (FB_EXTERNAL == 0) begin: bram_zbuf
+    blk_mem_gen_1 z_buf(
+      .clka(S_AXI_ACLK),
+      .addra(zbuf_addr),
+      .dina(zbuf_din),
+      .douta(zbuf_dout),
+      .wea(zbuf_we),
+      .ena(zbuf_en)
+    );
+  end
+endgenerate
+
+//Only the rasterizer or the CLEAR command writes depths outside of clear_buf, so the tile they ask for is the one
+//being written. The epoch wrap sweep resets the first NUM_TILES entries along with the z buffer. A bound read while
+//the pixel before is being written is only missing that pixel's depth, and no pixel is drawn twice by a triangle.
+assign zmin_tile = req_tile_y*TILES_X + req_tile_x;
+assign zmin_cur = (tile_zmin_mem[zmin_tile][9:8] == zbuf_epoch) ? tile_zmin_mem[zmin_tile][7:0] : 8'hFF;
+assign raster_tile_zmin = zmin_cur;
+
+always_ff @(posedge S_AXI_ACLK) begin
+  if(controller_state == clear_buf) begin
+    if(zbuf_epoch == 3 && clear_addr < NUM_TILES)
+      tile_zmin_mem[clear_addr] <= {2'b00, 8'hFF};
+  end else if(zbuf_we) begin
+    tile_zmin_mem[zmin_tile] <= {zbuf_epoch, (zbuf_din[7:0] < zmin_cur) ? zbuf_din[7:0] : zmin_cur};
+  end
+end
 
 ////////////////////END ZBUFFER
 
 
+////////////////////BEGIN EXTERNAL MEMORY
+generate
+  if (FB_EXTERNAL != 0) begin: ext_mem
+    logic [15:0] z_dout;
+
+    axi_pixel_cache #(
+      .C_M_AXI_ADDR_WIDTH(C_M_AXI_ADDR_WIDTH)
+    ) pixel_cache(
+      .clk(S_AXI_ACLK),
+      .rst(~S_AXI_ARESETN),
+      .c_we(wea),
+      .c_addr(FB_BASE_ADDR + draw_buf*FB_BUF_BYTES + addra),
+      .c_din(dina),
+      .z_re(zbuf_re),
+      .z_we(zbuf_we),
+      .z_addr(FB_BASE_ADDR + FB_Z_OFFSET + {zbuf_addr, 1'b0}),
+      .z_din({6'd0, zbuf_din}),
+      .z_dout(z_dout),
+      .flush(mem_flush),
+      .clean(mem_clean),
+      .stall(mem_stall),
+      .*
+    );
+    assign zbuf_dout = z_dout[9:0];
+
+    axi_scanout_reader #(
+      .C_M_AXI_ADDR_WIDTH(C_M_AXI_ADDR_WIDTH),
+      .FB_WIDTH(FB_WIDTH)
+    ) scan_reader(
+      .clk(S_AXI_ACLK),
+      .rst(~S_AXI_ARESETN),
+      .base(FB_BASE_ADDR + disp_buf*FB_BUF_BYTES),
+      .width(9'(FB_WIDTH >> disp_res)),
+      .height(8'(FB_HEIGHT >> disp_res)),
+      .scan_x(scan_x),
+      .scan_y(scan_y),
+      .vblank(drawY >= 480),
+      .pixel(ext_pixel),
+      .underrun(scan_underrun),
+      .M_AXI_ARADDR(M_AXI_SCAN_ARADDR),
+      .M_AXI_ARLEN(M_AXI_SCAN_ARLEN),
+      .M_AXI_ARSIZE(M_AXI_SCAN_ARSIZE),
+      .M_AXI_ARBURST(M_AXI_SCAN_ARBURST),
+      .M_AXI_ARCACHE(M_AXI_SCAN_ARCACHE),
+      .M_AXI_ARPROT(M_AXI_SCAN_ARPROT),
+      .M_AXI_ARVALID(M_AXI_SCAN_ARVALID),
+      .M_AXI_ARREADY(M_AXI_SCAN_ARREADY),
+      .M_AXI_RDATA(M_AXI_SCAN_RDATA),
+      .M_AXI_RRESP(M_AXI_SCAN_RRESP),
+      .M_AXI_RLAST(M_AXI_SCAN_RLAST),
+      .M_AXI_RVALID(M_AXI_SCAN_RVALID),
+      .M_AXI_RREADY(M_AXI_SCAN_RREADY)
+    );
+  end else begin: no_ext_mem
+    assign mem_stall = 0;
+    assign mem_clean = 1;
+    assign ext_pixel = 8'h00;
+    assign scan_underrun = 0;
+    assign M_AXI_AWADDR = 0;
+    assign M_AXI_AWLEN = 0;
+    assign M_AXI_AWSIZE = 0;
+    assign M_AXI_AWBURST = 0;
+    assign M_AXI_AWCACHE = 0;
+    assign M_AXI_AWPROT = 0;
+    assign M_AXI_AWVALID = 0;
+    assign M_AXI_WDATA = 0;
+    assign M_AXI_WSTRB = 0;
+    assign M_AXI_WLAST = 0;
+    assign M_AXI_WVALID = 0;
+    assign M_AXI_BREADY = 0;
+    assign M_AXI_ARADDR = 0;
+    assign M_AXI_ARLEN = 0;
+    assign M_AXI_ARSIZE = 0;
+    assign M_AXI_ARBURST = 0;
+    assign M_AXI_ARCACHE = 0;
+    assign M_AXI_ARPROT = 0;
+    assign M_AXI_ARVALID = 0;
+    assign M_AXI_RREADY = 0;
+    assign M_AXI_SCAN_ARADDR = 0;
+    assign M_AXI_SCAN_ARLEN = 0;
+    assign M_AXI_SCAN_ARSIZE = 0;
+    assign M_AXI_SCAN_ARBURST = 0;
+    assign M_AXI_SCAN_ARCACHE = 0;
+    assign M_AXI_SCAN_ARPROT = 0;
+    assign M_AXI_SCAN_ARVALID = 0;
+    assign M_AXI_SCAN_RREADY = 0;
+  end
+endgenerate
+
+//Write back whatever the cache holds whenever the controller has nothing to draw.
+assign mem_flush = controller_state == wait_tri || controller_state == wait_swap;
+////////////////////END EXTERNAL MEMORY
+
+
 //Triangle logic
 
 
 ///// Configuration
 // Interface type: Native
 // Write/Read Width: 192 (32 * 6)
-// Depth 16 bits
+// Depth 32
 fifo_generator_0 fifo(
   .clk(S_AXI_ACLK),
   .srst(~S_AXI_ARESETN),
@@ -851,49 +1359,172 @@ always_ff @(posedge S_AXI_ACLK) begin
   end
 end
 
-assign fifo_rd_en = triangle_valid & triangle_ready;
+//Don't pop on the cycle the buffers flip, the controller drops whatever it is doing then and the command would be lost.
+assign fifo_rd_en = triangle_valid & triangle_ready & (front == prev_front);
+
+//Command processor.
+//Every FIFO entry is a command. The opcode sits in the top byte of word 4, which the original triangle packet
+//left as 0, so old packets still decode as DRAW_TRI. Word layouts (v = {y[23:16], x[8:0]} like a triangle vertex):
+//  DRAW_TRI      triangle packet as before.
+//  LOAD_VERTS    triangle packet layout, but word 5 is a base index. Stores v1, v2, v3 with their z at vertex table
+//                entries base, base+1, base+2.
+//  DRAW_INDEXED  word 0 = {i3, i2, i1} vertex table indices, word 4 = {op, color, 16'd0}, word 5 = inv_area.
+//  CLEAR         word 0 = top left v, word 3 = bottom right v (inclusive), word 1[7:0] = depth value,
+//                word 4 = {op, color, 14'd0, clear_depth, clear_color}.
+//  SET_SCISSOR   word 0 = top left v, word 3 = bottom right v (inclusive). Triangles are only drawn inside it.
+//  SWAP          request a buffer swap and wait for it before running anything else. Word 5 is the frame tag,
+//                which shows up in the FRAME_TAG register once that frame is on screen. If word 4 bit 1 is set,
+//                word 4 bit 0 is the render resolution (like RENDER_RES) of the frame after the swap.
+//  FENCE         word 5 is copied to the FENCE register once every earlier command has finished.
+//  STRIP, FAN    one new vertex in the v3 fields (word 3 = v, word 4 = {op, color, z}, word 5 = inv_area), so only
+//                words 3-5 need writing. The other two vertices are ones kept from the last triangle drawn: a
+//                triangle drawn as v1, v2, v3 keeps center = v1, last two = v2, v3. STRIP draws the last two then
+//                the new one, swapped on every other STRIP so the whole strip keeps the first triangle's winding,
+//                FAN draws center, the last one and the new one. Both then shift the new vertex into the last two.
+//  DRAW_QUAD     DRAW_INDEXED with a fourth index, word 0 = {i4, i3, i2, i1}. Draws the convex, planar quad i1, i2, i3,
+//                i4 in one walk of its bounding box, inv_area is that of the triangle i1, i2, i3 and the depth comes
+//                from that triangle's plane. Keeps the vertices for STRIP and FAN like DRAW_INDEXED.
+localparam logic [7:0] OP_DRAW_TRI     = 8'h00;
+localparam logic [7:0] OP_LOAD_VERTS   = 8'h01;
+localparam logic [7:0] OP_DRAW_INDEXED = 8'h02;
+localparam logic [7:0] OP_CLEAR        = 8'h03;
+localparam logic [7:0] OP_SET_SCISSOR  = 8'h04;
+localparam logic [7:0] OP_SWAP         = 8'h05;
+localparam logic [7:0] OP_FENCE        = 8'h06;
+localparam logic [7:0] OP_STRIP        = 8'h07;
+localparam logic [7:0] OP_FAN          = 8'h08;
+localparam logic [7:0] OP_DRAW_QUAD     = 8'h09;
+
+//Current command, latched in the decode state. Draw commands keep the triangle layout here so the edge and raster
+//stages read their fields from it (DRAW_INDEXED fills in the vertices from the vertex table).
+logic [191:0] cmd;
+logic [7:0] opcode;
+assign opcode = fifo_dout[159:152];
+
+assign inv_area = cmd[191:160];
+assign color = cmd[151:144];
+assign z3 = cmd[143:128];
+assign v3y = cmd[119:112];
+assign v3x = cmd[104:96];
+assign z2 = cmd[95:80];
+assign v2y = cmd[71:64];
+assign v2x = cmd[56:48];
+assign z1 = cmd[47:32];
+assign v1y = cmd[23:16];
+assign v1x = cmd[8:0];
+
+//Vertex table for LOAD_VERTS and DRAW_INDEXED. Each entry is {z, y, x}. Small enough for distributed or block RAM.
+logic [32:0] vtx_mem[256];
+logic vtx_we;
+logic [7:0] vtx_waddr;
+logic [7:0] vtx_raddr;
+logic [32:0] vtx_din;
+logic [32:0] vtx_dout;
+logic [31:0] vtx_idx;
+logic [2:0] cmd_step;
+
+always_ff @(posedge S_AXI_ACLK) begin
+  if (vtx_we)
+    vtx_mem[vtx_waddr] <= vtx_din;
+  vtx_dout <= vtx_mem[vtx_raddr];
+end
+
+assign vtx_we = controller_state == load_verts;
+assign vtx_waddr = cmd[167:160] + cmd_step;
+always_comb begin
+  case (cmd_step)
+    3'd0: vtx_din = {z1, v1y, v1x};
+    3'd1: vtx_din = {z2, v2y, v2x};
+    default: vtx_din = {z3, v3y, v3x};
+  endcase
+  case (cmd_step)
+    3'd0: vtx_raddr = vtx_idx[7:0];
+    3'd1: vtx_raddr = vtx_idx[15:8];
+    3'd2: vtx_raddr = vtx_idx[23:16];
+    default: vtx_raddr = vtx_idx[31:24];
+  endcase
+end
+
+//Vertices kept for STRIP and FAN, {z, y, x} like the vertex table. prim_odd is set when the next STRIP swaps.
+logic [32:0] prim_center, prim_last1, prim_last2;
+logic prim_odd;
+logic [32:0] prim_new;
+assign prim_new = {fifo_dout[143:128], fifo_dout[119:112], fifo_dout[104:96]};
+
+//Fourth corner of a DRAW_QUAD, {y, x}. Its depth isn't needed, the quad is planar.
+logic [16:0] quad_v4;
 
-assign inv_area = fifo_dout[191:160];
-assign color = fifo_dout[151:144];
-assign z3 = fifo_dout[143:128];
-assign v3y = fifo_dout[119:112];
-assign v3x = fifo_dout[104:96];
-assign z2 = fifo_dout[95:80];
-assign v2y = fifo_dout[71:64];
-assign v2x = fifo_dout[56:48];
-assign z1 = fifo_dout[47:32];
-assign v1y = fifo_dout[23:16];
-assign v1x = fifo_dout[8:0];
+//Scissor rectangle, inclusive. Defaults to the whole buffer, and is always limited to the render resolution.
+logic [8:0] scissor_x0, scissor_x1;
+logic [7:0] scissor_y0, scissor_y1;
+
+//CLEAR command progress.
+logic [8:0] clr_x, clr_x0, clr_x1;
+logic [7:0] clr_y, clr_y1;
+assign addr_clear_rect = clr_y*FB_WIDTH + clr_x;
+assign wea_clear_rect = cmd[128] && clr_tile_valid;
+assign zbuf_we_clear_rect = cmd[129] && clr_tile_valid;
+assign color_clear_rect = color;
+assign zbuf_din_clear_rect = {zbuf_epoch, z1[7:0]};
 
 ////////////////////BEGIN EDGES & BOUNDING BOX STAGE (3 clock cycles)
 //Calculate Edge equations using vertices, and bounding box.
 
 //Vertices. I renamed these so that we can differentiate from the ones coming out of the FIFO/AXI. We need these to be 1 triangle at a time in the controller.
-logic [8:0] v1x_in, v2x_in, v3x_in;
-logic [7:0] v1y_in, v2y_in, v3y_in;
+logic [8:0] v1x_in, v2x_in, v3x_in, v4x_in;
+logic [7:0] v1y_in, v2y_in, v3y_in, v4y_in;
 assign v1x_in = v1x;
 assign v2x_in = v2x;
 assign v3x_in = v3x;
 assign v1y_in = v1y;
 assign v2y_in = v2y;
 assign v3y_in = v3y;
+//A triangle is a quad with v4 = v1.
+assign v4x_in = (cmd[159:152] == OP_DRAW_QUAD) ? quad_v4[8:0] : v1x;
+assign v4y_in = (cmd[159:152] == OP_DRAW_QUAD) ? quad_v4[16:9] : v1y;
 //Edge handshaking protocol. We assert edge_start for 1 clock cycle when the data in is valid. We then wait for edge_done before retrieving data and continuing to next stage. Expect a 2 clock cycle latency.
 logic edge_start;
 logic edge_done;
+logic bbox_done;
 
 //Edge equation coefficients.
-logic signed [9:0] a1, b1, a2, b2, a3, b3;
-logic signed [17:0] c1, c2, c3;
+logic signed [9:0] a1, b1, a2, b2, a3, b3, a4, b4, a5, b5;
+logic signed [17:0] c1, c2, c3, c4, c5;
 logic [8:0] bbxi;
 logic [8:0] bbxf;
 logic [7:0] bbyi;
 logic [7:0] bbyf; 
 
+//Triangle bounding box before the scissor is applied.
+logic [8:0] tri_bbxi;
+logic [8:0] tri_bbxf;
+logic [7:0] tri_bbyi;
+logic [7:0] tri_bbyf;
+logic bbox_empty;
+
 edge_eq_bb edge_calc(
  .clk(S_AXI_ACLK),
  .rst(~S_AXI_ARESETN),
+ .bbxi(tri_bbxi),
+ .bbxf(tri_bbxf),
+ .bbyi(tri_bbyi),
+ .bbyf(tri_bbyf),
  .*
 );
+
+//Clip the bounding box to the scissor. If nothing is left we skip the rasterizer entirely.
+assign bbxi = (tri_bbxi < scissor_x0) ? scissor_x0 : tri_bbxi;
+assign bbxf = (tri_bbxf > scissor_x1_eff) ? scissor_x1_eff : tri_bbxf;
+assign bbyi = (tri_bbyi < scissor_y0) ? scissor_y0 : tri_bbyi;
+assign bbyf = (tri_bbyf > scissor_y1_eff) ? scissor_y1_eff : tri_bbyf;
+assign bbox_empty = (bbxi > bbxf) || (bbyi > bbyf);
+
+//Triangles (and quads) with a bounding box up to 4x4 take the rasterizer's small triangle path, which doesn't need
+//the c coefficients, so they can go as soon as the bounding box is known.
+logic small;
+logic edge_ready;
+assign small = (tri_bbxf - tri_bbxi < 4) && (tri_bbyf - tri_bbyi < 4);
+assign edge_ready = edge_done || (bbox_done && small);
 ////////////////////END EDGES & BOUNDING BOX STAGE
 
 
@@ -905,22 +1536,128 @@ logic rasterizer_done;
 
 
 
-rasterizer raster(
+//A buffer flip abandons the triangle in flight, the same as the controller.
+rasterizer #(
+  .FB_WIDTH(FB_WIDTH)
+) raster(
   .clk(S_AXI_ACLK),
-  .rst(~S_AXI_ARESETN),
+  .rst(~S_AXI_ARESETN || front != prev_front),
   .zbuf_dout(zbuf_dout_raster),
   .zbuf_addr(zbuf_addr_raster),
   .zbuf_din(zbuf_din_raster),
   .zbuf_we(zbuf_we_raster),
+  .zbuf_re(zbuf_re_raster),
+  .mem_stall(mem_stall),
+  .tile_x(raster_tile_x),
+  .tile_y(raster_tile_y),
+  .tile_valid(raster_tile_valid),
+  .tile_miss(raster_tile_miss),
+  .tile_zmin(raster_tile_zmin),
   .*
 );
 ////////////////////END RASTERIZER STAGE
 
 
-////////////////////BEGIN PIPELINE CONTROLLER
-logic buffers_cleared;
-logic [16:0] clear_addr;
+////////////////////BEGIN LAZY TILE CLEAR
+assign draw_res = buf_res[draw_buf];
+assign disp_res = buf_res[disp_buf];
+assign render_x1 = (FB_WIDTH >> draw_res) - 1;
+assign render_y1 = (FB_HEIGHT >> draw_res) - 1;
+assign scissor_x1_eff = (scissor_x1 > render_x1) ? render_x1 : scissor_x1;
+assign scissor_y1_eff = (scissor_y1 > render_y1) ? render_y1 : scissor_y1;
+assign clear_color = slv_regs[13][7:0];
+assign raster_tile_valid = tile_valid_bits[draw_buf][raster_tile_y*TILES_X + raster_tile_x];
+assign clr_tile_valid = tile_valid_bits[draw_buf][clr_y[7:3]*TILES_X + clr_x[8:3]];
 
+//Only one of the rasterizer and the CLEAR command can be waiting on a tile at a time.
+assign req_tile_x = (controller_state == clear_rect) ? clr_x[8:3] : raster_tile_x;
+assign req_tile_y = (controller_state == clear_rect) ? clr_y[7:3] : raster_tile_y;
+assign tile_start = (controller_state == clear_rect) ? !clr_tile_valid : (raster_tile_miss && !raster_tile_valid);
+
+//One pixel of the tile per cycle, 64 cycles per tile.
+assign addr_tile = (tile_y0 + tile_px[5:3])*FB_WIDTH + tile_x0 + tile_px[2:0];
+
+always_ff @(posedge S_AXI_ACLK) begin
+  if (~S_AXI_ARESETN) begin
+    tile_busy <= 0;
+    tile_px <= 0;
+    for (int i = 0; i < NUM_FRAME_BUFFERS; i++)
+      tile_valid_bits[i] <= '0;
+  end else if (front != prev_front) begin
+    //The draw buffer just changed under us, drop the tile. clear_buf resets the new buffer's bits next cycle.
+    tile_busy <= 0;
+  end else begin
+    if (controller_state == clear_buf)
+      tile_valid_bits[draw_buf] <= '0;
+    if (tile_busy && !mem_stall) begin
+      tile_px <= tile_px + 1;
+      if (tile_px == 63) begin
+        tile_busy <= 0;
+        tile_valid_bits[draw_buf][tile_cur] <= 1;
+      end
+    end else if (tile_start) begin
+      if (color_clean[draw_buf]) begin
+        //Nothing to write, the scanout already cleared the color and depth goes by epoch.
+        tile_valid_bits[draw_buf][req_tile_y*TILES_X + req_tile_x] <= 1;
+      end else begin
+        tile_busy <= 1;
+        tile_px <= 0;
+        tile_cur <= req_tile_y*TILES_X + req_tile_x;
+        tile_x0 <= {req_tile_x, 3'b000};
+        tile_y0 <= {req_tile_y, 3'b000};
+      end
+    end
+  end
+end
+////////////////////END LAZY TILE CLEAR
+
+
+////////////////////SWAP CONTROL
+assign manual_swap = slv_regs[8][0];
+assign swap_req_wr = slv_reg_wren && wr_in_regs && wr_reg == 11;
+assign swap_req_cmd = controller_state == decode && opcode == OP_SWAP;
+
+//Nothing left to draw from before the swap: either the controller reached a SWAP command,
+//or it is idle with nothing queued anywhere upstream of it.
+//With external memory the cache also has to have written everything back.
+assign pipeline_drained = mem_clean &&
+                          (controller_state == wait_swap ||
+                           (controller_state == wait_tri && fifo_empty && !triangle_valid && !fifo_wr_en &&
+                            !lite_fifo_wr_en && !axis_pkt_valid && axis_beat == 0 &&
+                            ring_state == ring_idle && ring_head == ring_tail));
+assign swap_en = ~manual_swap || (swap_pending && pipeline_drained);
+
+//With triple buffering a finished frame doesn't wait for vsync, the framebuffer queues it and hands us a free buffer.
+//In automatic mode every vsync finishes a frame, the same as double buffering.
+//front == prev_front keeps this to one pulse, swap_pending only drops the cycle after the buffers change.
+assign frame_done = manual_swap ? (swap_pending && pipeline_drained && front == prev_front) :
+                                  (prev_vsync_sync & ~vsync_sync2);
+
+always_ff @(posedge S_AXI_ACLK) begin
+  if (~S_AXI_ARESETN) begin
+    swap_pending <= 0;
+    swap_tag <= 0;
+    render_res_next <= 0;
+  end else begin
+    if (slv_reg_wren && wr_in_regs && wr_reg == 14)
+      render_res_next <= S_AXI_WDATA[0];
+    else if (swap_req_cmd && fifo_dout[129])
+      render_res_next <= fifo_dout[128];
+    if (front != prev_front)
+      swap_pending <= 0;
+    if (swap_req_wr) begin
+      swap_pending <= 1;
+      swap_tag <= S_AXI_WDATA;
+    end else if (swap_req_cmd) begin
+      swap_pending <= 1;
+      swap_tag <= fifo_dout[191:160];
+    end
+  end
+end
+////////////////////END SWAP CONTROL
+
+
+////////////////////BEGIN PIPELINE CONTROLLER
 
 //Used to prevent clock domain crossing since the memory runs at 100 MHz and vsync is at 25 MHz, causes front to trigger multiple times.
 always_ff @(posedge S_AXI_ACLK) begin
@@ -941,50 +1678,174 @@ always_ff @(posedge S_AXI_ACLK) begin
     triangle_ready <= 0;
     edge_start <= 0;
     rasterizer_start <= 0;
-    buffers_cleared <= 0;
+    cmd_step <= 0;
+    //Sweep on the way out of reset, the z buffer starts with anything in it.
+    zbuf_epoch <= 3;
     clear_addr <= 0;
+    scissor_x0 <= 0;
+    scissor_y0 <= 0;
+    scissor_x1 <= FB_WIDTH - 1;
+    scissor_y1 <= FB_HEIGHT - 1;
+    for (int i = 0; i < NUM_FRAME_BUFFERS; i++)
+      buf_res[i] <= 0;
+    fence_value <= 0;
+    prim_center <= 0;
+    prim_last1 <= 0;
+    prim_last2 <= 0;
+    prim_odd <= 0;
   end else begin
     if(front != prev_front) begin
       controller_state <= clear_buf;
-      buffers_cleared <= 0;
+      triangle_ready <= 0;
+      edge_start <= 0;
+      rasterizer_start <= 0;
       clear_addr <= 0;
     end else begin
       case(controller_state) 
         clear_buf: begin
-          triangle_ready <= 0;
-          if(~buffers_cleared) begin
-            // Clear both buffers
-            zbuf_we_buf_clear <= 1;
-            zbuf_addr_buf_clear <= clear_addr;
-            zbuf_din_buf_clear <= 8'hFF;
-            
-            wea_clear_buf <= 1;
-            addra_clear_buf <= clear_addr;
-            dina_clear_buf <= 8'h00;
-
-            clear_addr <= clear_addr + 1;
-
-            if(clear_addr == 76799) begin
-              buffers_cleared <= 1;
-              zbuf_we_buf_clear <= 0;
-              wea_clear_buf <= 0;
+          buf_res[draw_buf] <= render_res_next;
+          //The tile bits of the new draw buffer are reset here (see LAZY TILE CLEAR) and the z buffer moves to the
+          //next epoch, that is the whole clear. Only when the epoch wraps do we sweep the z buffer, one entry per cycle.
+          if(zbuf_epoch == 3) begin
+            if(!mem_stall)
+              clear_addr <= clear_addr + 1;
+            if(clear_addr == FB_WIDTH*FB_HEIGHT - 1 && !mem_stall) begin
+              clear_addr <= 0;
+              zbuf_epoch <= 1;
               triangle_ready <= 1;
               controller_state <= wait_tri;
             end
+          end else begin
+            zbuf_epoch <= zbuf_epoch + 1;
+            triangle_ready <= 1;
+            controller_state <= wait_tri;
           end
         end
         wait_tri: begin
           if(triangle_ready && triangle_valid) begin
-            edge_start <= 1;
             triangle_ready <= 0;
-            controller_state <= calc_edge;
+            controller_state <= decode;
+          end
+        end
+        decode: begin
+          //The FIFO output is valid the cycle after the pop.
+          cmd <= fifo_dout;
+          cmd_step <= 0;
+          case(opcode)
+            OP_DRAW_TRI: begin
+              prim_center <= {fifo_dout[47:32], fifo_dout[23:16], fifo_dout[8:0]};
+              prim_last1 <= {fifo_dout[95:80], fifo_dout[71:64], fifo_dout[56:48]};
+              prim_last2 <= prim_new;
+              prim_odd <= 1;
+              edge_start <= 1;
+              controller_state <= calc_edge;
+            end
+            OP_STRIP, OP_FAN: begin
+              //v3, color and inv_area come with the command, v1 and v2 are the kept vertices.
+              if(opcode == OP_FAN)
+                {cmd[47:32], cmd[23:16], cmd[8:0]} <= prim_center;
+              else
+                {cmd[47:32], cmd[23:16], cmd[8:0]} <= prim_odd ? prim_last2 : prim_last1;
+              {cmd[95:80], cmd[71:64], cmd[56:48]} <= (opcode == OP_STRIP && prim_odd) ? prim_last1 : prim_last2;
+              prim_last1 <= prim_last2;
+              prim_last2 <= prim_new;
+              if(opcode == OP_STRIP)
+                prim_odd <= !prim_odd;
+              edge_start <= 1;
+              controller_state <= calc_edge;
+            end
+            OP_LOAD_VERTS: begin
+              controller_state <= load_verts;
+            end
+            OP_DRAW_INDEXED, OP_DRAW_QUAD: begin
+              vtx_idx <= fifo_dout[31:0];
+              controller_state <= fetch_verts;
+            end
+            OP_CLEAR: begin
+              clr_x <= fifo_dout[8:0];
+              clr_x0 <= fifo_dout[8:0];
+              clr_y <= fifo_dout[23:16];
+              clr_x1 <= (fifo_dout[104:96] > render_x1) ? render_x1 : fifo_dout[104:96];
+              clr_y1 <= (fifo_dout[119:112] > render_y1) ? render_y1 : fifo_dout[119:112];
+              if(fifo_dout[104:96] < fifo_dout[8:0] || fifo_dout[119:112] < fifo_dout[23:16] ||
+                 fifo_dout[8:0] > render_x1 || fifo_dout[23:16] > render_y1) begin
+                triangle_ready <= 1;
+                controller_state <= wait_tri;
+              end else begin
+                controller_state <= clear_rect;
+              end
+            end
+            OP_SET_SCISSOR: begin
+              scissor_x0 <= fifo_dout[8:0];
+              scissor_y0 <= fifo_dout[23:16];
+              scissor_x1 <= (fifo_dout[104:96] > FB_WIDTH - 1) ? 9'(FB_WIDTH - 1) : fifo_dout[104:96];
+              scissor_y1 <= (fifo_dout[119:112] > FB_HEIGHT - 1) ? 8'(FB_HEIGHT - 1) : fifo_dout[119:112];
+              triangle_ready <= 1;
+              controller_state <= wait_tri;
+            end
+            OP_SWAP: begin
+              controller_state <= wait_swap;
+            end
+            OP_FENCE: begin
+              fence_value <= fifo_dout[191:160];
+              triangle_ready <= 1;
+              controller_state <= wait_tri;
+            end
+            default: begin
+              //Unknown opcode, skip it.
+              triangle_ready <= 1;
+              controller_state <= wait_tri;
+            end
+          endcase
+        end
+        load_verts: begin
+          //One vertex table write per cycle (vtx_we is high in this state).
+          cmd_step <= cmd_step + 1;
+          if(cmd_step == 2) begin
+            triangle_ready <= 1;
+            controller_state <= wait_tri;
           end
         end
+        fetch_verts: begin
+          //Vertex table reads have 1 cycle latency, so entry n arrives while n+1 is addressed.
+          cmd_step <= cmd_step + 1;
+          case(cmd_step)
+            3'd1: begin
+              {cmd[47:32], cmd[23:16], cmd[8:0]} <= vtx_dout;
+              prim_center <= vtx_dout;
+            end
+            3'd2: begin
+              {cmd[95:80], cmd[71:64], cmd[56:48]} <= vtx_dout;
+              prim_last1 <= vtx_dout;
+            end
+            3'd3: begin
+              {cmd[143:128], cmd[119:112], cmd[104:96]} <= vtx_dout;
+              prim_last2 <= vtx_dout;
+              prim_odd <= 1;
+              if(cmd[159:152] != OP_DRAW_QUAD) begin
+                edge_start <= 1;
+                controller_state <= calc_edge;
+              end
+            end
+            3'd4: begin
+              quad_v4 <= vtx_dout[16:0];
+              edge_start <= 1;
+              controller_state <= calc_edge;
+            end
+            default: ;
+          endcase
+        end
         calc_edge: begin
           edge_start <= 0;
-          if(edge_done) begin
-            rasterizer_start <= 1;
-            controller_state <= rasterize;
+          if(edge_ready) begin
+            if(bbox_empty) begin
+              //Completely outside the scissor.
+              triangle_ready <= 1;
+              controller_state <= wait_tri;
+            end else begin
+              rasterizer_start <= 1;
+              controller_state <= rasterize;
+            end
           end
         end
         rasterize: begin
@@ -994,10 +1855,28 @@ always_ff @(posedge S_AXI_ACLK) begin
             triangle_ready <= 1;
           end
         end
+        clear_rect: begin
+          //One pixel per cycle, the write for (clr_x, clr_y) happens this cycle.
+          //The first pixel in an uncleared tile waits for the tile engine instead.
+          if(clr_tile_valid && !mem_stall) begin
+            if(clr_x == clr_x1) begin
+              clr_x <= clr_x0;
+              if(clr_y == clr_y1) begin
+                triangle_ready <= 1;
+                controller_state <= wait_tri;
+              end else begin
+                clr_y <= clr_y + 1;
+              end
+            end else begin
+              clr_x <= clr_x + 1;
+            end
+          end
+        end
+        wait_swap: begin
+          //Nothing to do, the buffer flip above moves us to clear_buf.
+        end
         default: begin
             controller_state <= clear_buf;
-            buffers_cleared <= 0;
-            clear_addr <= 0;
         end
       endcase
     end
@@ -1011,11 +1890,213 @@ end
 
 //Pixel drawing logic:
 //Calculate address in the frame buffer for the current x and y we are drawing for.
-assign addrb = drawY[8:1]*320 + drawX[9:1];
+//Upscale by 2 at 320x240 and by 4 at 160x120.
+assign scan_x = disp_res ? drawX[9:2] : drawX[9:1];
+assign scan_y = disp_res ? drawY[8:2] : drawY[8:1];
+assign addrb = scan_y*FB_WIDTH + scan_x;
 
 //Retrieve the data combinationally since our VGA clock is 4x slower (25 MHz vs 100MHz AXI clock)
+//Tiles nothing touched since the buffer was cleared still hold an old frame, show the clear color instead.
 logic [7:0] pixel_data;
-assign pixel_data = doutb;
+assign disp_tile_valid = tile_valid_bits[disp_buf][scan_y[7:3]*TILES_X + scan_x[8:3]];
+assign pixel_data = !disp_tile_valid ? clear_color : (FB_EXTERNAL != 0) ? ext_pixel : doutb;
+
+////////////////////BEGIN SCANOUT CLEAR
+//Every pixel is read 4 times at 2x2 upscaling (16 at 4x4), the last read is the bottom right one. We write the
+//clear color the cycle the scan moves off it. This is only done for frames that are certain to be replaced at the next vsync,
+//otherwise a frame shown twice would come up blank the second time.
+//Not with external memory, the scanout there is read only.
+assign scan_clear_en = slv_regs[8][1] && FB_EXTERNAL == 0;
+//Automatic swapping flips every vsync. In manual mode that is only certain once the controller is parked on a
+//SWAP command (double buffering) or a finished frame is queued (triple buffering).
+assign scan_will_flip = ~manual_swap || (NUM_FRAME_BUFFERS == 2 ? controller_state == wait_swap : ready_valid);
+assign scan_addr = scan_prev_addr;
+assign scan_din = clear_color;
+assign scan_we = scan_frame_ok && scan_last_read && addrb != scan_prev_addr;
+
+always_ff @(posedge S_AXI_ACLK) begin
+  if (~S_AXI_ARESETN) begin
+    scan_frame_ok <= 0;
+    scan_last_read <= 0;
+    scan_prev_addr <= 0;
+    prev_draw_buf <= 0;
+    prev_disp_buf <= 0;
+    color_clean <= 0;
+  end else begin
+    scan_last_read <= (disp_res ? (&drawX[1:0] && &drawY[1:0]) : (drawX[0] && drawY[0])) && drawX < 640 && drawY < 480;
+    scan_prev_addr <= addrb;
+    if (drawX == 0 && drawY == 0)
+      scan_frame_ok <= scan_clear_en && scan_will_flip;
+    else if (~scan_clear_en)
+      scan_frame_ok <= 0;
+
+    //A buffer that was drawn into is dirty. One leaving the screen is clean if the whole frame was cleared.
+    prev_draw_buf <= draw_buf;
+    prev_disp_buf <= disp_buf;
+    if (draw_buf != prev_draw_buf)
+      color_clean[prev_draw_buf] <= 0;
+    //The scanout only cleared the part of the buffer it showed, so a bigger resolution isn't clean.
+    if (controller_state == clear_buf && render_res_next < buf_res[draw_buf])
+      color_clean[draw_buf] <= 0;
+    if (disp_buf != prev_disp_buf)
+      color_clean[prev_disp_buf] <= scan_frame_ok;
+  end
+end
+////////////////////END SCANOUT CLEAR
+
+
+////////////////////BEGIN PERF COUNTERS
+//  17 CYC_CLEAR_BUF   cycles in clear_buf
+//  18 CYC_WAIT_TRI    cycles in wait_tri
+//  19 CYC_CALC_EDGE   cycles in calc_edge
+//  20 CYC_RASTERIZE   cycles in rasterize
+//  21 CYC_OTHER       cycles in every other state (decode, vertex commands, CLEAR, wait_swap)
+//  22 TRI_ACCEPTED    draw commands pushed into the FIFO from any source (DRAW_TRI, DRAW_INDEXED, STRIP, FAN and
+//                     DRAW_QUAD), not CLEAR, SWAP, FENCE, SET_SCISSOR or LOAD_VERTS
+//  23 TRI_DROPPED     packets lost: AXI-Lite pushes into a full FIFO, short stream packets, and triangles cut off by a flip
+//  24 PIX_VISITED     pixels the rasterizer stepped over in bounding boxes
+//  25 PIX_INSIDE      of those, pixels inside the triangle
+//  26 PIX_ZPASS       pixels that passed the depth test and were written
+//  27 PIX_ZFAIL       pixels that failed the depth test
+//  28 FIFO_HWM        most packets the FIFO held at once
+//  29 FRAME_CYCLES    cycles between the last two draw buffer changes
+//  30-31 CYCLES       64 bit cycle count, low word first
+assign perf_ctrl_wr = slv_reg_wren && wr_in_regs && wr_reg == PERF_BASE;
+
+always_ff @(posedge S_AXI_ACLK) begin
+  if (~S_AXI_ARESETN) begin
+    for (int i = 0; i < NUM_PERF; i++) begin
+      perf_live[i] <= 0;
+      perf_snap[i] <= 0;
+    end
+    frame_cycle_count <= 0;
+    fifo_level <= 0;
+  end else begin
+    //The FIFO level is needed for the high-water mark, fifo_generator_0 doesn't give us a count.
+    fifo_level <= fifo_level + fifo_wr_en - fifo_rd_en;
+    frame_cycle_count <= frame_cycle_count + 1;
+    if (front != prev_front) begin
+      perf_live[PERF_FRAME_CYCLES] <= frame_cycle_count;
+      frame_cycle_count <= 1;
+    end
+
+    case (controller_state)
+      clear_buf: perf_live[PERF_CYC_CLEAR_BUF] <= perf_live[PERF_CYC_CLEAR_BUF] + 1;
+      wait_tri: perf_live[PERF_CYC_WAIT_TRI] <= perf_live[PERF_CYC_WAIT_TRI] + 1;
+      calc_edge: perf_live[PERF_CYC_CALC_EDGE] <= perf_live[PERF_CYC_CALC_EDGE] + 1;
+      rasterize: perf_live[PERF_CYC_RASTERIZE] <= perf_live[PERF_CYC_RASTERIZE] + 1;
+      default: perf_live[PERF_CYC_OTHER] <= perf_live[PERF_CYC_OTHER] + 1;
+    endcase
+    if (fifo_wr_en && (fifo_din[159:152] == OP_DRAW_TRI || fifo_din[159:152] == OP_DRAW_INDEXED ||
+                       fifo_din[159:152] == OP_STRIP || fifo_din[159:152] == OP_FAN ||
+                       fifo_din[159:152] == OP_DRAW_QUAD))
+      perf_live[PERF_TRI_ACCEPTED] <= perf_live[PERF_TRI_ACCEPTED] + 1;
+    //The three ways to lose a packet are independent and can land on the same cycle.
+    perf_live[PERF_TRI_DROPPED] <= perf_live[PERF_TRI_DROPPED] +
+        (slv_reg_wren && wr_in_regs && wr_reg == 5 && fifo_full) +
+        (S_AXIS_TVALID && S_AXIS_TREADY && axis_beat != 3'd5 && S_AXIS_TLAST) +
+        (front != prev_front && (controller_state == calc_edge || controller_state == rasterize));
+    if (px_visit)
+      perf_live[PERF_PIX_VISITED] <= perf_live[PERF_PIX_VISITED] + 1;
+    if (px_inside)
+      perf_live[PERF_PIX_INSIDE] <= perf_live[PERF_PIX_INSIDE] + 1;
+    if (px_zpass)
+      perf_live[PERF_PIX_ZPASS] <= perf_live[PERF_PIX_ZPASS] + 1;
+    if (px_zfail)
+      perf_live[PERF_PIX_ZFAIL] <= perf_live[PERF_PIX_ZFAIL] + 1;
+    if (fifo_level > perf_live[PERF_FIFO_HWM])
+      perf_live[PERF_FIFO_HWM] <= fifo_level;
+    {perf_live[PERF_CYCLES_HI], perf_live[PERF_CYCLES_LO]} <=
+        {perf_live[PERF_CYCLES_HI], perf_live[PERF_CYCLES_LO]} + 1;
+
+    //Snapshot takes this cycle's values, then the reset starts everything over. The frame length is left alone.
+    if (perf_ctrl_wr && S_AXI_WDATA[0]) begin
+      for (int i = 1; i < NUM_PERF; i++)
+        perf_snap[i] <= perf_live[i];
+    end
+    if (perf_ctrl_wr && S_AXI_WDATA[1]) begin
+      for (int i = 1; i < NUM_PERF; i++)
+        if (i != PERF_FRAME_CYCLES)
+          perf_live[i] <= 0;
+    end
+  end
+end
+////////////////////END PERF COUNTERS
+
+
+////////////////////BEGIN TRIANGLE TRACE
+//With CTRL bit 2 set, every triangle that reaches calc_edge leaves one entry when it is finished, culled or cut off
+//by a flip. The trace is a ring, software reads TRACE_COUNT to know where it is and writes it to start over.
+//  word 0  CYCLES counter (register 30) when the command came out of the FIFO
+//  word 1  [31:20] frame number (flips since reset), [19:16] flags, [15:0] setup cycles (decode to rasterizer start)
+//          flags: bit 0 = culled by the scissor, bit 1 = cut off by a flip, bit 2 = DRAW_INDEXED, bit 3 = DRAW_QUAD
+//  word 2  rasterizer cycles
+//  word 3  [31:16] pixels written, [15:0] pixels visited, both stick at 0xFFFF
+assign trace_on = slv_regs[8][2] && TRACE_ENABLE != 0;
+assign trace_entry = {trace_written, trace_visited, trace_raster,
+                      trace_frame, trace_flags, trace_setup, trace_pop_time};
+
+always_comb begin
+  trace_fire = 0;
+  trace_flags = {cmd[159:152] == OP_DRAW_QUAD, cmd[159:152] == OP_DRAW_INDEXED, 2'b00};
+  if (front != prev_front) begin
+    trace_fire = controller_state == calc_edge || controller_state == rasterize;
+    trace_flags[1] = 1;
+  end else if (controller_state == calc_edge && edge_ready && bbox_empty) begin
+    trace_fire = 1;
+    trace_flags[0] = 1;
+  end else if (controller_state == rasterize && rasterizer_done) begin
+    trace_fire = 1;
+  end
+end
+
+always_ff @(posedge S_AXI_ACLK) begin
+  if (~S_AXI_ARESETN) begin
+    trace_count <= 0;
+    trace_frame <= 0;
+  end else begin
+    if (fifo_rd_en)
+      trace_pop_time <= perf_live[PERF_CYCLES_LO];
+    if (controller_state == decode) begin
+      trace_setup <= 1;
+      trace_raster <= 0;
+      trace_visited <= 0;
+      trace_written <= 0;
+    end else begin
+      if ((controller_state == fetch_verts || controller_state == calc_edge) && trace_setup != 16'hFFFF)
+        trace_setup <= trace_setup + 1;
+      if (controller_state == rasterize)
+        trace_raster <= trace_raster + 1;
+      if (px_visit && trace_visited != 16'hFFFF)
+        trace_visited <= trace_visited + 1;
+      if (px_zpass && trace_written != 16'hFFFF)
+        trace_written <= trace_written + 1;
+    end
+    if (front != prev_front)
+      trace_frame <= trace_frame + 1;
+    if (slv_reg_wren && wr_in_regs && wr_reg == 15)
+      trace_count <= 0;
+    else if (trace_on && trace_fire)
+      trace_count <= trace_count + 1;
+  end
+end
+
+generate
+  if (TRACE_ENABLE != 0) begin: trace
+    //Simple dual port BRAM, 256 x 128. The read is started with the AXI read address so the data is ready when
+    //the read data register loads.
+    logic [127:0] trace_mem[TRACE_ENTRIES];
+    always_ff @(posedge S_AXI_ACLK) begin
+      if (trace_on && trace_fire)
+        trace_mem[trace_count[7:0]] <= trace_entry;
+      if (~axi_arready && S_AXI_ARVALID)
+        trace_rdata <= trace_mem[S_AXI_ARADDR[11:4]];
+    end
+  end else begin: no_trace
+    assign trace_rdata = 0;
+  end
+endgenerate
+////////////////////END TRIANGLE TRACE
 
 //Retrieve 8 bit color & resize it to 4 bits, as that's how VGA requires it.
 logic [3:0] r,g,b;
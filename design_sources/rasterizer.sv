@@ -1,7 +1,10 @@
 // Z-buffer is per pixel, only part of triangle may be drawn
 // z here is z in screen space (microblaze gives this)
 // https://www.scratchapixel.com/lessons/3d-basic-rendering/rasterization-practical-implementation/visibility-problem-depth-buffer-depth-interpolation.html
-module rasterizer(
+module rasterizer#(
+    //Row stride of the frame buffer and zbuffer.
+    parameter FB_WIDTH = 320
+)(
     input logic clk,
     input logic rst,
     //Inverse area of the triangle from the microblaze.
@@ -10,9 +13,16 @@ module rasterizer(
     //Color of triangle
     input logic [7:0] color,
 
-    //Edge equation coefficients
-    input logic signed [9:0] a1, b1, a2, b2, a3, b3,
-    input logic signed [17:0] c1, c2, c3,
+    //Edge equation coefficients. Edges 4 and 5 close a quad, for a triangle edge 4 is edge 3 and edge 5 is zero.
+    input logic signed [9:0] a1, b1, a2, b2, a3, b3, a4, b4, a5, b5,
+    input logic signed [17:0] c1, c2, c3, c4, c5,
+    //Vertices, only used by the small triangle path. v4 = v1 for a triangle.
+    input logic [8:0] v1x_in, v2x_in, v3x_in, v4x_in,
+    input logic [7:0] v1y_in, v2y_in, v3y_in, v4y_in,
+    //The triangle's bounding box (before the scissor) is at most 4x4, so every vertex is within 3 pixels of every
+    //pixel we could visit.
+    input logic small,
+
     //Bounding box
     input logic [8:0] bbxi,
     input logic [8:0] bbxf,
@@ -31,11 +41,31 @@ module rasterizer(
     output logic [7:0] data_in_gpu,
     output logic [16:0] addr_gpu,
     
-    //Zbuffer memory signals.
-    input logic [7:0] zbuf_dout,
+    //Zbuffer memory signals. Entries are {epoch, depth}, a depth from another epoch is stale.
+    input logic [1:0] zbuf_epoch,
+    input logic [9:0] zbuf_dout,
     output logic [16:0] zbuf_addr,
-    output logic [7:0] zbuf_din,
-    output logic zbuf_we
+    output logic [9:0] zbuf_din,
+    output logic zbuf_we,
+    //Only used with external memory: high while we wait for the zbuffer read, and the memory can hold us off
+    //with mem_stall. Tied low for BRAM.
+    output logic zbuf_re,
+    input logic mem_stall,
+
+    //Lazy clear. The 8x8 tile holding the current pixel, and whether it has been cleared this frame.
+    //tile_miss is high while we wait for it to be cleared.
+    output logic [5:0] tile_x,
+    output logic [4:0] tile_y,
+    input logic tile_valid,
+    output logic tile_miss,
+    //Lower bound of the depths stored in the current tile, 0xFF if nothing was written to it this frame.
+    input logic [7:0] tile_zmin,
+
+    //Per pixel events for the performance counters, each high for one cycle.
+    output logic px_visit,
+    output logic px_inside,
+    output logic px_zpass,
+    output logic px_zfail
 );
 
 //https://stackoverflow.com/questions/2049582/how-to-determine-if-a-point-is-in-a-2d-triangle
@@ -45,6 +75,9 @@ module rasterizer(
 // Pseudocode that we implement.
 // Calculate E1, E2, E3 a single time.
 // Edge(x,y) = A*x + B*y + C
+// E4 and E5 are stepped the same way as the others. A pixel is inside when E1, E2, E4 and E5 are all >= 0, so a
+// convex quad v1, v2, v3, v4 is walked in one pass over its bounding box. E3 (the v3 to v1 diagonal) is only used
+// for the barycentric weights, which extend past it: the quad is planar, so v1, v2, v3 give its depth everywhere.
 
 // PART 1:
 // E1 = a1*bbxi + b1*bbyi + c1
@@ -57,7 +90,7 @@ module rasterizer(
 //     E2_row = E2;
 //     E3_row = E3;
 //     for(integer x = bbxi; x <= bbxf; x++) begin
-//         if(E1_row >= 0 && E2_row >= 0 && E3_row >= 0): CHECK ZBUFFER & Write color.
+//         if(E1_row >= 0 && E2_row >= 0 && E4_row >= 0 && E5_row >= 0): CHECK ZBUFFER & Write color.
 //         E1_row += a1;
 //         E2_row += a2;
 //         E3_row += a3;
@@ -67,6 +100,23 @@ module rasterizer(
 //     E3 += b3;
 // end
 
+// Small triangles skip all of that. Every pixel of a bounding box up to 4x4 is within 3 pixels of each vertex, and
+// the edge coefficients are within 3 as well, so Edge(x,y) = A*(x - vx) + B*(y - vy) for the edge's first vertex
+// is a few bits wide and cheap enough to do for all 16 pixels at once. The pixels that pass are kept in small_mask
+// and go straight to the depth test one after the other, without edge_prods, edge_eqs, the row states or the
+// outside pixels. The edge values are the same as the incremental ones, so are the pixels drawn. Each pixel drawn
+// still takes 7 cycles, small_next to col_inc, since the depth read and write are not overlapped.
+
+// Big triangles have whole runs of pixels inside. At an x that starts an 8 pixel span of a tile row, if every edge
+// is >= 0 at both ends of the span it is >= 0 all along it, so the span is accepted without more edge tests. Its
+// first pixel takes the barycentric states for z_calc, and the rest add dzdx = sum(a_k * inv_area * z_k), which the
+// same states work out once per triangle with a in place of E. Only z_calc[31:16] is kept, so doing the sum modulo
+// 2^32 gives the same z as the full products. The span then takes a pixel per cycle: a pixel nearer than tile_zmin
+// passes the depth test whatever is in the z buffer and is written straight away, any other one reads and compares
+// it the usual way. The whole span is in one tile, so tile_valid is only checked for its first pixel. tile_zmin is
+// read while the pixel before is being written, so it can miss that pixel's depth. That is safe: no triangle writes
+// a pixel twice, so the depth it misses is never the one of the pixel being tested.
+
 
 //Pixel positions
 logic [8:0] x;
@@ -79,17 +129,36 @@ logic signed [19:0] prod3;
 logic signed [18:0] prod4;
 logic signed [19:0] prod5;
 logic signed [18:0] prod6;
+logic signed [19:0] prod10;
+logic signed [18:0] prod11;
+logic signed [19:0] prod12;
+logic signed [18:0] prod13;
 
 
 //Edge equations
 logic signed [21:0] e1;
 logic signed [21:0] e2;
 logic signed [21:0] e3;
+logic signed [21:0] e4;
+logic signed [21:0] e5;
 
 //Edge equations stored per row.
 logic signed [21:0] e1_row;
 logic signed [21:0] e2_row;
 logic signed [21:0] e3_row;
+logic signed [21:0] e4_row;
+logic signed [21:0] e5_row;
+logic inside;
+assign inside = e1_row >= 0 && e2_row >= 0 && e4_row >= 0 && e5_row >= 0;
+
+//Edge values at the last pixel of the span starting at x.
+logic signed [22:0] e1_end, e2_end, e4_end, e5_end;
+assign e1_end = e1_row + 7*a1;
+assign e2_end = e2_row + 7*a2;
+assign e4_end = e4_row + 7*a4;
+assign e5_end = e5_row + 7*a5;
+logic span_ok;
+assign span_ok = x[2:0] == 0 && 10'(x) + 10'd7 <= 10'(bbxf) && e1_end >= 0 && e2_end >= 0 && e4_end >= 0 && e5_end >= 0;
 
 //Barycentric weights for zbuffer.
 logic signed [53:0] w1_raw, w2_raw, w3_raw;
@@ -103,8 +172,48 @@ logic signed [70:0] prod9_raw;
 logic signed [71:0] z_calc;
 logic [15:0] z;
 
+//Span fill. span is set while the pixels from x to the end of the span are drawn, z_acc is z_calc at x and
+//span_addr its address. dzdx is valid once dz_ready is set, dz_pass marks the states working it out.
+logic span;
+logic dz_ready;
+logic dz_pass;
+logic [31:0] dzdx;
+logic [31:0] z_acc;
+logic [16:0] span_addr;
+logic span_fast;
+logic span_step;
 
-enum logic [3:0] {
+//Stored depth, as far away as possible if it was written in an older frame.
+logic [7:0] zbuf_depth;
+assign zbuf_depth = (zbuf_dout[9:8] == zbuf_epoch) ? zbuf_dout[7:0] : 8'hFF;
+
+//Edge value at (px, py) of the edge with coefficients a, b starting at (vx, vy), for a small triangle only.
+function automatic logic signed [7:0] small_edge(input logic signed [9:0] a, input logic signed [9:0] b,
+                                                 input logic [8:0] px, input logic [8:0] vx,
+                                                 input logic [7:0] py, input logic [7:0] vy);
+    logic signed [7:0] dx, dy;
+    dx = 8'($signed(3'(px - vx)));
+    dy = 8'($signed(3'(py - vy)));
+    return 8'($signed(a[2:0])) * dx + 8'($signed(b[2:0])) * dy;
+endfunction
+
+//Small triangle path: pixels of the 4x4 box (bit 4*row + column) still to draw, and the next one.
+logic small_run;
+logic [15:0] small_mask;
+logic [3:0] small_sel;
+logic [8:0] small_x;
+logic [7:0] small_y;
+always_comb begin
+    small_sel = 0;
+    for (int i = 15; i >= 0; i--)
+        if (small_mask[i])
+            small_sel = 4'(i);
+end
+assign small_x = bbxi + small_sel[1:0];
+assign small_y = bbyi + small_sel[3:2];
+
+
+enum logic [4:0] {
     halt,
     edge_prods,
     edge_eqs,
@@ -117,22 +226,69 @@ enum logic [3:0] {
     read_zbuf,
     write,
     col_inc,
-    row_inc
+    row_inc,
+    tile_wait,
+    small_next,
+    dz_bary,
+    span_px,
+    span_read,
+    span_write
 } state;
 
+assign tile_x = x[8:3];
+assign tile_y = y[7:3];
+assign tile_miss = state == tile_wait;
+assign zbuf_re = state == read_zbuf || state == span_read;
+//A span pixel that passes without a read, and a span pixel being finished. The first pixel of a span was counted
+//by inside_check, the others when the one before them is finished.
+assign span_fast = state == span_px && !mem_stall && z_acc[31:16] < tile_zmin;
+assign span_step = (span_fast || state == span_write) && x[2:0] != 7;
+//The small path only visits the pixels inside.
+assign px_visit = state == inside_check || (state == small_next && small_mask != 0) || span_step;
+assign px_inside = (state == inside_check && inside) || (state == small_next && small_mask != 0) || span_step;
+assign px_zpass = ((state == write || state == span_write) && z < zbuf_depth) || span_fast;
+assign px_zfail = (state == write || state == span_write) && !(z < zbuf_depth);
+
 
 always_ff @(posedge clk) begin
     if(rst) begin
         state <= halt;
         rasterizer_done <= 0;
+        zbuf_we <= 0;
+        write_enable_gpu <= 0;
     end else begin
         case(state)
             halt: begin
                 rasterizer_done <= 0;
                 if(rasterizer_start) begin
-                    state <= edge_prods;
+                    state <= small ? small_next : edge_prods;
+                    small_run <= small;
+                    span <= 0;
+                    dz_ready <= 0;
+                    dz_pass <= 0;
                     x <= bbxi;
                     y <= bbyi;
+                    for (int i = 0; i < 16; i++)
+                        small_mask[i] <= 10'(bbxi) + 10'(i % 4) <= 10'(bbxf) && 9'(bbyi) + 9'(i / 4) <= 9'(bbyf) &&
+                            small_edge(a1, b1, bbxi + 9'(i % 4), v1x_in, bbyi + 8'(i / 4), v1y_in) >= 0 &&
+                            small_edge(a2, b2, bbxi + 9'(i % 4), v2x_in, bbyi + 8'(i / 4), v2y_in) >= 0 &&
+                            small_edge(a4, b4, bbxi + 9'(i % 4), v3x_in, bbyi + 8'(i / 4), v3y_in) >= 0 &&
+                            small_edge(a5, b5, bbxi + 9'(i % 4), v4x_in, bbyi + 8'(i / 4), v4y_in) >= 0;
+                end
+            end
+            small_next: begin
+                //Next pixel of the small triangle, straight to the barycentric products.
+                if(small_mask == 0) begin
+                    rasterizer_done <= 1;
+                    state <= halt;
+                end else begin
+                    small_mask[small_sel] <= 0;
+                    x <= small_x;
+                    y <= small_y;
+                    w1_raw <= 22'(small_edge(a1, b1, small_x, v1x_in, small_y, v1y_in)) * $signed(inv_area);
+                    w2_raw <= 22'(small_edge(a2, b2, small_x, v2x_in, small_y, v2y_in)) * $signed(inv_area);
+                    w3_raw <= 22'(small_edge(a3, b3, small_x, v3x_in, small_y, v3y_in)) * $signed(inv_area);
+                    state <= barycentric_normalize;
                 end
             end
             edge_prods: begin
@@ -143,6 +299,10 @@ always_ff @(posedge clk) begin
                 prod4 <= $signed(b2) * $signed({1'b0, bbyi});
                 prod5 <= $signed(a3) * $signed({1'b0, bbxi});
                 prod6 <= $signed(b3) * $signed({1'b0, bbyi});
+                prod10 <= $signed(a4) * $signed({1'b0, bbxi});
+                prod11 <= $signed(b4) * $signed({1'b0, bbyi});
+                prod12 <= $signed(a5) * $signed({1'b0, bbxi});
+                prod13 <= $signed(b5) * $signed({1'b0, bbyi});
                 state <= edge_eqs;
             end
             edge_eqs: begin
@@ -150,6 +310,8 @@ always_ff @(posedge clk) begin
                 e1 <= $signed(prod1) + $signed(prod2) + $signed(c1);
                 e2 <= $signed(prod3) + $signed(prod4) + $signed(c2);
                 e3 <= $signed(prod5) + $signed(prod6) + $signed(c3);
+                e4 <= $signed(prod10) + $signed(prod11) + $signed(c4);
+                e5 <= $signed(prod12) + $signed(prod13) + $signed(c5);
                 state <= row_setup;
             end
             row_setup: begin
@@ -157,11 +319,16 @@ always_ff @(posedge clk) begin
                 e1_row <= e1;
                 e2_row <= e2;
                 e3_row <= e3;
+                e4_row <= e4;
+                e5_row <= e5;
                 state <= inside_check;
             end
             inside_check: begin
                 //Should it be like this or 1 clock cycle delayed by calculating inside first and then checking for inside?
-                if(e1_row >= 0 && e2_row >= 0 && e3_row >= 0) begin
+                if(inside && span_ok) begin
+                    span <= 1;
+                    state <= dz_ready ? barycentric : dz_bary;
+                end else if(inside) begin
                     state <= barycentric;
                 end else begin
                     state <= col_inc;
@@ -173,6 +340,14 @@ always_ff @(posedge clk) begin
                 w3_raw <= $signed(e3_row) * $signed(inv_area);
                 state <= barycentric_normalize;
             end
+            dz_bary: begin
+                //The barycentric states with a for E, comp_z then gives dzdx.
+                w1_raw <= 22'(a1) * $signed(inv_area);
+                w2_raw <= 22'(a2) * $signed(inv_area);
+                w3_raw <= 22'(a3) * $signed(inv_area);
+                dz_pass <= 1;
+                state <= barycentric_normalize;
+            end
             barycentric_normalize: begin
                 prod7_raw <= $signed(w1_raw) * $signed(z1);
                 prod8_raw <= $signed(w2_raw) * $signed(z2);
@@ -184,19 +359,100 @@ always_ff @(posedge clk) begin
                 state <= buf_addressing;
             end
             buf_addressing: begin
-                z <= z_calc[31:16];
-                zbuf_addr <= y*320 + x;
-                addr_gpu <= y*320 + x;
-                state <= read_zbuf;
+                if(dz_pass) begin
+                    dzdx <= z_calc[31:0];
+                    dz_ready <= 1;
+                    dz_pass <= 0;
+                    state <= barycentric;
+                end else begin
+                    z <= z_calc[31:16];
+                    z_acc <= z_calc[31:0];
+                    zbuf_addr <= y*FB_WIDTH + x;
+                    addr_gpu <= y*FB_WIDTH + x;
+                    span_addr <= y*FB_WIDTH + x;
+                    //First pixel in this tile since the buffer was cleared, the tile has to be cleared before we read the zbuffer.
+                    if(!tile_valid) begin
+                        state <= tile_wait;
+                    end else if(span) begin
+                        state <= span_px;
+                    end else begin
+                        state <= read_zbuf;
+                    end
+                end
+            end
+            tile_wait: begin
+                if(tile_valid) begin
+                    state <= span ? span_px : read_zbuf;
+                end
+            end
+            span_px: begin
+                //The write of the pixel before is held until the memory takes it.
+                if(!mem_stall) begin
+                    z <= z_acc[31:16];
+                    zbuf_addr <= span_addr;
+                    addr_gpu <= span_addr;
+                    if(span_fast) begin
+                        zbuf_we <= 1;
+                        zbuf_din <= {zbuf_epoch, z_acc[23:16]};
+                        write_enable_gpu <= 1;
+                        data_in_gpu <= color;
+                        if(x[2:0] == 7) begin
+                            span <= 0;
+                            state <= col_inc;
+                        end else begin
+                            x <= x+1;
+                            span_addr <= span_addr + 1;
+                            z_acc <= z_acc + dzdx;
+                            e1_row <= e1_row + a1;
+                            e2_row <= e2_row + a2;
+                            e3_row <= e3_row + a3;
+                            e4_row <= e4_row + a4;
+                            e5_row <= e5_row + a5;
+                        end
+                    end else begin
+                        zbuf_we <= 0;
+                        write_enable_gpu <= 0;
+                        state <= span_read;
+                    end
+                end
+            end
+            span_read: begin
+                if(!mem_stall) begin
+                    state <= span_write;
+                end
+            end
+            span_write: begin
+                if(z < zbuf_depth) begin
+                    zbuf_we <= 1;
+                    zbuf_din <= {zbuf_epoch, z[7:0]};
+                    write_enable_gpu <= 1;
+                    data_in_gpu <= color;
+                end
+                if(x[2:0] == 7) begin
+                    span <= 0;
+                    state <= col_inc;
+                end else begin
+                    x <= x+1;
+                    span_addr <= span_addr + 1;
+                    z_acc <= z_acc + dzdx;
+                    e1_row <= e1_row + a1;
+                    e2_row <= e2_row + a2;
+                    e3_row <= e3_row + a3;
+                    e4_row <= e4_row + a4;
+                    e5_row <= e5_row + a5;
+                    state <= span_px;
+                end
             end
             read_zbuf: begin
                 //BRAM memory has a 1 cycle latency. We therefore add a wait state to ensure correct data is read.
-                state <= write;
+                if(!mem_stall) begin
+                    state <= write;
+                end
             end
             write: begin
-                if(z < zbuf_dout) begin
+                if(z < zbuf_depth) begin
                     zbuf_we <= 1;
-                    zbuf_din <= z;
+                    zbuf_din <= {zbuf_epoch, z[7:0]};
 
                     write_enable_gpu <= 1;
                     data_in_gpu <= color;
@@ -207,16 +463,23 @@ always_ff @(posedge clk) begin
                 state <= col_inc;
             end
             col_inc: begin
-                zbuf_we <= 0;
-                write_enable_gpu <= 0;
-                if(x == bbxf) begin
-                    state <= row_inc;
-                end else begin
-                    x <= x+1;
-                    e1_row <= e1_row + a1;
-                    e2_row <= e2_row + a2;
-                    e3_row <= e3_row + a3;
-                    state <= inside_check;
+                //The writes from the last state happen in this one, hold them until the memory takes them.
+                if(!mem_stall) begin
+                    zbuf_we <= 0;
+                    write_enable_gpu <= 0;
+                    if(small_run) begin
+                        state <= small_next;
+                    end else if(x == bbxf) begin
+                        state <= row_inc;
+                    end else begin
+                        x <= x+1;
+                        e1_row <= e1_row + a1;
+                        e2_row <= e2_row + a2;
+                        e3_row <= e3_row + a3;
+                        e4_row <= e4_row + a4;
+                        e5_row <= e5_row + a5;
+                        state <= inside_check;
+                    end
                 end
             end
             row_inc: begin
@@ -228,6 +491,8 @@ always_ff @(posedge clk) begin
                     e1 <= e1 + b1;
                     e2 <= e2 + b2;
                     e3 <= e3 + b3;
+                    e4 <= e4 + b4;
+                    e5 <= e5 + b5;
                     state <= row_setup;
                 end
             end
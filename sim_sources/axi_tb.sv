@@ -14,7 +14,7 @@ module tb_axi_triangle_pipeline();
     // =========================================================================
     // AXI signals (tied off)
     // =========================================================================
-    logic [4:0] write_addr = 5'd0;
+    logic [13:0] write_addr = 14'd0;
     logic write_addr_valid = 1'b0;
     logic write_addr_ready;
     logic [31:0] write_data = 32'd0;
@@ -24,7 +24,7 @@ module tb_axi_triangle_pipeline();
     logic write_resp_valid;
     logic write_resp_ready = 1'b0;
     
-    logic [4:0] axi_araddr = 14'd0;
+    logic [13:0] axi_araddr = 14'd0;
     logic [2:0] axi_arprot = 3'd0;
     logic axi_arvalid = 1'b0;
     logic axi_arready;
@@ -46,7 +46,8 @@ module tb_axi_triangle_pipeline();
     // =========================================================================
     hdmi_text_controller_v1_0 #(
         .C_AXI_DATA_WIDTH(32),
-        .C_AXI_ADDR_WIDTH(5)
+        .C_AXI_ADDR_WIDTH(14),
+        .TRACE_ENABLE(1)
     ) dut (
         .hdmi_clk_n(hdmi_clk_n),
         .hdmi_clk_p(hdmi_clk_p),
@@ -194,6 +195,129 @@ module tb_axi_triangle_pipeline();
         end
     endtask;
 
+    task axi_read (input logic [31:0] addr, output logic [31:0] data);
+        begin
+            #3 axi_araddr <= addr;	//Put read address on bus
+            axi_arvalid <= 1'b1;	//indicate address is valid
+            axi_rready <= 1'b1;	//indicate ready for the data
+
+            //address handshake
+            wait(axi_arready);
+            @(posedge aclk);
+            axi_arvalid <= 1'b0;
+
+            //data handshake
+            wait(axi_rvalid);
+            data = axi_rdata;
+            @(posedge aclk);
+            axi_rready <= 1'b0;
+        end
+    endtask;
+
+    // =========================================================================
+    // Command Ring
+    // =========================================================================
+    localparam int RING_BASE = 'h2000;
+    localparam int RING_SLOTS = 256;
+    localparam int REG_RING_HEAD = 6 * 4;
+    localparam int REG_RING_TAIL = 7 * 4;
+    int unsigned ring_head = 0;
+
+    // Copies a packet into the next ring slot. Nothing is drawn until ring_doorbell().
+    task ring_write(input logic [31:0] buffer[6]);
+        begin
+            for (int i = 0; i < 6; i++)
+                axi_write(RING_BASE + (ring_head % RING_SLOTS) * 32 + i * 4, buffer[i]);
+            ring_head++;
+        end
+    endtask
+
+    task ring_doorbell();
+        axi_write(REG_RING_HEAD, ring_head);
+    endtask
+
+    // =========================================================================
+    // Commands (opcode in the top byte of word 4)
+    // =========================================================================
+    localparam logic [7:0] OP_CLEAR = 8'h03;
+    localparam logic [7:0] OP_SET_SCISSOR = 8'h04;
+    localparam logic [7:0] OP_FENCE = 8'h06;
+    localparam int REG_CTRL = 8 * 4;
+    localparam int REG_FENCE = 10 * 4;
+    localparam int REG_SWAP_REQ = 11 * 4;
+    localparam int REG_FRAME_TAG = 12 * 4;
+    localparam int REG_PERF_CTRL = 16 * 4;
+    localparam int REG_TRACE_COUNT = 15 * 4;
+    localparam int TRACE_BASE = 'h1000;
+    localparam int TRACE_ENTRIES = 256;
+    localparam logic [31:0] CTRL_TRACE = 32'h4;
+
+    // Reads the triangle trace back over AXI and writes it out as CSV, one row per triangle, oldest first.
+    // Sort on raster_cycles to find the expensive ones.
+    task trace_dump_csv(string csv_file_name);
+        integer fd;
+        logic [31:0] count;
+        logic [31:0] w[4];
+        axi_read(REG_TRACE_COUNT, count);
+        fd = $fopen(csv_file_name, "w");
+        if (!fd) begin
+            $display("Could not open file: %s", csv_file_name);
+            return;
+        end
+        $fdisplay(fd, "index,frame,pop_cycle,setup_cycles,raster_cycles,pixels_visited,pixels_written,culled,cut_off,indexed,quad");
+        for (int n = (count > TRACE_ENTRIES) ? count - TRACE_ENTRIES : 0; n < count; n++) begin
+            for (int i = 0; i < 4; i++)
+                axi_read(TRACE_BASE + (n % TRACE_ENTRIES) * 16 + i * 4, w[i]);
+            $fdisplay(fd, "%0d,%0d,%0d,%0d,%0d,%0d,%0d,%0d,%0d,%0d,%0d", n, w[1][31:20], w[0], w[1][15:0], w[2],
+                      w[3][15:0], w[3][31:16], w[1][16], w[1][17], w[1][18], w[1][19]);
+        end
+        $fclose(fd);
+        $display("Wrote %0d trace entries to %s", (count > TRACE_ENTRIES) ? TRACE_ENTRIES : count, csv_file_name);
+    endtask
+
+    // Snapshots the performance counters (and resets them if asked) and prints them.
+    task perf_dump(input logic reset);
+        string names[16] = '{"", "CYC_CLEAR_BUF", "CYC_WAIT_TRI", "CYC_CALC_EDGE", "CYC_RASTERIZE", "CYC_OTHER",
+                             "TRI_ACCEPTED", "TRI_DROPPED", "PIX_VISITED", "PIX_INSIDE", "PIX_ZPASS", "PIX_ZFAIL",
+                             "FIFO_HWM", "FRAME_CYCLES", "CYCLES_LO", "CYCLES_HI"};
+        logic [31:0] perf[16];
+        axi_write(REG_PERF_CTRL, {30'd0, reset, 1'b1});
+        for (int i = 1; i < 16; i++) begin
+            axi_read((16 + i) * 4, perf[i]);
+            $display("  %-14s %0d", names[i], perf[i]);
+        end
+        // A triangle cut off by a flip can leave inside pixels that never reach the depth test.
+        if (perf[7] == 0 && perf[10] + perf[11] != perf[9])
+            $display("ERROR: z pass + z fail (%0d) != inside pixels (%0d)", perf[10] + perf[11], perf[9]);
+        if (perf[9] > perf[8])
+            $display("ERROR: more inside pixels (%0d) than visited (%0d)", perf[9], perf[8]);
+    endtask
+
+    // Queues a command that uses a rectangle: v = top left, v3 = bottom right, both inclusive
+    task ring_rect_cmd(input logic [7:0] op,
+                       input logic [8:0] x0, input logic [7:0] y0,
+                       input logic [8:0] x1, input logic [7:0] y1,
+                       input logic [7:0] color_in, input logic [7:0] depth, input logic [1:0] flags);
+        logic [31:0] buffer[6];
+        begin
+            buffer[0] = {8'd0, y0, 7'd0, x0};
+            buffer[1] = {24'd0, depth};
+            buffer[2] = 32'd0;
+            buffer[3] = {8'd0, y1, 7'd0, x1};
+            buffer[4] = {op, color_in, 14'd0, flags};
+            buffer[5] = 32'd0;
+            ring_write(buffer);
+        end
+    endtask
+
+    task ring_fence(input logic [31:0] value);
+        logic [31:0] buffer[6];
+        begin
+            buffer = '{32'd0, 32'd0, 32'd0, 32'd0, {OP_FENCE, 24'd0}, value};
+            ring_write(buffer);
+        end
+    endtask
+
     // =========================================================================
     // Triangle Drawing Task
     // =========================================================================
@@ -202,7 +326,8 @@ module tb_axi_triangle_pipeline();
         input logic [8:0] x2, input logic [7:0] y2,
         input logic [8:0] x3, input logic [7:0] y3,
         input logic [7:0] color_in,
-        input logic [15:0] z1, z2, z3
+        input logic [15:0] z1, z2, z3,
+        input bit use_ring = 0    // queue in the command ring instead of writing the staging registers
     );
         int area_x2;
         real inv_area_real;
@@ -246,6 +371,12 @@ module tb_axi_triangle_pipeline();
             buffer[4] = {8'd0, color_in, z3};           // color + v3z
             buffer[5] = inv_area_fixed;                 // r_area
 
+            if (use_ring) begin
+                ring_write(buffer);
+                $display("  Queued in ring slot %0d", (ring_head - 1) % RING_SLOTS);
+                return;
+            end
+
             // Write all 6 words via AXI (addresses 0x00, 0x04, 0x08, 0x0C, 0x10, 0x14)
             for (int i = 0; i < 6; i++) begin
                 axi_write(i * 4, buffer[i]);
@@ -264,6 +395,75 @@ module tb_axi_triangle_pipeline();
         end
     endtask
 
+    // =========================================================================
+    // Strips and fans
+    // =========================================================================
+    localparam logic [7:0] OP_STRIP = 8'h07;
+    localparam logic [7:0] OP_FAN = 8'h08;
+
+    // Continues a strip or fan from the last triangle drawn with one new vertex. Only words 3-5 of the
+    // ring slot are written, the IP fills in the other two vertices. (x1, y1) and (x2, y2) are those two,
+    // for the area.
+    task ring_vertex(
+        input logic [7:0] op,
+        input logic [8:0] x1, input logic [7:0] y1,
+        input logic [8:0] x2, input logic [7:0] y2,
+        input logic [8:0] x3, input logic [7:0] y3,
+        input logic [7:0] color_in,
+        input logic [15:0] z3
+    );
+        int area_x2;
+        logic [31:0] slot;
+        begin
+            area_x2 = int'(x1)*(int'(y2) - int'(y3)) +
+                      int'(x2)*(int'(y3) - int'(y1)) +
+                      int'(x3)*(int'(y1) - int'(y2));
+            if (area_x2 < 0) area_x2 = -area_x2;
+            slot = RING_BASE + (ring_head % RING_SLOTS) * 32;
+            axi_write(slot + 12, {8'd0, y3, 7'd0, x3});
+            axi_write(slot + 16, {op, color_in, z3});
+            axi_write(slot + 20, $unsigned((1.0 / real'(area_x2)) * 16777216.0));
+            ring_head++;
+        end
+    endtask
+
+    // =========================================================================
+    // Quads
+    // =========================================================================
+    localparam logic [7:0] OP_LOAD_VERTS = 8'h01;
+    localparam logic [7:0] OP_DRAW_QUAD = 8'h09;
+
+    // Loads the corners of a convex quad at vertex table entries base to base + 3, all at depth z, and draws it
+    // with one DRAW_QUAD. inv_area is that of the first three corners.
+    task ring_quad(
+        input logic [8:0] x1, input logic [7:0] y1,
+        input logic [8:0] x2, input logic [7:0] y2,
+        input logic [8:0] x3, input logic [7:0] y3,
+        input logic [8:0] x4, input logic [7:0] y4,
+        input logic [7:0] color_in,
+        input logic [15:0] z,
+        input logic [7:0] base
+    );
+        int area_x2;
+        logic [31:0] buffer[6];
+        begin
+            area_x2 = int'(x1)*(int'(y2) - int'(y3)) +
+                      int'(x2)*(int'(y3) - int'(y1)) +
+                      int'(x3)*(int'(y1) - int'(y2));
+            if (area_x2 < 0) area_x2 = -area_x2;
+            buffer = '{{8'd0, y1, 7'd0, x1}, {7'd0, x2, z}, {z, 8'd0, y2}, {8'd0, y3, 7'd0, x3},
+                       {OP_LOAD_VERTS, 8'd0, z}, {24'd0, base}};
+            ring_write(buffer);
+            // Only the first vertex of the second load is used, the other two entries get the same one
+            buffer = '{{8'd0, y4, 7'd0, x4}, {7'd0, x4, z}, {z, 8'd0, y4}, {8'd0, y4, 7'd0, x4},
+                       {OP_LOAD_VERTS, 8'd0, z}, {24'd0, base + 8'd3}};
+            ring_write(buffer);
+            buffer = '{{base + 8'd3, base + 8'd2, base + 8'd1, base}, 32'd0, 32'd0, 32'd0,
+                       {OP_DRAW_QUAD, color_in, 16'd0}, $unsigned((1.0 / real'(area_x2)) * 16777216.0)};
+            ring_write(buffer);
+        end
+    endtask
+
     // =========================================================================
     // Main Test Sequence
     // =========================================================================
@@ -282,6 +482,7 @@ module tb_axi_triangle_pipeline();
         repeat (100) @(posedge aclk);
 
         $display("\n=== Starting Triangle Pipeline Test ===\n");
+        axi_write(REG_CTRL, CTRL_TRACE);
 
         // Triangle 1: Red (Bottom Left) - Farther Back (Z=50)
         draw_triangle(
@@ -349,6 +550,74 @@ module tb_axi_triangle_pipeline();
             16'd90, 16'd10, 16'd10
         );
 
+        // Same kind of triangles through the command ring, doorbell rung once for the batch
+        draw_triangle(9'd220, 8'd20, 9'd300, 8'd100, 9'd220, 8'd100, 8'hFF, 16'd20, 16'd20, 16'd20, 1);
+        draw_triangle(9'd230, 8'd110, 9'd300, 8'd180, 9'd230, 8'd180, 8'h92, 16'd20, 16'd20, 16'd20, 1);
+        draw_triangle(9'd240, 8'd190, 9'd300, 8'd230, 9'd240, 8'd230, 8'h49, 16'd20, 16'd20, 16'd20, 1);
+        ring_doorbell();
+        begin
+            logic [31:0] tail;
+            do begin
+                axi_read(REG_RING_TAIL, tail);
+            end while (tail != ring_head);
+            $display("Ring drained: RING_TAIL=%0d", tail);
+        end
+
+        // A band from (20,0) to (80,15) as a 4 triangle strip, and a 3 triangle fan next to it. After the
+        // first triangle of each only the new vertex goes over AXI.
+        draw_triangle(9'd20, 8'd15, 9'd20, 8'd0, 9'd50, 8'd15, 8'hE0, 16'd20, 16'd20, 16'd20, 1);
+        ring_vertex(OP_STRIP, 9'd50, 8'd15, 9'd20, 8'd0, 9'd50, 8'd0, 8'hFC, 16'd20);
+        ring_vertex(OP_STRIP, 9'd50, 8'd15, 9'd50, 8'd0, 9'd80, 8'd15, 8'h1C, 16'd20);
+        ring_vertex(OP_STRIP, 9'd80, 8'd15, 9'd50, 8'd0, 9'd80, 8'd0, 8'h03, 16'd20);
+        draw_triangle(9'd120, 8'd15, 9'd120, 8'd0, 9'd140, 8'd0, 8'hE0, 16'd20, 16'd20, 16'd20, 1);
+        ring_vertex(OP_FAN, 9'd120, 8'd15, 9'd140, 8'd0, 9'd160, 8'd5, 8'hFC, 16'd20);
+        ring_vertex(OP_FAN, 9'd120, 8'd15, 9'd160, 8'd5, 9'd160, 8'd15, 8'h1C, 16'd20);
+        // A skewed quad next to them, one walk of its bounding box instead of two
+        ring_quad(9'd180, 8'd15, 9'd190, 8'd0, 9'd215, 8'd3, 9'd205, 8'd15, 8'hE3, 16'd20, 8'd0);
+        // Bounding box within 4x4, so it takes the rasterizer's small triangle path
+        draw_triangle(9'd225, 8'd3, 9'd228, 8'd6, 9'd225, 8'd6, 8'h1F, 16'd20, 16'd20, 16'd20, 1);
+        ring_doorbell();
+
+        // Command stream: clear a band to blue (colour only), draw a big triangle scissored to that band,
+        // restore the scissor and check the fence comes back once all of it has run.
+        ring_rect_cmd(OP_CLEAR, 9'd10, 8'd205, 9'd200, 8'd235, 8'h03, 8'hFF, 2'b01);
+        ring_rect_cmd(OP_SET_SCISSOR, 9'd10, 8'd210, 9'd200, 8'd230, 8'h00, 8'h00, 2'b00);
+        draw_triangle(9'd0, 8'd150, 9'd240, 8'd239, 9'd0, 8'd239, 8'hFC, 16'd30, 16'd30, 16'd30, 1);
+        ring_rect_cmd(OP_SET_SCISSOR, 9'd0, 8'd0, 9'd319, 8'd239, 8'h00, 8'h00, 2'b00);
+        ring_fence(32'hF00D);
+        ring_doorbell();
+        begin
+            logic [31:0] fence;
+            do begin
+                axi_read(REG_FENCE, fence);
+            end while (fence != 32'hF00D);
+            $display("Fence reached: FENCE=0x%h", fence);
+        end
+
+        // Everything up to the fence has been drawn, the counters should add up.
+        $display("Performance counters:");
+        perf_dump(1'b1);
+
+        // Manual swap: the buffers should only flip once we ask, and the frame tag should follow
+        axi_write(REG_CTRL, CTRL_TRACE | 32'd1);
+        begin
+            logic [31:0] tag;
+            logic front_before;
+            front_before = dut.hdmi_text_controller_v1_0_AXI_inst.front;
+            wait(pixel_vs == 1'b0);
+            wait(pixel_vs == 1'b1);
+            wait(pixel_vs == 1'b0);
+            repeat (10) @(posedge aclk);
+            if (dut.hdmi_text_controller_v1_0_AXI_inst.front != front_before)
+                $display("ERROR: buffers flipped without a swap request");
+            axi_write(REG_SWAP_REQ, 32'd7);
+            do begin
+                axi_read(REG_FRAME_TAG, tag);
+            end while (tag != 32'd7);
+            $display("Swap done: FRAME_TAG=%0d", tag);
+        end
+        axi_write(REG_CTRL, CTRL_TRACE);
+
         $display("\nAll triangles submitted via AXI. Waiting for processing and display...");
         
         // Wait for triangles to be processed
@@ -383,6 +652,8 @@ module tb_axi_triangle_pipeline();
         $display("BMP saved successfully!");
         `endif
 
+        trace_dump_csv("pipeline_axi_trace.csv");
+
         $display("\n=== Test Complete ===\n");
         $finish;
     end
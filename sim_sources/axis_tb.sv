@@ -0,0 +1,318 @@
+// Copied and modified from axi_tb.sv so that part was AI generated
+// Streams triangle packets into the AXI4-Stream port the same way an AXI DMA MM2S channel would,
+// and reports how many packets per clock the IP accepts.
+`timescale 1ns / 1ps
+//`define SIM_VIDEO // Uncomment to also save a BMP of the streamed triangles
+
+module tb_axis_triangle_pipeline();
+
+    // =========================================================================
+    // Clock & Reset
+    // =========================================================================
+    logic aclk = 1'b0;
+    logic arstn = 1'b0;
+    always #5 aclk = ~aclk; // 100MHz
+
+    // =========================================================================
+    // AXI-Lite signals (tied off)
+    // =========================================================================
+    logic [13:0] axi_awaddr = 14'd0;
+    logic axi_awvalid = 1'b0;
+    logic axi_awready;
+    logic [31:0] axi_wdata = 32'd0;
+    logic axi_wvalid = 1'b0;
+    logic axi_wready;
+    logic [1:0] axi_bresp;
+    logic axi_bvalid;
+    logic axi_bready = 1'b0;
+    logic [13:0] axi_araddr = 14'd0;
+    logic axi_arvalid = 1'b0;
+    logic axi_arready;
+    logic [31:0] axi_rdata;
+    logic [1:0] axi_rresp;
+    logic axi_rvalid;
+    logic axi_rready = 1'b0;
+
+    // =========================================================================
+    // AXI4-Stream signals (driven by the stream driver below)
+    // =========================================================================
+    logic [31:0] axis_tdata = 32'd0;
+    logic axis_tvalid = 1'b0;
+    logic axis_tready;
+    logic axis_tlast = 1'b0;
+
+    // =========================================================================
+    // HDMI outputs
+    // =========================================================================
+    logic hdmi_clk_n, hdmi_clk_p;
+    logic [2:0] hdmi_tx_n, hdmi_tx_p;
+
+    // =========================================================================
+    // DUT Instantiation
+    // =========================================================================
+    hdmi_text_controller_v1_0 #(
+        .C_AXI_DATA_WIDTH(32),
+        .C_AXI_ADDR_WIDTH(14)
+    ) dut (
+        .hdmi_clk_n(hdmi_clk_n),
+        .hdmi_clk_p(hdmi_clk_p),
+        .hdmi_tx_n(hdmi_tx_n),
+        .hdmi_tx_p(hdmi_tx_p),
+        .axis_tdata(axis_tdata),
+        .axis_tvalid(axis_tvalid),
+        .axis_tready(axis_tready),
+        .axis_tlast(axis_tlast),
+        .axi_aclk(aclk),
+        .axi_aresetn(arstn),
+        .axi_awaddr(axi_awaddr),
+        .axi_awvalid(axi_awvalid),
+        .axi_awready(axi_awready),
+        .axi_wdata(axi_wdata),
+        .axi_wvalid(axi_wvalid),
+        .axi_wready(axi_wready),
+        .axi_bresp(axi_bresp),
+        .axi_bvalid(axi_bvalid),
+        .axi_bready(axi_bready),
+        .axi_araddr(axi_araddr),
+        .axi_arvalid(axi_arvalid),
+        .axi_arready(axi_arready),
+        .axi_rdata(axi_rdata),
+        .axi_rresp(axi_rresp),
+        .axi_rvalid(axi_rvalid),
+        .axi_rready(axi_rready)
+    );
+
+    // =========================================================================
+    // Internal signals
+    // =========================================================================
+    logic [3:0] red, green, blue;
+    logic pixel_clk, pixel_vs, pixel_vde;
+    logic [9:0] drawX, drawY;
+
+    assign pixel_clk = dut.clk_25MHz;
+    assign pixel_vs = dut.vsync;
+    assign pixel_vde = dut.vde;
+    assign drawX = dut.drawX;
+    assign drawY = dut.drawY;
+    assign red = dut.red;
+    assign green = dut.green;
+    assign blue = dut.blue;
+
+    // =========================================================================
+    // BMP Generation
+    // =========================================================================
+    localparam BMP_WIDTH  = 640;
+    localparam BMP_HEIGHT = 480;
+    logic [23:0] bitmap [BMP_WIDTH][BMP_HEIGHT];
+    integer i, j;
+
+    // Capture pixels
+    always @(posedge pixel_clk) begin
+        if (!arstn) begin
+            for (j = 0; j < BMP_HEIGHT; j++)
+                for (i = 0; i < BMP_WIDTH; i++)
+                    bitmap[i][j] <= 24'h000000; // Black background
+        end else if (pixel_vde) begin
+            // Scale 4-bit RGB to 8-bit for BMP
+            bitmap[drawX][drawY] <= {red, 4'h0, green, 4'h0, blue, 4'h0};
+        end
+    end
+
+    // Save BMP task
+    task save_bmp(string bmp_file_name);
+        integer unsigned fout, BMP_file_size, BMP_row_size;
+        logic unsigned [31:0] BMP_header[0:12];
+        begin
+            BMP_row_size = 32'(BMP_WIDTH * 3) & 32'hFFFC;
+            if (((BMP_WIDTH * 3) & 32'd3) != 0) BMP_row_size = BMP_row_size + 4;
+
+            fout = $fopen(bmp_file_name, "wb");
+            if (fout == 0) begin
+                $display("Could not open file: %s", bmp_file_name);
+                $stop;
+            end
+            $display("Saving bitmap: %s", bmp_file_name);
+
+            BMP_header[0:12] = '{BMP_file_size, 0, 0054, 40, BMP_WIDTH, BMP_HEIGHT,
+                               {16'd24, 16'd1}, 0, (BMP_row_size * BMP_HEIGHT),
+                               2835, 2835, 0, 0};
+
+            $fwrite(fout, "BM");
+            for (int k = 0; k < 13; k++)
+                $fwrite(fout, "%c%c%c%c",
+                       BMP_header[k][7:0], BMP_header[k][15:8],
+                       BMP_header[k][23:16], BMP_header[k][31:24]);
+
+            for (int y = BMP_HEIGHT - 1; y >= 0; y--)
+                for (int x = 0; x < BMP_WIDTH; x++)
+                    $fwrite(fout, "%c%c%c",
+                           bitmap[x][y][23:16], bitmap[x][y][15:8], bitmap[x][y][7:0]);
+
+            $fclose(fout);
+        end
+    endtask
+
+    // =========================================================================
+    // Packet building
+    // =========================================================================
+    // Queue of stream words. One triangle is 6 words, same layout as the C TrianglePacket.
+    logic [31:0] stream_words[$];
+
+    task queue_triangle(
+        input logic [8:0] x1, input logic [7:0] y1,
+        input logic [8:0] x2, input logic [7:0] y2,
+        input logic [8:0] x3, input logic [7:0] y3,
+        input logic [7:0] color_in,
+        input logic [15:0] z1, z2, z3
+    );
+        int area_x2;
+        real inv_area_real;
+        logic [31:0] inv_area_fixed;
+        begin
+            // Calculate 2*Area
+            area_x2 = int'(x1)*(int'(y2) - int'(y3)) +
+                      int'(x2)*(int'(y3) - int'(y1)) +
+                      int'(x3)*(int'(y1) - int'(y2));
+            if (area_x2 < 0) area_x2 = -area_x2;
+            if (area_x2 == 0) area_x2 = 1;
+
+            // Calculate 1/(2*Area) in 8.24 fixed-point
+            inv_area_real = (1.0 / real'(area_x2)) * 16777216.0; // 2^24
+            inv_area_fixed = $unsigned(inv_area_real);
+
+            stream_words.push_back({8'd0, y1, 7'd0, x1});      // v1y + v1x
+            stream_words.push_back({7'd0, x2, z1});            // v2x + v1z
+            stream_words.push_back({z2, 8'd0, y2});            // v2z + v2y
+            stream_words.push_back({8'd0, y3, 7'd0, x3});      // v3y + v3x
+            stream_words.push_back({8'd0, color_in, z3});      // color + v3z
+            stream_words.push_back(inv_area_fixed);            // r_area
+        end
+    endtask
+
+    // =========================================================================
+    // Stream driver
+    // =========================================================================
+    // Holds TVALID high and sends every queued word back to back, like a DMA with data ready.
+    // TLAST goes with the 6th word of every packet.
+    longint unsigned cycle = 0;
+    always @(posedge aclk) cycle <= cycle + 1;
+
+    longint unsigned first_beat_cycle, last_beat_cycle;
+    int beats_sent;
+
+    task stream_all();
+        int k;
+        begin
+            k = 0;
+            beats_sent = 0;
+            axis_tdata  <= stream_words[0];
+            axis_tlast  <= 1'b0;
+            axis_tvalid <= 1'b1;
+            while (k < stream_words.size()) begin
+                @(posedge aclk);
+                if (axis_tready) begin
+                    if (k == 0) first_beat_cycle = cycle;
+                    last_beat_cycle = cycle;
+                    beats_sent++;
+                    k++;
+                    if (k < stream_words.size()) begin
+                        axis_tdata <= stream_words[k];
+                        axis_tlast <= (k % 6) == 5;
+                    end
+                end
+            end
+            axis_tvalid <= 1'b0;
+            axis_tlast  <= 1'b0;
+            stream_words.delete();
+        end
+    endtask
+
+    // Count FIFO pushes from the stream so we can check nothing is dropped.
+    int fifo_pushes = 0;
+    always @(posedge aclk)
+        if (dut.hdmi_text_controller_v1_0_AXI_inst.fifo_wr_en) fifo_pushes++;
+
+    task report(string name, int packets);
+        real cycles;
+        begin
+            cycles = real'(last_beat_cycle - first_beat_cycle + 1);
+            $display("%s: %0d packets (%0d beats) in %0.0f cycles -> %0.3f beats/cycle, %0.4f packets/cycle",
+                     name, packets, beats_sent, cycles, beats_sent / cycles, packets / cycles);
+        end
+    endtask
+
+    // =========================================================================
+    // Main Test Sequence
+    // =========================================================================
+    localparam int BURST_PACKETS = 24;     // fits in the 32 deep FIFO
+    localparam int SUSTAIN_PACKETS = 256;  // long enough to be bounded by the rasterizer
+    longint unsigned drain_cycle;
+
+    initial begin: TEST_VECTORS
+        // Reset
+        arstn = 1'b0;
+        repeat (10) @(posedge aclk);
+        arstn = 1'b1;
+
+        // Wait for clock wizard to lock
+        $display("Waiting for clock wizard to lock...");
+        wait(dut.locked);
+        $display("Clock wizard locked!");
+
+        repeat (100) @(posedge aclk);
+
+        $display("\n=== Starting AXI4-Stream Ingest Test ===\n");
+
+        // Burst: back to back packets, this measures the raw ingest rate of the stream port into the FIFO.
+        // The controller pops at most one packet per triangle so the FIFO only ever fills up from here.
+        for (int n = 0; n < BURST_PACKETS; n++)
+            queue_triangle(9'(10 + 4*n), 8'd10, 9'(12 + 4*n), 8'd12, 9'(10 + 4*n), 8'd12,
+                           8'(8'h20 + n), 16'd50, 16'd50, 16'd50);
+        stream_all();
+        report("Burst into FIFO", BURST_PACKETS);
+        repeat (5) @(posedge aclk);
+        if (fifo_pushes != BURST_PACKETS)
+            $display("ERROR: expected %0d FIFO pushes, saw %0d", BURST_PACKETS, fifo_pushes);
+
+        // Sustained: small triangles so the rasterizer, not the port, sets the pace.
+        wait(dut.hdmi_text_controller_v1_0_AXI_inst.controller_state ==
+             dut.hdmi_text_controller_v1_0_AXI_inst.wait_tri);
+        for (int n = 0; n < SUSTAIN_PACKETS; n++)
+            queue_triangle(9'(20 + (n % 64) * 4), 8'(40 + (n / 64) * 4),
+                           9'(22 + (n % 64) * 4), 8'(42 + (n / 64) * 4),
+                           9'(20 + (n % 64) * 4), 8'(42 + (n / 64) * 4),
+                           8'(n), 16'd40, 16'd40, 16'd40);
+        stream_all();
+        report("Sustained stream", SUSTAIN_PACKETS);
+
+        wait(dut.hdmi_text_controller_v1_0_AXI_inst.fifo_empty == 1'b1);
+        wait(dut.hdmi_text_controller_v1_0_AXI_inst.controller_state ==
+             dut.hdmi_text_controller_v1_0_AXI_inst.wait_tri);
+        drain_cycle = cycle;
+        $display("End to end: %0d packets rasterized %0d cycles after the first beat -> %0.4f packets/cycle",
+                 SUSTAIN_PACKETS, drain_cycle - first_beat_cycle,
+                 real'(SUSTAIN_PACKETS) / real'(drain_cycle - first_beat_cycle));
+        if (fifo_pushes != BURST_PACKETS + SUSTAIN_PACKETS)
+            $display("ERROR: expected %0d FIFO pushes, saw %0d", BURST_PACKETS + SUSTAIN_PACKETS, fifo_pushes);
+
+        `ifdef SIM_VIDEO
+        wait(pixel_vs == 1'b0);
+        wait(pixel_vs == 1'b1);
+        wait(pixel_vs == 1'b0);
+        repeat(1000) @(posedge pixel_clk);
+        $display("\nSaving BMP...");
+        save_bmp("pipeline_axis_test.bmp");
+        `endif
+
+        $display("\n=== Test Complete ===\n");
+        $finish;
+    end
+
+    // Timeout watchdog
+    initial begin
+        #100000000; // 100ms timeout
+        $display("ERROR: Testbench timeout!");
+        $finish;
+    end
+
+endmodule
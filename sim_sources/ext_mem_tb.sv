@@ -0,0 +1,365 @@
+// Tests the external memory path (axi_pixel_cache and axi_scanout_reader) against an AXI memory model with latency.
+// Draws rectangles the way the rasterizer does, one depth read then one depth and color write per pixel, and reports
+// how many pixels per clock get through the cache. Then flushes, checks memory, and scans the rows back out.
+`timescale 1ns / 1ps
+
+//Slave side of an AXI4 memory. One burst at a time, every address handshake waits LATENCY cycles.
+module axi_mem_model#(
+    parameter integer LATENCY = 20
+)(
+    input logic clk,
+    input logic [31:0] AWADDR,
+    input logic AWVALID,
+    output logic AWREADY,
+    input logic [31:0] WDATA,
+    input logic [3:0] WSTRB,
+    input logic WLAST,
+    input logic WVALID,
+    output logic WREADY,
+    output logic [1:0] BRESP,
+    output logic BVALID,
+    input logic BREADY,
+    input logic [31:0] ARADDR,
+    input logic [7:0] ARLEN,
+    input logic ARVALID,
+    output logic ARREADY,
+    output logic [31:0] RDATA,
+    output logic [1:0] RRESP,
+    output logic RLAST,
+    output logic RVALID,
+    input logic RREADY
+);
+    //Word addressed, unwritten words read as 0.
+    logic [31:0] mem[int];
+    int bursts = 0;
+
+    assign BRESP = 2'b00;
+    assign RRESP = 2'b00;
+
+    initial begin
+        automatic logic [31:0] addr;
+        AWREADY <= 0;
+        WREADY <= 0;
+        BVALID <= 0;
+        forever begin
+            @(posedge clk);
+            if (AWVALID) begin
+                repeat (LATENCY) @(posedge clk);
+                AWREADY <= 1;
+                @(posedge clk);
+                AWREADY <= 0;
+                addr = AWADDR;
+                WREADY <= 1;
+                forever begin
+                    @(posedge clk);
+                    if (WVALID) begin
+                        for (int b = 0; b < 4; b++)
+                            if (WSTRB[b])
+                                mem[addr >> 2][8*b +: 8] = WDATA[8*b +: 8];
+                        addr += 4;
+                        if (WLAST)
+                            break;
+                    end
+                end
+                WREADY <= 0;
+                BVALID <= 1;
+                do @(posedge clk); while (!BREADY);
+                BVALID <= 0;
+                bursts++;
+            end
+        end
+    end
+
+    initial begin
+        automatic logic [31:0] addr;
+        automatic int len;
+        ARREADY <= 0;
+        RVALID <= 0;
+        RLAST <= 0;
+        forever begin
+            @(posedge clk);
+            if (ARVALID) begin
+                repeat (LATENCY) @(posedge clk);
+                ARREADY <= 1;
+                @(posedge clk);
+                ARREADY <= 0;
+                addr = ARADDR;
+                len = ARLEN;
+                for (int i = 0; i <= len; i++) begin
+                    RDATA <= mem.exists(addr >> 2) ? mem[addr >> 2] : 32'h0;
+                    RLAST <= i == len;
+                    RVALID <= 1;
+                    do @(posedge clk); while (!RREADY);
+                    addr += 4;
+                end
+                RVALID <= 0;
+                RLAST <= 0;
+                bursts++;
+            end
+        end
+    end
+endmodule
+
+module ext_mem_tb();
+
+    localparam integer MEM_LATENCY = 20;
+    localparam logic [31:0] FB_BASE = 32'h8000_0000;
+    localparam logic [31:0] Z_BASE = FB_BASE + 32'h0006_0000;
+    localparam integer FB_WIDTH = 320;
+    localparam integer FB_HEIGHT = 240;
+
+    logic clk = 1'b0;
+    logic rst = 1'b1;
+    always #5 clk = ~clk;
+
+    //Cache client ports, driven like the rasterizer drives them.
+    logic c_we = 0;
+    logic [31:0] c_addr = 0;
+    logic [7:0] c_din = 0;
+    logic z_re = 0;
+    logic z_we = 0;
+    logic [31:0] z_addr = 0;
+    logic [15:0] z_din = 0;
+    logic [15:0] z_dout;
+    logic flush = 0;
+    logic clean;
+    logic stall;
+
+    logic [31:0] M_AXI_AWADDR;
+    logic [7:0] M_AXI_AWLEN;
+    logic [2:0] M_AXI_AWSIZE;
+    logic [1:0] M_AXI_AWBURST;
+    logic [3:0] M_AXI_AWCACHE;
+    logic [2:0] M_AXI_AWPROT;
+    logic M_AXI_AWVALID;
+    logic M_AXI_AWREADY;
+    logic [31:0] M_AXI_WDATA;
+    logic [3:0] M_AXI_WSTRB;
+    logic M_AXI_WLAST;
+    logic M_AXI_WVALID;
+    logic M_AXI_WREADY;
+    logic [1:0] M_AXI_BRESP;
+    logic M_AXI_BVALID;
+    logic M_AXI_BREADY;
+    logic [31:0] M_AXI_ARADDR;
+    logic [7:0] M_AXI_ARLEN;
+    logic [2:0] M_AXI_ARSIZE;
+    logic [1:0] M_AXI_ARBURST;
+    logic [3:0] M_AXI_ARCACHE;
+    logic [2:0] M_AXI_ARPROT;
+    logic M_AXI_ARVALID;
+    logic M_AXI_ARREADY;
+    logic [31:0] M_AXI_RDATA;
+    logic [1:0] M_AXI_RRESP;
+    logic M_AXI_RLAST;
+    logic M_AXI_RVALID;
+    logic M_AXI_RREADY;
+
+    axi_pixel_cache dut(.*);
+
+    axi_mem_model #(.LATENCY(MEM_LATENCY)) mem(
+        .clk(clk),
+        .AWADDR(M_AXI_AWADDR),
+        .AWVALID(M_AXI_AWVALID),
+        .AWREADY(M_AXI_AWREADY),
+        .WDATA(M_AXI_WDATA),
+        .WSTRB(M_AXI_WSTRB),
+        .WLAST(M_AXI_WLAST),
+        .WVALID(M_AXI_WVALID),
+        .WREADY(M_AXI_WREADY),
+        .BRESP(M_AXI_BRESP),
+        .BVALID(M_AXI_BVALID),
+        .BREADY(M_AXI_BREADY),
+        .ARADDR(M_AXI_ARADDR),
+        .ARLEN(M_AXI_ARLEN),
+        .ARVALID(M_AXI_ARVALID),
+        .ARREADY(M_AXI_ARREADY),
+        .RDATA(M_AXI_RDATA),
+        .RRESP(M_AXI_RRESP),
+        .RLAST(M_AXI_RLAST),
+        .RVALID(M_AXI_RVALID),
+        .RREADY(M_AXI_RREADY)
+    );
+
+    //Scanout reader on its own copy of memory, filled in after the flush.
+    logic [8:0] scan_x = 0;
+    logic [7:0] scan_y = 0;
+    logic vblank = 1;
+    logic [7:0] pixel;
+    logic underrun;
+    logic [31:0] S_ARADDR;
+    logic [7:0] S_ARLEN;
+    logic S_ARVALID;
+    logic S_ARREADY;
+    logic [31:0] S_RDATA;
+    logic [1:0] S_RRESP;
+    logic S_RLAST;
+    logic S_RVALID;
+    logic S_RREADY;
+
+    axi_scanout_reader #(.FB_WIDTH(FB_WIDTH)) scan(
+        .clk(clk),
+        .rst(rst),
+        .base(FB_BASE),
+        .width(9'(FB_WIDTH)),
+        .height(8'(FB_HEIGHT)),
+        .scan_x(scan_x),
+        .scan_y(scan_y),
+        .vblank(vblank),
+        .pixel(pixel),
+        .underrun(underrun),
+        .M_AXI_ARADDR(S_ARADDR),
+        .M_AXI_ARLEN(S_ARLEN),
+        .M_AXI_ARSIZE(),
+        .M_AXI_ARBURST(),
+        .M_AXI_ARCACHE(),
+        .M_AXI_ARPROT(),
+        .M_AXI_ARVALID(S_ARVALID),
+        .M_AXI_ARREADY(S_ARREADY),
+        .M_AXI_RDATA(S_RDATA),
+        .M_AXI_RRESP(S_RRESP),
+        .M_AXI_RLAST(S_RLAST),
+        .M_AXI_RVALID(S_RVALID),
+        .M_AXI_RREADY(S_RREADY)
+    );
+
+    axi_mem_model #(.LATENCY(MEM_LATENCY)) scan_mem(
+        .clk(clk),
+        .AWADDR(32'h0),
+        .AWVALID(1'b0),
+        .AWREADY(),
+        .WDATA(32'h0),
+        .WSTRB(4'h0),
+        .WLAST(1'b0),
+        .WVALID(1'b0),
+        .WREADY(),
+        .BRESP(),
+        .BVALID(),
+        .BREADY(1'b0),
+        .ARADDR(S_ARADDR),
+        .ARLEN(S_ARLEN),
+        .ARVALID(S_ARVALID),
+        .ARREADY(S_ARREADY),
+        .RDATA(S_RDATA),
+        .RRESP(S_RRESP),
+        .RLAST(S_RLAST),
+        .RVALID(S_RVALID),
+        .RREADY(S_RREADY)
+    );
+
+    //What memory should hold once everything is flushed.
+    logic [7:0] exp_color[FB_WIDTH*FB_HEIGHT];
+    logic [15:0] exp_z[FB_WIDTH*FB_HEIGHT];
+    int errors = 0;
+
+    //Wait for the edge the request set up before it is taken.
+    task automatic issue();
+        do @(posedge clk); while (stall);
+    endtask
+
+    //One pixel like the rasterizer: read_zbuf, then the depth test and write on the next cycle.
+    task automatic draw_pixel(input int x, input int y, input logic [7:0] color, input logic [7:0] depth);
+        automatic int idx = y*FB_WIDTH + x;
+        z_re <= 1;
+        z_addr <= Z_BASE + 2*idx;
+        issue();
+        z_re <= 0;
+        @(negedge clk);
+        if (z_dout !== exp_z[idx]) begin
+            $display("ERROR: depth read at (%0d,%0d) got %h, expected %h", x, y, z_dout, exp_z[idx]);
+            errors++;
+        end
+        if (depth < z_dout[7:0]) begin
+            z_we <= 1;
+            z_din <= {8'h00, depth};
+            c_we <= 1;
+            c_addr <= FB_BASE + idx;
+            c_din <= color;
+            exp_z[idx] = {8'h00, depth};
+            exp_color[idx] = color;
+        end
+        issue();
+        z_we <= 0;
+        c_we <= 0;
+    endtask
+
+    task automatic draw_rect(input int x0, input int y0, input int w, input int h,
+                             input logic [7:0] color, input logic [7:0] depth);
+        automatic longint start = $time;
+        automatic int cycles;
+        for (int y = y0; y < y0 + h; y++)
+            for (int x = x0; x < x0 + w; x++)
+                draw_pixel(x, y, color, depth);
+        cycles = ($time - start) / 10;
+        $display("%0dx%0d rect: %0d pixels in %0d cycles, %0.3f pixels/clk (BRAM: 0.500)",
+                 w, h, w*h, cycles, real'(w*h) / cycles);
+    endtask
+
+    initial begin
+        //Depth starts cleared to the far plane, color to 0.
+        for (int i = 0; i < FB_WIDTH*FB_HEIGHT; i++) begin
+            exp_color[i] = 8'h00;
+            exp_z[i] = 16'h00FF;
+        end
+        for (int i = 0; i < FB_WIDTH*FB_HEIGHT / 2; i++)
+            mem.mem[(Z_BASE >> 2) + i] = 32'h00FF_00FF;
+
+        repeat (4) @(posedge clk);
+        rst <= 0;
+        repeat (4) @(posedge clk);
+
+        $display("\n=== External memory, %0d cycle latency ===\n", MEM_LATENCY);
+        draw_rect(16, 8, 96, 32, 8'hE0, 8'd100);
+        //Nearer, overlapping the first one, so some depth lines come back from memory.
+        draw_rect(64, 24, 96, 32, 8'h1C, 8'd50);
+        //Further away, only the uncovered part gets written.
+        draw_rect(0, 0, 160, 48, 8'h03, 8'd150);
+
+        //Flush like the controller does before a swap.
+        flush <= 1;
+        do @(posedge clk); while (!clean);
+        flush <= 0;
+        $display("Flushed, %0d bursts total", mem.bursts);
+
+        for (int i = 0; i < FB_WIDTH*FB_HEIGHT; i++) begin
+            automatic logic [31:0] cw = mem.mem.exists((FB_BASE >> 2) + i/4) ? mem.mem[(FB_BASE >> 2) + i/4] : 32'h0;
+            automatic logic [31:0] zw = mem.mem[(Z_BASE >> 2) + i/2];
+            if (cw[8*(i%4) +: 8] !== exp_color[i] || zw[16*(i%2) +: 16] !== exp_z[i]) begin
+                if (errors < 16)
+                    $display("ERROR: pixel %0d holds color %h depth %h, expected %h %h", i,
+                             cw[8*(i%4) +: 8], zw[16*(i%2) +: 16], exp_color[i], exp_z[i]);
+                errors++;
+            end
+        end
+
+        //Scan the first rows back out at one frame buffer pixel every 4 clocks, as at 320x240.
+        scan_mem.mem = mem.mem;
+        vblank <= 1;
+        repeat (2000) @(posedge clk);
+        vblank <= 0;
+        for (int y = 0; y < 48; y++) begin
+            scan_y <= y;
+            for (int x = 0; x < FB_WIDTH; x++) begin
+                scan_x <= x;
+                @(posedge clk);
+                @(negedge clk);
+                if (underrun) begin
+                    $display("ERROR: scanout underrun on row %0d", y);
+                    errors++;
+                end else if (pixel !== exp_color[y*FB_WIDTH + x]) begin
+                    if (errors < 16)
+                        $display("ERROR: scanout (%0d,%0d) got %h, expected %h", x, y, pixel,
+                                 exp_color[y*FB_WIDTH + x]);
+                    errors++;
+                end
+                repeat (3) @(posedge clk);
+            end
+        end
+
+        if (errors == 0)
+            $display("\nPASS");
+        else
+            $display("\nFAIL, %0d errors", errors);
+        $finish;
+    end
+endmodule
@@ -250,6 +250,10 @@ module framebuffer_tb();
             end
         end
         
+        // Direct writes bypass the lazy tile clear, so mark every tile of the draw buffer as cleared
+        // or scanout would show the clear color instead.
+        dut.hdmi_text_controller_v1_0_AXI_inst.tile_valid_bits[dut.hdmi_text_controller_v1_0_AXI_inst.draw_buf] = '1;
+
         $display("Finished drawing. Waiting for buffer swap and frame display...");
         
         // Wait for vsync to trigger buffer swap (falling edge swaps buffers)
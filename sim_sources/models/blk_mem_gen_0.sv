@@ -0,0 +1,45 @@
+`timescale 1ns / 1ps
+//Behavioral model of the blk_mem_gen_0 IP (frame buffer) for simulators without the Xilinx libraries.
+//True dual port, 76800 x 8 bits, write first, 1 cycle read latency on both ports, no output registers.
+//Preloaded with 0 like the IP. Synthesizable, it infers the same block RAM.
+module blk_mem_gen_0(
+    input logic clka,
+    input logic ena,
+    input logic [0:0] wea,
+    input logic [16:0] addra,
+    input logic [7:0] dina,
+    output logic [7:0] douta,
+    input logic clkb,
+    input logic enb,
+    input logic [0:0] web,
+    input logic [16:0] addrb,
+    input logic [7:0] dinb,
+    output logic [7:0] doutb
+);
+
+localparam integer DEPTH = 76800;
+
+logic [7:0] mem[DEPTH] = '{default: 8'h00};
+
+always_ff @(posedge clka) begin
+    if (ena) begin
+        if (wea) begin
+            mem[addra] <= dina;
+            douta <= dina;
+        end else begin
+            douta <= mem[addra];
+        end
+    end
+end
+
+always_ff @(posedge clkb) begin
+    if (enb) begin
+        if (web) begin
+            mem[addrb] <= dinb;
+            doutb <= dinb;
+        end else begin
+            doutb <= mem[addrb];
+        end
+    end
+end
+endmodule
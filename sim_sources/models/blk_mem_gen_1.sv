@@ -0,0 +1,28 @@
+`timescale 1ns / 1ps
+//Behavioral model of the blk_mem_gen_1 IP (z buffer) for simulators without the Xilinx libraries.
+//Single port, 76800 x 10 bits ({epoch, depth}), write first, 1 cycle read latency, no output register.
+//Starts at 0, the controller sweeps it on the first frame anyway.
+module blk_mem_gen_1(
+    input logic clka,
+    input logic ena,
+    input logic [0:0] wea,
+    input logic [16:0] addra,
+    input logic [9:0] dina,
+    output logic [9:0] douta
+);
+
+localparam integer DEPTH = 76800;
+
+logic [9:0] mem[DEPTH] = '{default: 10'h000};
+
+always_ff @(posedge clka) begin
+    if (ena) begin
+        if (wea) begin
+            mem[addra] <= dina;
+            douta <= dina;
+        end else begin
+            douta <= mem[addra];
+        end
+    end
+end
+endmodule
@@ -0,0 +1,31 @@
+`timescale 1ns / 1ps
+//Behavioral model of the clk_wiz_0 IP for simulators without the Xilinx libraries.
+//clk_out1 is the 100 MHz input divided by 4, so it keeps the same phase relation to the AXI clock on every run.
+//clk_out2 (the 5x clock) only feeds the TMDS serializers, which the hdmi_tx_0 model doesn't have, so it is
+//the input clock. locked rises a few cycles after reset like the real MMCM.
+module clk_wiz_0(
+    input logic clk_in1,
+    input logic reset,
+    output logic clk_out1,
+    output logic clk_out2,
+    output logic locked
+);
+
+logic [1:0] div = 0;
+logic [3:0] lock_count = 0;
+
+always_ff @(posedge clk_in1) begin
+    if (reset) begin
+        div <= 0;
+        lock_count <= 0;
+    end else begin
+        div <= div + 1;
+        if (lock_count != 4'hF)
+            lock_count <= lock_count + 1;
+    end
+end
+
+assign clk_out1 = div[1];
+assign clk_out2 = clk_in1;
+assign locked = lock_count == 4'hF;
+endmodule
@@ -0,0 +1,46 @@
+`timescale 1ns / 1ps
+//Behavioral model of the fifo_generator_0 IP (command FIFO) for simulators without the Xilinx libraries.
+//Native interface, common clock, standard read mode: dout changes the cycle after rd_en. 192 bits x 32 entries.
+//Writes while full and reads while empty are ignored, like the IP.
+module fifo_generator_0(
+    input logic clk,
+    input logic srst,
+    input logic [191:0] din,
+    input logic wr_en,
+    input logic rd_en,
+    output logic [191:0] dout,
+    output logic full,
+    output logic empty
+);
+
+localparam integer DEPTH = 32;
+
+logic [191:0] mem[DEPTH];
+logic [4:0] wr_ptr, rd_ptr;
+logic [5:0] count;
+logic do_wr, do_rd;
+
+assign do_wr = wr_en && !full;
+assign do_rd = rd_en && !empty;
+assign full = count == DEPTH;
+assign empty = count == 0;
+
+always_ff @(posedge clk) begin
+    if (srst) begin
+        wr_ptr <= 0;
+        rd_ptr <= 0;
+        count <= 0;
+        dout <= 0;
+    end else begin
+        if (do_wr) begin
+            mem[wr_ptr] <= din;
+            wr_ptr <= wr_ptr + 1;
+        end
+        if (do_rd) begin
+            dout <= mem[rd_ptr];
+            rd_ptr <= rd_ptr + 1;
+        end
+        count <= count + do_wr - do_rd;
+    end
+end
+endmodule
@@ -0,0 +1,30 @@
+`timescale 1ns / 1ps
+//Behavioral model of the Real Digital hdmi_tx_0 IP for simulators without the Xilinx libraries.
+//There is no TMDS encoder or serializer: testbenches read red/green/blue/hsync/vsync/vde where they go in. The
+//pixel clock is passed through on the clock pair so the outputs aren't left floating.
+module hdmi_tx_0(
+    input logic pix_clk,
+    input logic pix_clkx5,
+    input logic pix_clk_locked,
+    input logic rst,
+    input logic [3:0] red,
+    input logic [3:0] green,
+    input logic [3:0] blue,
+    input logic hsync,
+    input logic vsync,
+    input logic vde,
+    input logic [3:0] aux0_din,
+    input logic [3:0] aux1_din,
+    input logic [3:0] aux2_din,
+    input logic ade,
+    output logic TMDS_CLK_P,
+    output logic TMDS_CLK_N,
+    output logic [2:0] TMDS_DATA_P,
+    output logic [2:0] TMDS_DATA_N
+);
+
+assign TMDS_CLK_P = pix_clk;
+assign TMDS_CLK_N = ~pix_clk;
+assign TMDS_DATA_P = 3'b000;
+assign TMDS_DATA_N = 3'b111;
+endmodule
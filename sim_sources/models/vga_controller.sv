@@ -0,0 +1,41 @@
+`timescale 1ns / 1ps
+//Behavioral model of the course provided vga_controller: 640x480 at 60 Hz from a 25 MHz pixel clock.
+//800 pixels per line and 525 lines per frame, sync pulses active low at pixels 656-751 and lines 490-491.
+module vga_controller(
+    input logic pixel_clk,
+    input logic reset,
+    output logic hs,
+    output logic vs,
+    output logic active_nblank,
+    output logic [9:0] drawX,
+    output logic [9:0] drawY
+);
+
+localparam logic [9:0] H_TOTAL = 800;
+localparam logic [9:0] V_TOTAL = 525;
+
+logic [9:0] hc, vc;
+logic [9:0] hc_next, vc_next;
+
+assign hc_next = (hc == H_TOTAL - 1) ? 10'd0 : hc + 1;
+assign vc_next = (hc != H_TOTAL - 1) ? vc : (vc == V_TOTAL - 1) ? 10'd0 : vc + 1;
+
+always_ff @(posedge pixel_clk or posedge reset) begin
+    if (reset) begin
+        hc <= 0;
+        vc <= 0;
+        hs <= 1'b1;
+        vs <= 1'b1;
+    end else begin
+        hc <= hc_next;
+        vc <= vc_next;
+        //Registered from the next count, so they line up with drawX/drawY.
+        hs <= !(hc_next >= 656 && hc_next < 752);
+        vs <= !(vc_next >= 490 && vc_next < 492);
+    end
+end
+
+assign drawX = hc;
+assign drawY = vc;
+assign active_nblank = hc < 640 && vc < 480;
+endmodule
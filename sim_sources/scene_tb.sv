@@ -0,0 +1,276 @@
+// Stress scene playback. AXI plumbing copied from axi_tb.sv.
+// Feeds the packets scenegen.c wrote for a scene (software_sources/scene_<name>.mem, pick it with
+// +scene=<file>) through the command ring the way main() does, one frame at a time, and writes a row per frame
+// to scene_frames.csv: how long the controller was busy drawing, how long it sat waiting for packets, and how
+// many pixels it wrote. busy_cycles is what the hardware needs for the frame, starved_cycles shows how much of
+// the frame the AXI-Lite feed held it up.
+`timescale 1ns / 1ps
+
+module tb_scene();
+
+    // =========================================================================
+    // Clock & Reset
+    // =========================================================================
+    logic aclk = 1'b0;
+    logic arstn = 1'b0;
+    always #5 aclk = ~aclk; // 100MHz
+
+    // =========================================================================
+    // AXI signals
+    // =========================================================================
+    logic [13:0] write_addr = 14'd0;
+    logic write_addr_valid = 1'b0;
+    logic write_addr_ready;
+    logic [31:0] write_data = 32'd0;
+    logic write_data_valid = 1'b0;
+    logic write_data_ready;
+    logic [1:0] write_resp;
+    logic write_resp_valid;
+    logic write_resp_ready = 1'b0;
+
+    logic [13:0] axi_araddr = 14'd0;
+    logic [2:0] axi_arprot = 3'd0;
+    logic axi_arvalid = 1'b0;
+    logic axi_arready;
+    logic [31:0] axi_rdata;
+    logic [1:0] axi_rresp;
+    logic axi_rvalid;
+    logic axi_rready = 1'b0;
+
+    logic [2:0] axi_awprot = 3'd0;
+    logic [3:0] axi_wstrb = 4'b1111;
+
+    logic hdmi_clk_n, hdmi_clk_p;
+    logic [2:0] hdmi_tx_n, hdmi_tx_p;
+
+    // =========================================================================
+    // DUT Instantiation
+    // =========================================================================
+    hdmi_text_controller_v1_0 #(
+        .C_AXI_DATA_WIDTH(32),
+        .C_AXI_ADDR_WIDTH(14)
+    ) dut (
+        .hdmi_clk_n(hdmi_clk_n),
+        .hdmi_clk_p(hdmi_clk_p),
+        .hdmi_tx_n(hdmi_tx_n),
+        .hdmi_tx_p(hdmi_tx_p),
+        .axi_aclk(aclk),
+        .axi_aresetn(arstn),
+        .axi_awaddr(write_addr),
+        .axi_awvalid(write_addr_valid),
+        .axi_awready(write_addr_ready),
+        .axi_wdata(write_data),
+        .axi_wvalid(write_data_valid),
+        .axi_wready(write_data_ready),
+        .axi_bresp(write_resp),
+        .axi_bvalid(write_resp_valid),
+        .axi_bready(write_resp_ready),
+        .axi_araddr(axi_araddr),
+        .axi_arprot(axi_arprot),
+        .axi_arvalid(axi_arvalid),
+        .axi_arready(axi_arready),
+        .axi_rdata(axi_rdata),
+        .axi_rresp(axi_rresp),
+        .axi_rvalid(axi_rvalid),
+        .axi_rready(axi_rready),
+        .axi_awprot(axi_awprot),
+        .axi_wstrb(axi_wstrb)
+    );
+
+    // =========================================================================
+    // Measurement, per frame
+    // =========================================================================
+    longint unsigned cycle = 0;
+    longint unsigned busy_cycles = 0;
+    longint unsigned starved_cycles = 0;
+    int unsigned pixels = 0;
+    int unsigned triangles = 0;
+
+    always @(posedge aclk) begin
+        cycle <= cycle + 1;
+        // Waiting on the swap is vsync time, not drawing
+        if (dut.hdmi_text_controller_v1_0_AXI_inst.controller_state.name() == "wait_tri")
+            starved_cycles++;
+        else if (dut.hdmi_text_controller_v1_0_AXI_inst.controller_state.name() != "wait_swap")
+            busy_cycles++;
+        if (dut.hdmi_text_controller_v1_0_AXI_inst.raster.px_zpass)
+            pixels++;
+        if (dut.hdmi_text_controller_v1_0_AXI_inst.rasterizer_done)
+            triangles++;
+    end
+
+    // =========================================================================
+    // AXI tasks
+    // =========================================================================
+    task axi_write (input logic [31:0] addr, input logic [31:0] data);
+        begin
+            #3 write_addr <= addr;
+            write_data <= data;
+            write_addr_valid <= 1'b1;
+            write_data_valid <= 1'b1;
+            write_resp_ready <= 1'b1;
+
+            wait(write_data_ready || write_addr_ready);
+            @(posedge aclk);
+            if (write_data_ready && write_addr_ready) begin
+                write_addr_valid <= 0;
+                write_data_valid <= 0;
+            end else begin
+                if (write_data_ready) begin
+                    write_data_valid <= 0;
+                    wait(write_addr_ready);
+                end else if (write_addr_ready) begin
+                    write_addr_valid <= 0;
+                    wait(write_data_ready);
+                end
+                @(posedge aclk);
+                write_addr_valid <= 0;
+                write_data_valid <= 0;
+            end
+
+            wait(write_resp_valid);
+            @(posedge aclk);
+            write_resp_ready <= 0;
+        end
+    endtask
+
+    task axi_read (input logic [31:0] addr, output logic [31:0] data);
+        begin
+            #3 axi_araddr <= addr;
+            axi_arvalid <= 1'b1;
+            axi_rready <= 1'b1;
+
+            wait(axi_arready);
+            @(posedge aclk);
+            axi_arvalid <= 1'b0;
+
+            wait(axi_rvalid);
+            data = axi_rdata;
+            @(posedge aclk);
+            axi_rready <= 1'b0;
+        end
+    endtask
+
+    // =========================================================================
+    // Command Ring
+    // =========================================================================
+    localparam int RING_BASE = 'h2000;
+    localparam int RING_SLOTS = 256;
+    localparam int REG_RING_HEAD = 6 * 4;
+    localparam int REG_RING_TAIL = 7 * 4;
+    localparam int REG_CTRL = 8 * 4;
+    localparam int REG_FENCE = 10 * 4;
+    localparam logic [7:0] OP_SWAP = 8'h05;
+    localparam logic [7:0] OP_FENCE = 8'h06;
+    localparam logic [31:0] CTRL_MANUAL_SWAP = 32'h1;
+    localparam logic [31:0] CTRL_SCANOUT_CLEAR = 32'h2;
+    int unsigned ring_head = 0;
+
+    task ring_write(input logic [191:0] packet);
+        logic [31:0] tail;
+        begin
+            // Only slots the fetcher has moved on from may be rewritten
+            axi_read(REG_RING_TAIL, tail);
+            if (ring_head - tail == RING_SLOTS) begin
+                ring_doorbell();
+                do begin
+                    axi_read(REG_RING_TAIL, tail);
+                end while (ring_head - tail == RING_SLOTS);
+            end
+            for (int i = 0; i < 6; i++)
+                axi_write(RING_BASE + (ring_head % RING_SLOTS) * 32 + i * 4, packet[32 * i +: 32]);
+            ring_head++;
+        end
+    endtask
+
+    task ring_doorbell();
+        axi_write(REG_RING_HEAD, ring_head);
+    endtask
+
+    // =========================================================================
+    // Main Test Sequence
+    // =========================================================================
+    localparam int MAX_PACKETS = 65536;
+    // Marks the slots past the end of the file. Verilator has no X to test for, and an opcode of 0xFF is not a
+    // command, so scenegen never writes it.
+    localparam logic [191:0] NO_PACKET = '1;
+
+    logic [191:0] packets[MAX_PACKETS];
+    string scene;
+    integer csv;
+
+    initial begin: TEST_VECTORS
+        logic [31:0] fence;
+        longint unsigned frame_start;
+        int frame, sent;
+
+        frame = 0;
+        sent = 0;
+        if (!$value$plusargs("scene=%s", scene))
+            scene = "scene.mem";
+        for (int i = 0; i < MAX_PACKETS; i++)
+            packets[i] = NO_PACKET;
+        $readmemh(scene, packets);
+        if (packets[0] === NO_PACKET || $isunknown(packets[0])) begin
+            $display("ERROR: no packets in %s, write it with scenegen in software_sources", scene);
+            $finish;
+        end
+
+        arstn = 1'b0;
+        repeat (10) @(posedge aclk);
+        arstn = 1'b1;
+        wait(dut.locked);
+        repeat (100) @(posedge aclk);
+
+        csv = $fopen("scene_frames.csv", "w");
+        if (!csv) begin
+            $display("Could not open scene_frames.csv");
+            $finish;
+        end
+        $fdisplay(csv, "frame,packets,triangles_drawn,busy_cycles,starved_cycles,frame_cycles,pixels_written,busy_fps_limit");
+
+        // Same setup as main() with the command ring
+        axi_write(REG_CTRL, CTRL_MANUAL_SWAP | CTRL_SCANOUT_CLEAR);
+
+        frame_start = cycle;
+        busy_cycles = 0;
+        starved_cycles = 0;
+        pixels = 0;
+        triangles = 0;
+        for (int i = 0; i < MAX_PACKETS && packets[i] !== NO_PACKET && !$isunknown(packets[i]); i++) begin
+            ring_write(packets[i]);
+            sent++;
+            if (packets[i][159:152] != OP_SWAP)
+                continue;
+
+            // End of a frame. The FENCE before the SWAP says when everything before it has been drawn.
+            ring_doorbell();
+            do begin
+                axi_read(REG_FENCE, fence);
+            end while (fence != packets[i][191:160]);
+            $fdisplay(csv, "%0d,%0d,%0d,%0d,%0d,%0d,%0d,%.1f", frame, sent, triangles, busy_cycles, starved_cycles,
+                      cycle - frame_start, pixels, busy_cycles ? 100.0e6 / busy_cycles : 0.0);
+            $display("Frame %0d: %0d packets, %0d busy cycles, %0d starved, %0d pixels", frame, sent, busy_cycles,
+                     starved_cycles, pixels);
+            frame++;
+            sent = 0;
+            frame_start = cycle;
+            busy_cycles = 0;
+            starved_cycles = 0;
+            pixels = 0;
+            triangles = 0;
+        end
+
+        $fclose(csv);
+        $display("\nPlayed %0d frames of %s, wrote scene_frames.csv", frame, scene);
+        $finish;
+    end
+
+    // Timeout watchdog
+    initial begin
+        #1000000000; // 1s timeout
+        $display("ERROR: Testbench timeout!");
+        $finish;
+    end
+
+endmodule
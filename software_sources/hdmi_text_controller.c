@@ -20,6 +20,29 @@
 #include "platform.h"
 
 #include "hdmi_text_controller.h"
+#include "profiler.h"
+
+// Build with -DHDMI_SCENE='"scene_<name>.h"' to draw a stress scene from
+// scenegen.c along its camera path instead of the Cornell box
+#ifdef HDMI_SCENE
+#include HDMI_SCENE
+#define MESH scene_mesh
+#define MESH_TRIANGLE_COUNT scene_triangle_count
+#else
+#define MESH cornell_box
+#define MESH_TRIANGLE_COUNT cornell_box_triangle_count
+#endif
+
+// Build with -DHDMI_MESH='"mesh_<model>.h"' to draw a model compiled by meshc.c
+#ifdef HDMI_MESH
+#include HDMI_MESH
+#include "mesh_format.h"
+#endif
+
+#ifdef HDMI_USE_AXI_DMA
+#include "xaxidma.h"
+#include "xil_cache.h"
+#endif
 
 extern HID_DEVICE hid_device;
 static BYTE addr = 1; 				//hard-wired USB address
@@ -96,12 +119,401 @@ void matvec4x1(const float mat[16], const float vec[4],
   }
 }
 
+#ifdef HDMI_USE_AXI_DMA
+// Two packet buffers, so the DMA can stream frame N while we transform frame N+1.
+static TrianglePacket frame_pkts[2][MAX_FRAME_TRIANGLES];
+static XAxiDma dma;
+
+int dma_init() {
+	XAxiDma_Config *cfg = XAxiDma_LookupConfig(XPAR_AXIDMA_0_DEVICE_ID);
+	if (cfg == NULL || XAxiDma_CfgInitialize(&dma, cfg) != XST_SUCCESS)
+		return XST_FAILURE;
+	// We poll for completion instead of using interrupts
+	XAxiDma_IntrDisable(&dma, XAXIDMA_IRQ_ALL_MASK, XAXIDMA_DMA_TO_DEVICE);
+	return XST_SUCCESS;
+}
+
+// Waits for the previous frame to finish streaming, then starts this one.
+// The previous buffer is free again once this returns.
+void dma_submit(TrianglePacket *pkts, int count) {
+	if (count == 0)
+		return;
+	while (XAxiDma_Busy(&dma, XAXIDMA_DMA_TO_DEVICE));
+	Xil_DCacheFlushRange((UINTPTR)pkts, count * sizeof(TrianglePacket));
+	XAxiDma_SimpleTransfer(&dma, (UINTPTR)pkts, count * sizeof(TrianglePacket),
+						   XAXIDMA_DMA_TO_DEVICE);
+}
+#endif
+
+#ifdef HDMI_USE_RING
+#define HDMI_BASE XPAR_HDMI_TEXT_CONTROLLER_0_AXI_BASEADDR
+static u32 ring_head = 0;
+static u32 frame_count = 0;
+
+// Tells the hardware about every slot filled so far.
+void ring_doorbell() {
+	HDMI_TEXT_CONTROLLER_mWriteReg(HDMI_BASE, HDMI_REG_RING_HEAD, ring_head);
+}
+
+// Copies words first to 5 of one packet into the next free ring slot. Nothing
+// is drawn until the doorbell is rung, so a whole frame can be queued and
+// started at once.
+void ring_push_words(const TrianglePacket *p, int first) {
+	// Ring is full, so hand over what we have and wait for a slot to free up
+	if (ring_head - HDMI_TEXT_CONTROLLER_mReadReg(HDMI_BASE, HDMI_REG_RING_TAIL) >= HDMI_RING_SLOTS) {
+		ring_doorbell();
+		while (ring_head - HDMI_TEXT_CONTROLLER_mReadReg(HDMI_BASE, HDMI_REG_RING_TAIL) >= HDMI_RING_SLOTS);
+	}
+	volatile u32 *slot = (u32*)(HDMI_BASE + HDMI_RING_OFFSET +
+			(ring_head % HDMI_RING_SLOTS) * HDMI_RING_SLOT_BYTES);
+	const u32 *words = (const u32*)p;
+	for (int w = first; w < 6; w++)
+		slot[w] = words[w];
+	ring_head++;
+}
+
+void ring_push(const TrianglePacket *p) {
+	ring_push_words(p, 0);
+}
+
+#ifdef HDMI_TRACE
+// Build with HDMI_TRACE (and the IP with TRACE_ENABLE) to print the triangle
+// trace over UART as CSV every HDMI_TRACE_FRAMES frames. The trace restarts
+// after each dump, so every dump covers the frames since the last one (the
+// last HDMI_TRACE_ENTRIES triangles of them).
+#define HDMI_TRACE_FRAMES 600
+
+void trace_dump_csv() {
+	u32 count = HDMI_TEXT_CONTROLLER_mReadReg(HDMI_BASE, HDMI_REG_TRACE_COUNT);
+	u32 first = count > HDMI_TRACE_ENTRIES ? count - HDMI_TRACE_ENTRIES : 0;
+	xil_printf("index,frame,pop_cycle,setup_cycles,raster_cycles,pixels_visited,pixels_written,culled,cut_off,indexed,quad\r\n");
+	for (u32 n = first; n < count; n++) {
+		u32 entry = HDMI_TRACE_OFFSET + (n % HDMI_TRACE_ENTRIES) * HDMI_TRACE_ENTRY_BYTES;
+		u32 pop = HDMI_TEXT_CONTROLLER_mReadReg(HDMI_BASE, entry);
+		u32 info = HDMI_TEXT_CONTROLLER_mReadReg(HDMI_BASE, entry + 4);
+		u32 raster = HDMI_TEXT_CONTROLLER_mReadReg(HDMI_BASE, entry + 8);
+		u32 pixels = HDMI_TEXT_CONTROLLER_mReadReg(HDMI_BASE, entry + 12);
+		xil_printf("%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d\r\n", n, info >> 20, pop, info & 0xFFFF, raster,
+				   pixels & 0xFFFF, pixels >> 16, (info >> 16) & 1, (info >> 17) & 1, (info >> 18) & 1,
+				   (info >> 19) & 1);
+	}
+	HDMI_TEXT_CONTROLLER_mWriteReg(HDMI_BASE, HDMI_REG_TRACE_COUNT, 0);
+}
+#endif
+#endif
+
 float dir = 0.5;
 float theta = 0.0f;
 float r = 100.0f;
 
+// Render resolution, and the viewport scale that goes with it (half the width and height)
+static int render_res = HDMI_RES_320x240;
+static float viewport_x = 160.0f, viewport_y = 120.0f;
+
+// For the frames built from now on. The SWAP that ended the last frame told the
+// hardware, which switches when that frame flips, right before drawing the next.
+void set_render_res(int res) {
+	render_res = res;
+	viewport_x = (float)(160 >> res);
+	viewport_y = (float)(120 >> res);
+}
+
+#ifndef HDMI_USE_LITE_REGS
+// What the IP kept from the last triangle for STRIP and FAN (x, y, z as sent).
+// The staging registers can drop packets, so this is only used when every
+// packet is sure to arrive.
+static uint16_t prim_center[3], prim_last1[3], prim_last2[3];
+static int prim_odd, prim_valid;
+
+static int same_vertex(const uint16_t *a, const uint16_t *b) {
+	return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+}
+
+// Picks the command with the fewest words for the triangle in data: STRIP or
+// FAN if two of its vertices are ones the IP kept, with the vertices rotated
+// so the new one is last, otherwise DRAW_TRI. Rotating keeps the winding and
+// the pixels drawn.
+int strip_or_fan(DATA *data) {
+	uint16_t t[9];
+	for (int r = 0; r < 3 && prim_valid; r++) {
+		for (int j = 0; j < 9; j++)
+			t[j] = data->vertices[(3 * r + j) % 9];
+		int op;
+		if (same_vertex(&t[0], prim_odd ? prim_last2 : prim_last1) &&
+			same_vertex(&t[3], prim_odd ? prim_last1 : prim_last2))
+			op = HDMI_OP_STRIP;
+		else if (same_vertex(&t[0], prim_center) && same_vertex(&t[3], prim_last2))
+			op = HDMI_OP_FAN;
+		else
+			continue;
+		for (int j = 0; j < 9; j++)
+			data->vertices[j] = t[j];
+		memcpy(prim_last1, prim_last2, sizeof(prim_last1));
+		memcpy(prim_last2, &t[6], sizeof(prim_last2));
+		if (op == HDMI_OP_STRIP)
+			prim_odd = !prim_odd;
+		return op;
+	}
+	for (int j = 0; j < 9; j++)
+		t[j] = data->vertices[j];
+	memcpy(prim_center, &t[0], sizeof(prim_center));
+	memcpy(prim_last1, &t[3], sizeof(prim_last1));
+	memcpy(prim_last2, &t[6], sizeof(prim_last2));
+	prim_odd = 1;
+	prim_valid = 1;
+	return HDMI_OP_DRAW_TRI;
+}
+#endif
+
+#ifdef HDMI_MESH
+#ifndef HDMI_USE_RING
+#error HDMI_MESH needs the command ring build
+#endif
+
+// Draws a mesh compiled by meshc.c (mesh_format.h) instead of MESH. Each vertex
+// is transformed once and loaded into the IP's vertex table with LOAD_VERTS,
+// and triangles are drawn from the table with DRAW_INDEXED, so the 256 table
+// entries act as a post-transform vertex cache. Entries are reused in FIFO
+// order, which is the cache meshc orders the triangles for.
+//
+// LOAD_VERTS writes 3 consecutive entries. Loads go to the ring as soon as 3
+// vertices are waiting, draws are held back in a batch until the vertices
+// they use have all been sent, and a batch is flushed before a load would
+// overwrite an entry one of its draws still reads.
+//
+// Triangle pairs meshc flagged MESH_TRI_QUAD go out as one DRAW_QUAD when
+// neither half would be culled and the quad is still convex and front facing
+// in the coordinates the IP sees, otherwise as the two triangles. Both draw
+// the same pixels.
+#define MESH_BATCH 64
+#define MESH_SLOT_HASH 4096 // power of 2
+#define VTX_TABLE_ENTRIES 256
+
+// Clip space outcodes
+#define OUT_LEFT 0x01
+#define OUT_RIGHT 0x02
+#define OUT_BOTTOM 0x04
+#define OUT_TOP 0x08
+#define OUT_NEAR 0x10
+#define OUT_FAR 0x20
+#define OUT_BAD_W 0x40 // too close to the eye to divide by
+
+static const MeshHeader *mesh = (const MeshHeader *)mesh_data;
+static uint8_t mesh_slot[MESH_SLOT_HASH];		// last entry vertex (hashed) was loaded into
+static int32_t slot_vertex[VTX_TABLE_ENTRIES];	// vertex in each entry, -1 if none
+static u32 slot_batch[VTX_TABLE_ENTRIES];		// last batch that drew from the entry
+static uint32_t slot_xyz[VTX_TABLE_ENTRIES][3];	// screen x, y and z
+static uint8_t slot_out[VTX_TABLE_ENTRIES];
+static uint8_t next_slot;
+static u32 batch = 1;
+static TrianglePacket batch_draws[MESH_BATCH];
+static int batch_draw_count;
+static uint8_t load_base, load_count;
+
+static uint8_t outcode(const float v[4]) {
+	uint8_t out = 0;
+	if (v[0] < -v[3]) out |= OUT_LEFT;
+	if (v[0] > v[3]) out |= OUT_RIGHT;
+	if (v[1] < -v[3]) out |= OUT_BOTTOM;
+	if (v[1] > v[3]) out |= OUT_TOP;
+	if (v[2] < 0) out |= OUT_NEAR;
+	if (v[2] > v[3]) out |= OUT_FAR;
+	if (v[3] <= 0.0001f) out |= OUT_BAD_W;
+	return out;
+}
+
+// Sends the waiting vertices. Entries of the packet past them get what they
+// already hold.
+void mesh_flush_loads() {
+	if (load_count == 0)
+		return;
+	uint16_t v[9];
+	for (int k = 0; k < 3; k++) {
+		const uint32_t *xyz = slot_xyz[(uint8_t)(load_base + k)];
+		v[3 * k] = xyz[0];
+		v[3 * k + 1] = xyz[1];
+		v[3 * k + 2] = xyz[2];
+	}
+	TrianglePacket pkt;
+	pkt.v0v1 = (v[1] << 16) | v[0];
+	pkt.v2v3 = (v[3] << 16) | v[2];
+	pkt.v4v5 = (v[5] << 16) | v[4];
+	pkt.v6v7 = (v[7] << 16) | v[6];
+	pkt.v8color = v[8];
+	hdmi_cmd_load_verts(&pkt, load_base);
+	ring_push(&pkt);
+	load_count = 0;
+}
+
+void mesh_flush() {
+	mesh_flush_loads();
+	for (int i = 0; i < batch_draw_count; i++)
+		ring_push(&batch_draws[i]);
+	batch_draw_count = 0;
+	batch++;
+}
+
+// Returns the table entry holding vertex v (an index into mesh_vertices()),
+// loading it first if it isn't there
+uint8_t mesh_vertex(int32_t v, const float mvp[16]) {
+	uint8_t s = mesh_slot[v & (MESH_SLOT_HASH - 1)];
+	if (slot_vertex[s] != v) {
+		s = next_slot;
+		if (slot_batch[s] == batch)
+			mesh_flush();
+		next_slot++;
+
+		PROF_START(PROF_TRANSFORM);
+		const MeshVertex *q = &mesh_vertices(mesh)[v];
+		float model_vec[4] = {(float)q->x, (float)q->y, (float)q->z, 1.0f};
+		float vec[4];
+		matvec4x1(mvp, model_vec, vec);
+		slot_out[s] = outcode(vec);
+		if (!(slot_out[s] & OUT_BAD_W)) {
+			slot_xyz[s][0] = (uint32_t)((vec[0] / vec[3] + 1.0f) * viewport_x);
+			slot_xyz[s][1] = (uint32_t)((1.0f - vec[1] / vec[3]) * viewport_y);
+			slot_xyz[s][2] = (uint16_t)(vec[2] / vec[3] * 255.0f);
+		}
+		PROF_STOP(PROF_TRANSFORM);
+
+		slot_vertex[s] = v;
+		mesh_slot[v & (MESH_SLOT_HASH - 1)] = s;
+		if (load_count == 0)
+			load_base = s;
+		if (++load_count == 3)
+			mesh_flush_loads();
+	}
+	slot_batch[s] = batch;
+	return s;
+}
+
+// 8.24 r_area of the triangle in entries a, b, c
+static int32_t slot_r_area(uint8_t a, uint8_t b, uint8_t c) {
+	const uint32_t *p = slot_xyz[a], *q = slot_xyz[b], *r = slot_xyz[c];
+	float r_area = 2.0f / (p[0] * (q[1] - r[1]) + q[0] * (r[1] - p[1]) + r[0] * (p[1] - q[1]));
+	if (r_area < 0) r_area *= -1;
+	return (int32_t) (r_area * (1 << 24));
+}
+
+// Area * 2 of the triangle in entries a, b, c as the IP sees it (9 bit x,
+// 8 bit y), positive when it would be drawn
+static int32_t slot_area(uint8_t a, uint8_t b, uint8_t c) {
+	int32_t xa = slot_xyz[a][0] & 0x1FF, ya = slot_xyz[a][1] & 0xFF;
+	int32_t xb = slot_xyz[b][0] & 0x1FF, yb = slot_xyz[b][1] & 0xFF;
+	int32_t xc = slot_xyz[c][0] & 0x1FF, yc = slot_xyz[c][1] & 0xFF;
+	return xa * (yb - yc) + xb * (yc - ya) + xc * (ya - yb);
+}
+
+// Whether the triangles in entries s[0], s[1], s[2] and s[0], s[2], s[3] can
+// be drawn as one DRAW_QUAD
+static int mesh_quad_ok(const uint8_t s[4]) {
+	uint8_t out_or = slot_out[s[0]] | slot_out[s[1]] | slot_out[s[2]] | slot_out[s[3]];
+	uint8_t out_and1 = slot_out[s[0]] & slot_out[s[1]] & slot_out[s[2]];
+	uint8_t out_and2 = slot_out[s[0]] & slot_out[s[2]] & slot_out[s[3]];
+	if ((out_or & OUT_BAD_W) || ((out_and1 | out_and2) & ~OUT_BAD_W))
+		return 0;
+	return slot_area(s[0], s[1], s[2]) > 0 && slot_area(s[1], s[2], s[3]) > 0 &&
+			slot_area(s[2], s[3], s[0]) > 0 && slot_area(s[3], s[0], s[1]) > 0;
+}
+
+void draw_mesh(const float proj_view_mat[16]) {
+	// Every entry is stale once the camera has moved
+	for (int s = 0; s < VTX_TABLE_ENTRIES; s++)
+		slot_vertex[s] = -1;
+	const MeshObject *objects = mesh_objects(mesh);
+	const MeshTriangle *triangles = mesh_triangles(mesh);
+	for (u32 o = 0; o < mesh->object_count; o++) {
+		const MeshObject *obj = &objects[o];
+
+		// Vertices are 8 bit positions in the object's box, so fold the
+		// dequantization into the matrix
+		const float model_mat[16] = {obj->scale[0], 0.0f, 0.0f, obj->offset[0],
+									 0.0f, obj->scale[1], 0.0f, obj->offset[1],
+									 0.0f, 0.0f, obj->scale[2], obj->offset[2],
+									 0.0f, 0.0f, 0.0f, 1.0f};
+		float mvp[16];
+		PROF_START(PROF_CULL);
+		matmul4x4(proj_view_mat, model_mat, mvp);
+
+		// Skip the object if its bounds are all outside one frustum plane
+		uint8_t all_out = 0xFF;
+		for (int c = 0; c < 8; c++) {
+			float corner[4] = {(c & 1) ? obj->bounds_max[0] : obj->bounds_min[0],
+							   (c & 2) ? obj->bounds_max[1] : obj->bounds_min[1],
+							   (c & 4) ? obj->bounds_max[2] : obj->bounds_min[2], 1.0f};
+			float vec[4];
+			matvec4x1(proj_view_mat, corner, vec);
+			all_out &= outcode(vec);
+		}
+		PROF_STOP(PROF_CULL);
+		if (all_out & ~OUT_BAD_W)
+			continue;
+
+		for (u32 t = 0; t < obj->triangle_count; t++) {
+			const MeshTriangle *tri = &triangles[obj->first_triangle + t];
+			int32_t v[4];
+			uint8_t s[4];
+			int n = 3;
+			for (int j = 0; j < 3; j++)
+				v[j] = obj->first_vertex + tri->v[j];
+			// The second half of a quad is (a, c, d)
+			if ((tri->flags & MESH_TRI_QUAD) && t + 1 < obj->triangle_count) {
+				v[3] = obj->first_vertex + tri[1].v[2];
+				n = 4;
+			}
+			// A flush for the last vertex can let its load reuse the entry of
+			// an earlier one, so look again until all of them are in
+			int resident;
+			do {
+				for (int j = 0; j < n; j++)
+					s[j] = mesh_vertex(v[j], mvp);
+				resident = 1;
+				for (int j = 0; j < n; j++)
+					resident &= slot_vertex[s[j]] == v[j];
+			} while (!resident);
+
+			if (n == 4 && mesh_quad_ok(s)) {
+				PROF_START(PROF_PACK);
+				hdmi_cmd_draw_quad(&batch_draws[batch_draw_count++], s[0], s[1], s[2], s[3], tri->color,
+						slot_r_area(s[0], s[1], s[2]));
+				PROF_STOP(PROF_PACK);
+				t++;
+				if (batch_draw_count == MESH_BATCH) {
+					PROF_START(PROF_SUBMIT);
+					mesh_flush();
+					PROF_STOP(PROF_SUBMIT);
+				}
+				continue;
+			}
+
+			PROF_START(PROF_CULL);
+			uint8_t out_and = slot_out[s[0]] & slot_out[s[1]] & slot_out[s[2]];
+			uint8_t out_or = slot_out[s[0]] | slot_out[s[1]] | slot_out[s[2]];
+			PROF_STOP(PROF_CULL);
+			if ((out_and & ~OUT_BAD_W) || (out_or & OUT_BAD_W))
+				continue;
+
+			PROF_START(PROF_PACK);
+			hdmi_cmd_draw_indexed(&batch_draws[batch_draw_count++], s[0], s[1], s[2], tri->color,
+					slot_r_area(s[0], s[1], s[2]));
+			PROF_STOP(PROF_PACK);
+
+			if (batch_draw_count == MESH_BATCH) {
+				PROF_START(PROF_SUBMIT);
+				mesh_flush();
+				PROF_STOP(PROF_SUBMIT);
+			}
+		}
+	}
+	PROF_START(PROF_SUBMIT);
+	mesh_flush();
+	PROF_STOP(PROF_SUBMIT);
+}
+#endif
+
 int main() {
 	init_platform();
+	PROF_INIT();
 //	BYTE rcode;
 //	BOOT_MOUSE_REPORT buf;		//USB mouse report
 //	BOOT_KBD_REPORT kbdbuf;
@@ -116,9 +528,38 @@ int main() {
 //	USB_init();
 
 	//xil_printf("Entering main");
+#ifdef HDMI_USE_AXI_DMA
+	if (dma_init() != XST_SUCCESS)
+		xil_printf("AXI DMA init failed\n");
+	int frame_buf = 0;
+#endif
+#ifdef HDMI_MESH
+	if (!mesh_valid(mesh))
+		xil_printf("HDMI_MESH is not a version %d mesh, rebuild it with meshc\n", MESH_FORMAT_VERSION);
+#endif
+#ifdef HDMI_USE_RING
+	// Frames end with a SWAP command, so only flip when a frame is complete.
+	// Every frame is new, so the display side can clear the color buffer as it goes.
+	u32 ctrl = HDMI_CTRL_MANUAL_SWAP | HDMI_CTRL_SCANOUT_CLEAR;
+#ifdef HDMI_TRACE
+	ctrl |= HDMI_CTRL_TRACE;
+#endif
+	HDMI_TEXT_CONTROLLER_mWriteReg(HDMI_BASE, HDMI_REG_CTRL, ctrl);
+#endif
 	float cam_x = 127.5f, cam_y = 127.5f, cam_z = -50.0f;
 	float yaw = 0.0f; // in radians
+#ifdef HDMI_SCENE
+	int scene_frame = 0;
+#endif
 	while(1)  {
+#ifdef HDMI_SCENE
+		const float *cam = scene_camera_path[scene_frame];
+		if (++scene_frame == scene_camera_frames) scene_frame = 0;
+		cam_x = cam[0];
+		cam_y = cam[1];
+		cam_z = cam[2];
+		yaw = cam[3];
+#else
 //		if (cam_z >= 255.0f || cam_z <= -20.0f) dir *= -1;
 //		cam_z += dir;
 		cam_x = (r * cos_lookup(theta));
@@ -127,12 +568,14 @@ int main() {
 		theta += 0.001f;
 		if (yaw >= (3.1415f) / 12 || yaw <= -3.1415f / 12) dir *= -1;
 		yaw += dir;
+#endif
 
 		//Calculate Project @ View
 		// One matmul and then one matvec mutiply per vertice
 //		xil_printf("Top of loop \n");
 		// ===== VIEW MATRIX =====
 		// View = Translate(-camera_pos) × RotateY(yaw)
+		PROF_START(PROF_VIEW_PROJ);
 		float sin_yaw = sin_lookup(yaw);
 		float cos_yaw = cos_lookup(yaw);
 
@@ -172,17 +615,29 @@ int main() {
 
 		float proj_view_mat[16];
 		matmul4x4(proj_mat, view_mat, proj_view_mat);
-		for (int i = 0; i < cornell_box_triangle_count; i++) {
+		PROF_STOP(PROF_VIEW_PROJ);
+#ifdef HDMI_USE_AXI_DMA
+		int frame_tris = 0;
+#endif
+#ifdef HDMI_USE_RING
+		// Stay at most one frame ahead of the screen: frame N+1 can be queued
+		// while frame N draws, but not N+2
+		while ((int32_t)(frame_count - HDMI_TEXT_CONTROLLER_mReadReg(HDMI_BASE, HDMI_REG_FRAME_TAG)) > 1);
+#endif
+#ifdef HDMI_MESH
+		draw_mesh(proj_view_mat);
+#else
+		for (int i = 0; i < MESH_TRIANGLE_COUNT; i++) {
 			DATA data;
 
-			float world_vec1[4] = {(float)cornell_box[i][0], (float)cornell_box[i][1],
-								 (float)cornell_box[i][2], 1.0f};
+			float world_vec1[4] = {(float)MESH[i][0], (float)MESH[i][1],
+								 (float)MESH[i][2], 1.0f};
 
-			float world_vec2[4] = {(float)cornell_box[i][3], (float)cornell_box[i][4],
-								 (float)cornell_box[i][5], 1.0f};
+			float world_vec2[4] = {(float)MESH[i][3], (float)MESH[i][4],
+								 (float)MESH[i][5], 1.0f};
 
-			float world_vec3[4] = {(float)cornell_box[i][6], (float)cornell_box[i][7],
-								 (float)cornell_box[i][8], 1.0f};
+			float world_vec3[4] = {(float)MESH[i][6], (float)MESH[i][7],
+								 (float)MESH[i][8], 1.0f};
 			// Backface Culling
 			// Calculate two edges
 //			float edge1[3] = {world_vec2[0] - world_vec1[0],
@@ -213,10 +668,13 @@ int main() {
 			float vec1[4], vec2[4], vec3[4];
 
 			// Transforms to clip space (before perspective divide)
+			PROF_START(PROF_TRANSFORM);
 			matvec4x1(proj_view_mat, world_vec1, vec1);
 			matvec4x1(proj_view_mat, world_vec2, vec2);
 			matvec4x1(proj_view_mat, world_vec3, vec3);
+			PROF_STOP(PROF_TRANSFORM);
 
+			PROF_START(PROF_CULL);
 			// Test if ALL vertices are outside the SAME frustum plane
 			int8_t all_left =
 			  (vec1[0] < -vec1[3] && vec2[0] < -vec2[3] && vec3[0] < -vec3[3]);
@@ -232,13 +690,20 @@ int main() {
 			  (vec1[2] > vec1[3] && vec2[2] > vec2[3] && vec3[2] > vec3[3]);
 
 			// Cull this triangle - completely outside frustum
-			if (all_left || all_right || all_bottom || all_top || all_near || all_far)
+			if (all_left || all_right || all_bottom || all_top || all_near || all_far) {
+				PROF_STOP(PROF_CULL);
 				continue;
+			}
 
 			// Check for degenerate w
-			if (vec1[3] <= 0.0001f || vec2[3] <= 0.0001f || vec3[3] <= 0.0001f)
+			if (vec1[3] <= 0.0001f || vec2[3] <= 0.0001f || vec3[3] <= 0.0001f) {
+				PROF_STOP(PROF_CULL);
 				continue;
-			data.color = cornell_box[i][9];
+			}
+			PROF_STOP(PROF_CULL);
+
+			PROF_START(PROF_TRANSFORM);
+			data.color = MESH[i][9];
 			float *vecs[3] = {vec1, vec2, vec3};
 			uint32_t x[3], y[3];
 			for (int j = 0; j < 3; j++) {
@@ -247,19 +712,22 @@ int main() {
 				vecs[j][1] /= vecs[j][3];
 				vecs[j][2] /= vecs[j][3];
 
-				x[j] = (uint32_t) ((vecs[j][0] + 1.0f) * 160.0f);
-				y[j] = (uint32_t) ((1.0f - vecs[j][1]) * 120.0f);
+				x[j] = (uint32_t) ((vecs[j][0] + 1.0f) * viewport_x);
+				y[j] = (uint32_t) ((1.0f - vecs[j][1]) * viewport_y);
 
 				data.vertices[3 * j] = x[j];
 				data.vertices[3 * j + 1] = y[j];
 				data.vertices[3 * j + 2] = (uint16_t) (vecs[j][2] * 255.0f);
 			}
+			PROF_STOP(PROF_TRANSFORM);
 
+			PROF_START(PROF_PACK);
 			float r_area = 2.0f / (x[0] * (y[1] - y[2]) + x[1] * (y[2] - y[0]) + x[2] * (y[0] - y[1]));
 			if (r_area < 0) r_area *= -1;
 
 			// Turn into 8.24 fixed point
 			data.r_area = (int32_t) (r_area * (1 << 24));
+			PROF_STOP(PROF_PACK);
 
 //			xil_printf("Start\n");
 //			xil_printf("%d\n",(data.vertices[1] << 16) | data.vertices[0]);
@@ -278,26 +746,74 @@ int main() {
 //			addr[5] = data.r_area;
 
 
-		  typedef struct {
-			  uint32_t v0v1;      // Maps to lower 16 bits of addr[0]
-			  uint32_t v2v3;      // Maps to lower 16 bits of addr[1]
-			  uint32_t v4v5;      // Maps to upper 16 bits of addr[1]
-			  uint32_t v6v7;      // Maps to lower 16 bits of addr[2]
-			  uint32_t v8color;      // Maps to upper 16 bits of addr[3]
-			  int32_t  r_area;  // Maps to addr[5]
-//			  uint32_t done;
-		  } TrianglePacket;
-
+			PROF_START(PROF_SUBMIT);
+#if defined(HDMI_USE_AXI_DMA)
+			  if (frame_tris == MAX_FRAME_TRIANGLES) {
+				  PROF_STOP(PROF_SUBMIT);
+				  break;
+			  }
+			  TrianglePacket *pkt = &frame_pkts[frame_buf][frame_tris++];
+#elif defined(HDMI_USE_RING)
+			  TrianglePacket ring_pkt;
+			  TrianglePacket *pkt = &ring_pkt;
+#else
 			  static volatile TrianglePacket *pkt = (TrianglePacket*)XPAR_HDMI_TEXT_CONTROLLER_0_AXI_BASEADDR;
+#endif
 
-			  pkt->v0v1 = (data.vertices[1] << 16) | data.vertices[0];
-			  pkt->v2v3 = (data.vertices[3] << 16) | data.vertices[2];
-			  pkt->v4v5 = (data.vertices[5] << 16) | data.vertices[4];
+			  // Triangles that continue a strip or fan only send their new vertex
+			  int op = HDMI_OP_DRAW_TRI;
+#ifndef HDMI_USE_LITE_REGS
+			  op = strip_or_fan(&data);
+#endif
+			  if (op == HDMI_OP_DRAW_TRI) {
+				  pkt->v0v1 = (data.vertices[1] << 16) | data.vertices[0];
+				  pkt->v2v3 = (data.vertices[3] << 16) | data.vertices[2];
+				  pkt->v4v5 = (data.vertices[5] << 16) | data.vertices[4];
+			  }
 			  pkt->v6v7 = (data.vertices[7] << 16) | data.vertices[6];
-			  pkt->v8color = (data.color << 16) | data.vertices[8];
+			  pkt->v8color = (op << HDMI_OP_SHIFT) | (data.color << 16) | data.vertices[8];
 			  pkt->r_area = data.r_area;
 //			  pkt->done = 0xFFFFFFFF;
+#ifdef HDMI_USE_RING
+			  ring_push_words(pkt, op == HDMI_OP_DRAW_TRI ? 0 : HDMI_VERTEX_CMD_FIRST_WORD);
+#endif
+			PROF_STOP(PROF_SUBMIT);
 		}
+#endif
+		PROF_START(PROF_SUBMIT);
+#if defined(HDMI_USE_AXI_DMA)
+		dma_submit(frame_pkts[frame_buf], frame_tris);
+		frame_buf ^= 1;
+#elif defined(HDMI_USE_RING)
+		// Drop to 160x120 while the rasterizer is more than a frame behind us, and
+		// go back up once it has kept up for a second. The SWAP carries the
+		// resolution of the next frame, which is the first one built for it.
+		static int idle_frames = 0;
+		int next_res = render_res;
+		u32 behind = frame_count - HDMI_TEXT_CONTROLLER_mReadReg(HDMI_BASE, HDMI_REG_FENCE);
+		if (behind != 0)
+			idle_frames = 0;
+		if (behind > 1)
+			next_res = HDMI_RES_160x120;
+		else if (behind == 0 && render_res != HDMI_RES_320x240 && ++idle_frames >= 60)
+			next_res = HDMI_RES_320x240;
+		// Mark the end of the frame, and show it once it has been drawn
+		TrianglePacket end_pkt;
+		frame_count++;
+		hdmi_cmd_fence(&end_pkt, frame_count);
+		ring_push(&end_pkt);
+		hdmi_cmd_swap_res(&end_pkt, frame_count, next_res);
+		ring_push(&end_pkt);
+		ring_doorbell();
+		if (next_res != render_res)
+			set_render_res(next_res);
+#ifdef HDMI_TRACE
+		if (frame_count % HDMI_TRACE_FRAMES == 0)
+			trace_dump_csv();
+#endif
+#endif
+		PROF_STOP(PROF_SUBMIT);
+		PROF_FRAME_END();
 	}
 	cleanup_platform();
 	return 0;
@@ -2,9 +2,11 @@
 #define HDMI_TEXT_CONTROLLER_H
 
 /****************** Include Files ********************/
+#include "xil_io.h"
 #include "xil_types.h"
 #include "xparameters.h"
 #include "xstatus.h"
+#include "sin_lut.h"
 
 typedef struct __attribute__((packed)) {
   uint16_t vertices[9];
@@ -12,6 +14,196 @@ typedef struct __attribute__((packed)) {
   int32_t r_area;
 } DATA;
 
+// One triangle as the hardware sees it, 6 words written to registers 0-5
+// (or streamed in this order through the AXI4-Stream port).
+typedef struct {
+  uint32_t v0v1;    // Maps to lower 16 bits of addr[0]
+  uint32_t v2v3;    // Maps to lower 16 bits of addr[1]
+  uint32_t v4v5;    // Maps to upper 16 bits of addr[1]
+  uint32_t v6v7;    // Maps to lower 16 bits of addr[2]
+  uint32_t v8color; // Maps to upper 16 bits of addr[3]
+  int32_t r_area;   // Maps to addr[5]
+} TrianglePacket;
+
+// Command opcodes, in the top byte of v8color. Plain triangle packets leave it
+// at 0, which is DRAW_TRI.
+#define HDMI_OP_SHIFT 24
+#define HDMI_OP_DRAW_TRI 0x00
+#define HDMI_OP_LOAD_VERTS 0x01
+#define HDMI_OP_DRAW_INDEXED 0x02
+#define HDMI_OP_CLEAR 0x03
+#define HDMI_OP_SET_SCISSOR 0x04
+#define HDMI_OP_SWAP 0x05
+#define HDMI_OP_FENCE 0x06
+#define HDMI_OP_STRIP 0x07
+#define HDMI_OP_FAN 0x08
+#define HDMI_OP_DRAW_QUAD 0x09
+
+// CLEAR flags
+#define HDMI_CLEAR_COLOR 0x1
+#define HDMI_CLEAR_DEPTH 0x2
+
+// Fills the packet with a CLEAR of the inclusive rectangle (x0,y0)-(x1,y1).
+static inline void hdmi_cmd_clear(TrianglePacket *p, uint32_t x0, uint32_t y0,
+                                  uint32_t x1, uint32_t y1, uint8_t color,
+                                  uint8_t depth, uint32_t flags) {
+  p->v0v1 = (y0 << 16) | x0;
+  p->v2v3 = depth;
+  p->v4v5 = 0;
+  p->v6v7 = (y1 << 16) | x1;
+  p->v8color = (HDMI_OP_CLEAR << HDMI_OP_SHIFT) | (color << 16) | flags;
+  p->r_area = 0;
+}
+
+// Only pixels inside the inclusive rectangle (x0,y0)-(x1,y1) are drawn after
+// this. The default is the whole screen.
+static inline void hdmi_cmd_scissor(TrianglePacket *p, uint32_t x0,
+                                    uint32_t y0, uint32_t x1, uint32_t y1) {
+  hdmi_cmd_clear(p, x0, y0, x1, y1, 0, 0, 0);
+  p->v8color = HDMI_OP_SET_SCISSOR << HDMI_OP_SHIFT;
+}
+
+// Stores the 3 vertices of the packet (same layout as a triangle) at vertex
+// table entries base, base + 1 and base + 2.
+static inline void hdmi_cmd_load_verts(TrianglePacket *p, uint8_t base) {
+  p->v8color = (HDMI_OP_LOAD_VERTS << HDMI_OP_SHIFT) | (p->v8color & 0xFFFF);
+  p->r_area = base;
+}
+
+// Draws the triangle made of vertex table entries i1, i2, i3.
+static inline void hdmi_cmd_draw_indexed(TrianglePacket *p, uint8_t i1,
+                                         uint8_t i2, uint8_t i3, uint8_t color,
+                                         int32_t r_area) {
+  p->v0v1 = (i3 << 16) | (i2 << 8) | i1;
+  p->v2v3 = 0;
+  p->v4v5 = 0;
+  p->v6v7 = 0;
+  p->v8color = (HDMI_OP_DRAW_INDEXED << HDMI_OP_SHIFT) | (color << 16);
+  p->r_area = r_area;
+}
+
+// Draws the quad made of vertex table entries i1, i2, i3, i4 in one pass. It
+// has to be convex and planar with the same winding as a triangle, r_area is
+// that of the triangle i1, i2, i3 and the depth comes from its plane.
+static inline void hdmi_cmd_draw_quad(TrianglePacket *p, uint8_t i1,
+                                      uint8_t i2, uint8_t i3, uint8_t i4,
+                                      uint8_t color, int32_t r_area) {
+  hdmi_cmd_draw_indexed(p, i1, i2, i3, color, r_area);
+  p->v0v1 |= (uint32_t)i4 << 24;
+  p->v8color = (HDMI_OP_DRAW_QUAD << HDMI_OP_SHIFT) | (color << 16);
+}
+
+// SWAP asks for the buffers to flip once everything before it has been drawn,
+// and holds later commands until they have. tag shows up in HDMI_REG_FRAME_TAG
+// once the frame is on screen. FENCE writes value to the FENCE register once
+// everything before it has been drawn.
+static inline void hdmi_cmd_swap(TrianglePacket *p, uint32_t tag) {
+  hdmi_cmd_clear(p, 0, 0, 0, 0, 0, 0, 0);
+  p->v8color = HDMI_OP_SWAP << HDMI_OP_SHIFT;
+  p->r_area = tag;
+}
+
+// SWAP that also sets the render resolution (HDMI_RES_*) of the frame after it.
+// The IP switches when this swap's buffer flip clears the next draw buffer, so
+// the frames built after this one are the ones drawn at the new size.
+#define HDMI_SWAP_SET_RES 0x2
+static inline void hdmi_cmd_swap_res(TrianglePacket *p, uint32_t tag, int res) {
+  hdmi_cmd_swap(p, tag);
+  p->v8color |= HDMI_SWAP_SET_RES | (res & 1);
+}
+
+static inline void hdmi_cmd_fence(TrianglePacket *p, uint32_t value) {
+  hdmi_cmd_clear(p, 0, 0, 0, 0, 0, 0, 0);
+  p->v8color = HDMI_OP_FENCE << HDMI_OP_SHIFT;
+  p->r_area = value;
+}
+
+// STRIP and FAN draw a triangle from two vertices the IP kept from the last
+// triangle and the new vertex (x, y, z) given here. A triangle drawn as v1, v2,
+// v3 keeps v1 as the fan center and v2, v3 as the last two. STRIP draws the
+// last two and the new vertex (swapping the two on every other STRIP, so the
+// strip keeps the first triangle's winding), FAN draws the center, the last
+// vertex and the new one. The new vertex, color and r_area go in words 3 to 5
+// like v3 of a triangle packet, and only those words need to be written.
+#define HDMI_VERTEX_CMD_FIRST_WORD 3
+
+// Packets are queued in the command ring by default. Define HDMI_USE_AXI_DMA
+// to send each frame's packets through an AXI DMA into the AXI4-Stream port
+// instead, or HDMI_USE_LITE_REGS for the old staging registers (which drop
+// packets when the hardware FIFO is full).
+#if !defined(HDMI_USE_AXI_DMA) && !defined(HDMI_USE_LITE_REGS)
+#define HDMI_USE_RING
+#endif
+
+// Each DMA packet buffer holds at most this many triangles.
+#define MAX_FRAME_TRIANGLES 256
+
+// Register offsets from XPAR_HDMI_TEXT_CONTROLLER_0_AXI_BASEADDR
+#define HDMI_REG_RING_HEAD (6 * 4) // doorbell, number of slots filled
+#define HDMI_REG_RING_TAIL (7 * 4) // read only, number of slots consumed
+#define HDMI_REG_CTRL (8 * 4)
+#define HDMI_REG_STATUS (9 * 4)      // read only
+#define HDMI_REG_FENCE (10 * 4)      // read only, value of the last FENCE reached
+#define HDMI_REG_SWAP_REQ (11 * 4)   // swap once drained, data is the frame tag
+#define HDMI_REG_FRAME_TAG (12 * 4)  // read only, tag of the frame on screen
+#define HDMI_REG_CLEAR_COLOR (13 * 4) // color of tiles not drawn to this frame
+#define HDMI_REG_RENDER_RES (14 * 4)  // HDMI_RES_*, used from the next frame on (or hdmi_cmd_swap_res)
+#define HDMI_REG_TRACE_COUNT (15 * 4) // trace entries written, write to restart
+#define HDMI_REG_PERF_CTRL (16 * 4)   // HDMI_PERF_*
+
+// Performance counters, read only. Reads return the values at the last
+// HDMI_PERF_SNAPSHOT.
+#define HDMI_REG_PERF_CYC_CLEAR_BUF (17 * 4) // cycles per controller state
+#define HDMI_REG_PERF_CYC_WAIT_TRI (18 * 4)
+#define HDMI_REG_PERF_CYC_CALC_EDGE (19 * 4)
+#define HDMI_REG_PERF_CYC_RASTERIZE (20 * 4)
+#define HDMI_REG_PERF_CYC_OTHER (21 * 4)
+#define HDMI_REG_PERF_TRI_ACCEPTED (22 * 4) // draw commands pushed into the FIFO
+#define HDMI_REG_PERF_TRI_DROPPED (23 * 4)
+#define HDMI_REG_PERF_PIX_VISITED (24 * 4)  // bounding box pixels stepped over
+#define HDMI_REG_PERF_PIX_INSIDE (25 * 4)
+#define HDMI_REG_PERF_PIX_ZPASS (26 * 4)
+#define HDMI_REG_PERF_PIX_ZFAIL (27 * 4)
+#define HDMI_REG_PERF_FIFO_HWM (28 * 4)     // most packets queued at once
+#define HDMI_REG_PERF_FRAME_CYCLES (29 * 4) // length of the last frame
+#define HDMI_REG_PERF_CYCLES_LO (30 * 4)
+#define HDMI_REG_PERF_CYCLES_HI (31 * 4)
+
+// HDMI_REG_RENDER_RES values
+#define HDMI_RES_320x240 0
+#define HDMI_RES_160x120 1
+
+// HDMI_REG_CTRL bits
+#define HDMI_CTRL_MANUAL_SWAP 0x1 // only flip buffers when a swap is requested
+#define HDMI_CTRL_SCANOUT_CLEAR 0x2 // clear the color buffer as it is displayed
+#define HDMI_CTRL_TRACE 0x4 // record a trace entry per triangle (TRACE_ENABLE)
+
+// HDMI_REG_PERF_CTRL bits, write both to snapshot and start a new interval
+#define HDMI_PERF_SNAPSHOT 0x1
+#define HDMI_PERF_RESET 0x2
+
+// HDMI_REG_STATUS bits
+#define HDMI_STATUS_FRONT 0x1
+#define HDMI_STATUS_SWAP_PENDING 0x2
+#define HDMI_STATUS_DRAINED 0x4
+
+// Command ring. Slot n holds a TrianglePacket at
+// HDMI_RING_OFFSET + (n % HDMI_RING_SLOTS) * HDMI_RING_SLOT_BYTES.
+#define HDMI_RING_OFFSET 0x2000
+#define HDMI_RING_SLOTS 256
+#define HDMI_RING_SLOT_BYTES 32
+
+// Triangle trace, only there when the IP is built with TRACE_ENABLE. Entry n
+// is at HDMI_TRACE_OFFSET + (n % HDMI_TRACE_ENTRIES) * HDMI_TRACE_ENTRY_BYTES.
+// Word 0: cycle count when the command left the FIFO
+// Word 1: [31:20] frame, [16] culled, [17] cut off by a flip, [18] indexed,
+//         [19] DRAW_QUAD, [15:0] setup cycles
+// Word 2: rasterizer cycles
+// Word 3: [31:16] pixels written, [15:0] pixels visited
+#define HDMI_TRACE_OFFSET 0x1000
+#define HDMI_TRACE_ENTRIES 256
+#define HDMI_TRACE_ENTRY_BYTES 16
+
 // TODO: SET THIS LATER
 // volatile bool *vsync;
 
@@ -123,81 +315,6 @@ static const uint8_t cornell_box[][10] = {
 static const int cornell_box_triangle_count =
     sizeof(cornell_box) / sizeof(cornell_box[0]);
 
-// Sin lookup table generated by AI
-static const float sin_lut[256] = {
-    0.000000f,  0.024541f,  0.049068f,  0.073565f,  0.098017f,  0.122411f,
-    0.146730f,  0.170962f,  0.195090f,  0.219101f,  0.242980f,  0.266713f,
-    0.290285f,  0.313682f,  0.336890f,  0.359895f,  0.382683f,  0.405241f,
-    0.427555f,  0.449611f,  0.471397f,  0.492898f,  0.514103f,  0.534998f,
-    0.555570f,  0.575808f,  0.595699f,  0.615232f,  0.634393f,  0.653173f,
-    0.671559f,  0.689541f,  0.707107f,  0.724247f,  0.740951f,  0.757209f,
-    0.773010f,  0.788346f,  0.803208f,  0.817585f,  0.831470f,  0.844854f,
-    0.857729f,  0.870087f,  0.881921f,  0.893224f,  0.903989f,  0.914210f,
-    0.923880f,  0.932993f,  0.941544f,  0.949528f,  0.956940f,  0.963776f,
-    0.970031f,  0.975702f,  0.980785f,  0.985278f,  0.989177f,  0.992480f,
-    0.995185f,  0.997290f,  0.998795f,  0.999699f,  1.000000f,  0.999699f,
-    0.998795f,  0.997290f,  0.995185f,  0.992480f,  0.989177f,  0.985278f,
-    0.980785f,  0.975702f,  0.970031f,  0.963776f,  0.956940f,  0.949528f,
-    0.941544f,  0.932993f,  0.923880f,  0.914210f,  0.903989f,  0.893224f,
-    0.881921f,  0.870087f,  0.857729f,  0.844854f,  0.831470f,  0.817585f,
-    0.803208f,  0.788346f,  0.773010f,  0.757209f,  0.740951f,  0.724247f,
-    0.707107f,  0.689541f,  0.671559f,  0.653173f,  0.634393f,  0.615232f,
-    0.595699f,  0.575808f,  0.555570f,  0.534998f,  0.514103f,  0.492898f,
-    0.471397f,  0.449611f,  0.427555f,  0.405241f,  0.382683f,  0.359895f,
-    0.336890f,  0.313682f,  0.290285f,  0.266713f,  0.242980f,  0.219101f,
-    0.195090f,  0.170962f,  0.146730f,  0.122411f,  0.098017f,  0.073565f,
-    0.049068f,  0.024541f,  0.000000f,  -0.024541f, -0.049068f, -0.073565f,
-    -0.098017f, -0.122411f, -0.146730f, -0.170962f, -0.195090f, -0.219101f,
-    -0.242980f, -0.266713f, -0.290285f, -0.313682f, -0.336890f, -0.359895f,
-    -0.382683f, -0.405241f, -0.427555f, -0.449611f, -0.471397f, -0.492898f,
-    -0.514103f, -0.534998f, -0.555570f, -0.575808f, -0.595699f, -0.615232f,
-    -0.634393f, -0.653173f, -0.671559f, -0.689541f, -0.707107f, -0.724247f,
-    -0.740951f, -0.757209f, -0.773010f, -0.788346f, -0.803208f, -0.817585f,
-    -0.831470f, -0.844854f, -0.857729f, -0.870087f, -0.881921f, -0.893224f,
-    -0.903989f, -0.914210f, -0.923880f, -0.932993f, -0.941544f, -0.949528f,
-    -0.956940f, -0.963776f, -0.970031f, -0.975702f, -0.980785f, -0.985278f,
-    -0.989177f, -0.992480f, -0.995185f, -0.997290f, -0.998795f, -0.999699f,
-    -1.000000f, -0.999699f, -0.998795f, -0.997290f, -0.995185f, -0.992480f,
-    -0.989177f, -0.985278f, -0.980785f, -0.975702f, -0.970031f, -0.963776f,
-    -0.956940f, -0.949528f, -0.941544f, -0.932993f, -0.923880f, -0.914210f,
-    -0.903989f, -0.893224f, -0.881921f, -0.870087f, -0.857729f, -0.844854f,
-    -0.831470f, -0.817585f, -0.803208f, -0.788346f, -0.773010f, -0.757209f,
-    -0.740951f, -0.724247f, -0.707107f, -0.689541f, -0.671559f, -0.653173f,
-    -0.634393f, -0.615232f, -0.595699f, -0.575808f, -0.555570f, -0.534998f,
-    -0.514103f, -0.492898f, -0.471397f, -0.449611f, -0.427555f, -0.405241f,
-    -0.382683f, -0.359895f, -0.336890f, -0.313682f, -0.290285f, -0.266713f,
-    -0.242980f, -0.219101f, -0.195090f, -0.170962f, -0.146730f, -0.122411f,
-    -0.098017f, -0.073565f, -0.049068f, -0.024541f
-
-};
-
-#define LUT_SIZE 256
-#define LUT_SIZE_F 256.0f
-
-// Fast sin approximation with linear interpolation
-// Generated by AI
-float sin_lookup(float radians) {
-  // Normalize to [0, 2π)
-  while (radians < 0.0f)
-    radians += 6.283185f;
-  while (radians >= 6.283185f)
-    radians -= 6.283185f;
-
-  // Map to table index (floating point)
-  float index_f = (radians / 6.283185f) * LUT_SIZE_F;
-  uint32_t index0 = (uint32_t)index_f;
-  uint32_t index1 = (index0 + 1) & (LUT_SIZE - 1); // Wrap around
-
-  // Linear interpolation
-  float frac = index_f - (float)index0;
-  return sin_lut[index0] + frac * (sin_lut[index1] - sin_lut[index0]);
-}
-
-float cos_lookup(float radians) {
-  // cos(x) = sin(x + π/2)
-  return sin_lookup(radians + 1.570796f);
-}
-
 /**************************** Type Definitions *****************************/
 /**
  *
@@ -237,8 +354,8 @@ float cos_lookup(float radians) {
  * 	u32 HDMI_TEXT_CONTROLLER_mReadReg(u32 BaseAddress, unsigned RegOffset)
  *
  */
-//#define HDMI_TEXT_CONTROLLER_mReadReg(BaseAddress, RegOffset) \
-//    Xil_In32((BaseAddress) + (RegOffset))
+#define HDMI_TEXT_CONTROLLER_mReadReg(BaseAddress, RegOffset)                 \
+  Xil_In32((BaseAddress) + (RegOffset))
 
 /************************** Function Prototypes ****************************/
 /**
@@ -0,0 +1,80 @@
+#ifndef MESH_FORMAT_H
+#define MESH_FORMAT_H
+
+// Compiled mesh format written by meshc.c. The same bytes come either as a
+// .bin file or as the mesh_data array of a generated header, and are read in
+// place: every table is at a byte offset from the MeshHeader, 4 byte aligned,
+// little endian, so a pointer to the start is all the firmware needs.
+//
+//   MeshHeader
+//   MeshObject   objects[object_count]
+//   MeshVertex   vertices[vertex_count]     grouped by object
+//   MeshTriangle triangles[triangle_count]  grouped by object
+//
+// Vertices are quantized to 8 bits per axis within their object, world
+// position = offset + scale * q. Triangle indices are relative to the
+// object's first_vertex, in the order meshc picked for vertex reuse, and
+// vertices are numbered in order of first use. A triangle (a, b, c) flagged
+// MESH_TRI_QUAD is followed by (a, c, d) of the same color, and a, b, c, d is
+// a convex planar quad that can be drawn in one go. Readers that don't care
+// can draw the two as triangles.
+//
+// A change to any of these structs bumps MESH_FORMAT_VERSION.
+
+#include <stdint.h>
+
+#define MESH_MAGIC 0x4853454D // "MESH"
+#define MESH_FORMAT_VERSION 2
+
+// MeshTriangle flags
+#define MESH_TRI_QUAD 0x01
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t object_count;
+  uint32_t vertex_count;
+  uint32_t triangle_count;
+  uint32_t objects_offset; // byte offsets from the start of the header
+  uint32_t vertices_offset;
+  uint32_t triangles_offset;
+} MeshHeader;
+
+typedef struct {
+  float scale[3];
+  float offset[3];
+  float bounds_min[3]; // world space, of the quantized vertices
+  float bounds_max[3];
+  uint32_t first_vertex;
+  uint32_t vertex_count;
+  uint32_t first_triangle;
+  uint32_t triangle_count;
+} MeshObject;
+
+typedef struct {
+  uint8_t x, y, z, pad;
+} MeshVertex;
+
+typedef struct {
+  uint16_t v[3];
+  uint8_t color; // RRRGGGBB
+  uint8_t flags; // MESH_TRI_*
+} MeshTriangle;
+
+static inline int mesh_valid(const MeshHeader *m) {
+  return m->magic == MESH_MAGIC && m->version == MESH_FORMAT_VERSION;
+}
+
+static inline const MeshObject *mesh_objects(const MeshHeader *m) {
+  return (const MeshObject *)((const uint8_t *)m + m->objects_offset);
+}
+
+static inline const MeshVertex *mesh_vertices(const MeshHeader *m) {
+  return (const MeshVertex *)((const uint8_t *)m + m->vertices_offset);
+}
+
+static inline const MeshTriangle *mesh_triangles(const MeshHeader *m) {
+  return (const MeshTriangle *)((const uint8_t *)m + m->triangles_offset);
+}
+
+#endif
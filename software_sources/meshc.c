@@ -0,0 +1,698 @@
+// Offline mesh compiler. Reads a Wavefront OBJ and writes it in the format of
+// mesh_format.h, which the MicroBlaze build draws with -DHDMI_MESH.
+//
+//   gcc -O2 -o meshc meshc.c -lm
+//   ./meshc [-f] [-t] [-c cache] <model.obj>
+//
+//   -f        scale and move the whole model to fit the 0-255 world cube the
+//             Cornell box and the default camera orbit use
+//   -t        triangles only, don't pair triangles into quads
+//   -c cache  vertex cache size to order triangles for, 256 by default (the
+//             IP's vertex table, which main() uses as its cache)
+//
+// For each object (o or g in the OBJ) the vertices are quantized to 8 bits per
+// axis over the object's bounds and deduplicated, triangles that collapse are
+// dropped, and the rest are reordered with Tipsify (Sander, Nehab and Barczak,
+// "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw") for a
+// FIFO cache of the given size. Faces with more than 3 vertices become fans.
+// Then triangles that share an edge with a triangle just after them, have the
+// same color and make a convex planar quad with it are paired up and flagged
+// MESH_TRI_QUAD, so the firmware can draw the pair as one DRAW_QUAD.
+// Colors come from the Kd of the face's material (mtllib/usemtl), white
+// without one.
+//
+// Output: mesh_<model>.bin and mesh_<model>.h, the same bytes as a uint32_t
+// array called mesh_data. Statistics go to stdout.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mesh_format.h"
+
+#define MAX_OBJECTS 1024
+#define MAX_MATERIALS 256
+#define NAME_LEN 64
+
+typedef struct {
+    int p[3]; // position indices
+    uint8_t color;
+} InTri;
+
+typedef struct {
+    char name[NAME_LEN];
+    int first_tri, tri_count;
+} InObject;
+
+typedef struct {
+    char name[NAME_LEN];
+    uint8_t color;
+} Material;
+
+static float (*positions)[3];
+static int position_count, position_cap;
+static InTri *in_tris;
+static int in_tri_count, in_tri_cap;
+static InObject in_objects[MAX_OBJECTS];
+static int in_object_count;
+static Material materials[MAX_MATERIALS];
+static int material_count;
+
+// Compiled output, all objects
+static MeshObject objects[MAX_OBJECTS];
+static MeshVertex *vertices;
+static int vertex_count;
+static MeshTriangle *triangles;
+static int triangle_count;
+
+static int cache_size = 256;
+static int make_quads = 1;
+
+// How far ahead of a triangle to look for the other half of its quad. The
+// partner is moved up next to it, which Tipsify's order barely notices.
+#define QUAD_WINDOW 8
+
+static void *grow(void *p, int *cap, int need, size_t size) {
+    if (need <= *cap)
+        return p;
+    *cap = *cap ? *cap * 2 : 1024;
+    if (*cap < need)
+        *cap = need;
+    p = realloc(p, *cap * size);
+    if (!p) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+static uint8_t rgb332(float r, float g, float b) {
+    int ri = (int)(r * 7.0f + 0.5f), gi = (int)(g * 7.0f + 0.5f), bi = (int)(b * 3.0f + 0.5f);
+    ri = ri < 0 ? 0 : ri > 7 ? 7 : ri;
+    gi = gi < 0 ? 0 : gi > 7 ? 7 : gi;
+    bi = bi < 0 ? 0 : bi > 3 ? 3 : bi;
+    return (uint8_t)(ri << 5 | gi << 2 | bi);
+}
+
+// Strips the newline and any trailing spaces, and returns the text after the
+// keyword at the start of line
+static char *arg(char *line, const char *keyword) {
+    char *s = line + strlen(keyword);
+    while (*s == ' ' || *s == '\t')
+        s++;
+    char *e = s + strlen(s);
+    while (e > s && (e[-1] == '\n' || e[-1] == '\r' || e[-1] == ' ' || e[-1] == '\t'))
+        *--e = 0;
+    return s;
+}
+
+static int keyword(const char *line, const char *k) {
+    size_t n = strlen(k);
+    return strncmp(line, k, n) == 0 && (line[n] == ' ' || line[n] == '\t');
+}
+
+static void read_mtl(const char *obj_path, const char *name) {
+    char path[512];
+    const char *slash = strrchr(obj_path, '/');
+    int dir = slash ? (int)(slash - obj_path + 1) : 0;
+    snprintf(path, sizeof(path), "%.*s%s", dir, obj_path, name);
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Warning: can't open %s, faces will be white\n", path);
+        return;
+    }
+    char line[512];
+    Material *m = NULL;
+    while (fgets(line, sizeof(line), f)) {
+        if (keyword(line, "newmtl")) {
+            if (material_count == MAX_MATERIALS) {
+                fprintf(stderr, "Too many materials, the limit is %d\n", MAX_MATERIALS);
+                exit(1);
+            }
+            m = &materials[material_count++];
+            snprintf(m->name, sizeof(m->name), "%s", arg(line, "newmtl"));
+            m->color = 0xFF;
+        } else if (m && keyword(line, "Kd")) {
+            float r, g, b;
+            if (sscanf(arg(line, "Kd"), "%f %f %f", &r, &g, &b) == 3)
+                m->color = rgb332(r, g, b);
+        }
+    }
+    fclose(f);
+}
+
+static void begin_object(const char *name) {
+    // An object or group with no faces yet is just renamed
+    if (in_object_count > 0 && in_objects[in_object_count - 1].tri_count == 0) {
+        snprintf(in_objects[in_object_count - 1].name, NAME_LEN, "%s", name);
+        return;
+    }
+    if (in_object_count == MAX_OBJECTS) {
+        fprintf(stderr, "Too many objects, the limit is %d\n", MAX_OBJECTS);
+        exit(1);
+    }
+    InObject *o = &in_objects[in_object_count++];
+    snprintf(o->name, NAME_LEN, "%s", name);
+    o->first_tri = in_tri_count;
+    o->tri_count = 0;
+}
+
+// Position index of one f token (v, v/vt, v//vn or v/vt/vn), -1 if it's bad
+static int face_index(const char *tok) {
+    int i = atoi(tok);
+    if (i < 0)
+        i += position_count;
+    else
+        i -= 1;
+    return i >= 0 && i < position_count ? i : -1;
+}
+
+static void read_obj(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    char line[4096];
+    int line_no = 0;
+    uint8_t color = 0xFF;
+    begin_object("default");
+    while (fgets(line, sizeof(line), f)) {
+        line_no++;
+        if (keyword(line, "v")) {
+            position_count++;
+            positions = grow(positions, &position_cap, position_count, sizeof(*positions));
+            float *p = positions[position_count - 1];
+            if (sscanf(line + 2, "%f %f %f", &p[0], &p[1], &p[2]) != 3) {
+                fprintf(stderr, "%s:%d: bad vertex\n", path, line_no);
+                exit(1);
+            }
+        } else if (keyword(line, "f")) {
+            int idx[64], n = 0;
+            for (char *tok = strtok(line + 2, " \t\r\n"); tok && n < 64; tok = strtok(NULL, " \t\r\n")) {
+                idx[n] = face_index(tok);
+                if (idx[n] < 0) {
+                    fprintf(stderr, "%s:%d: bad face index %s\n", path, line_no, tok);
+                    exit(1);
+                }
+                n++;
+            }
+            for (int k = 2; k < n; k++) {
+                in_tri_count++;
+                in_tris = grow(in_tris, &in_tri_cap, in_tri_count, sizeof(*in_tris));
+                InTri *t = &in_tris[in_tri_count - 1];
+                t->p[0] = idx[0];
+                t->p[1] = idx[k - 1];
+                t->p[2] = idx[k];
+                t->color = color;
+                in_objects[in_object_count - 1].tri_count++;
+            }
+        } else if (keyword(line, "o") || keyword(line, "g")) {
+            begin_object(arg(line, line[0] == 'o' ? "o" : "g"));
+        } else if (keyword(line, "usemtl")) {
+            const char *name = arg(line, "usemtl");
+            color = 0xFF;
+            for (int m = 0; m < material_count; m++)
+                if (strcmp(materials[m].name, name) == 0)
+                    color = materials[m].color;
+        } else if (keyword(line, "mtllib")) {
+            read_mtl(path, arg(line, "mtllib"));
+        }
+    }
+    fclose(f);
+    if (in_objects[in_object_count - 1].tri_count == 0)
+        in_object_count--;
+}
+
+// Uniform scale and offset that center the model in the 0-255 cube
+static void fit(void) {
+    float lo[3] = {INFINITY, INFINITY, INFINITY}, hi[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (int i = 0; i < position_count; i++)
+        for (int a = 0; a < 3; a++) {
+            lo[a] = fminf(lo[a], positions[i][a]);
+            hi[a] = fmaxf(hi[a], positions[i][a]);
+        }
+    float extent = fmaxf(hi[0] - lo[0], fmaxf(hi[1] - lo[1], hi[2] - lo[2]));
+    float s = extent > 0.0f ? 255.0f / extent : 1.0f;
+    for (int i = 0; i < position_count; i++)
+        for (int a = 0; a < 3; a++)
+            positions[i][a] = (positions[i][a] - (lo[a] + hi[a]) * 0.5f) * s + 127.5f;
+}
+
+// Vertex cache misses per triangle (ACMR) of an index list through a FIFO
+// cache of cache_size entries. stamp is scratch, one int per vertex.
+static float acmr(const int *idx, int tris, int *stamp, int verts) {
+    int misses = 0;
+    for (int v = 0; v < verts; v++)
+        stamp[v] = -cache_size - 1;
+    for (int i = 0; i < 3 * tris; i++) {
+        if (misses - stamp[idx[i]] > cache_size) {
+            stamp[idx[i]] = misses;
+            misses++;
+        }
+    }
+    return tris ? (float)misses / tris : 0.0f;
+}
+
+// Tipsify. Writes the new order of the tris triangles in idx (3 indices each,
+// into verts vertices) to tri_order.
+static void tipsify(const int *idx, int tris, int verts, int *tri_order) {
+    // Triangles using each vertex
+    int *adj_start = calloc(verts + 1, sizeof(int));
+    int *adj = malloc(3 * tris * sizeof(int));
+    int *live = calloc(verts, sizeof(int));
+    int *stamp = malloc(verts * sizeof(int));
+    int *dead_end = malloc(3 * tris * sizeof(int));
+    int *candidates = malloc(3 * tris * sizeof(int));
+    uint8_t *emitted = calloc(tris, 1);
+    for (int i = 0; i < 3 * tris; i++)
+        live[idx[i]]++;
+    for (int v = 0; v < verts; v++)
+        adj_start[v + 1] = adj_start[v] + live[v];
+    int *fill = calloc(verts, sizeof(int));
+    for (int i = 0; i < 3 * tris; i++)
+        adj[adj_start[idx[i]] + fill[idx[i]]++] = i / 3;
+    free(fill);
+    for (int v = 0; v < verts; v++)
+        stamp[v] = -2 * cache_size - 1;
+
+    int time = 0, dead_count = 0, out_count = 0, cursor = 0;
+    int fan = verts ? 0 : -1;
+    while (fan >= 0) {
+        int cand_count = 0;
+        for (int a = adj_start[fan]; a < adj_start[fan + 1]; a++) {
+            int t = adj[a];
+            if (emitted[t])
+                continue;
+            emitted[t] = 1;
+            tri_order[out_count++] = t;
+            for (int k = 0; k < 3; k++) {
+                int v = idx[3 * t + k];
+                dead_end[dead_count++] = v;
+                candidates[cand_count++] = v;
+                live[v]--;
+                if (time - stamp[v] > cache_size)
+                    stamp[v] = time++;
+            }
+        }
+        // Next fan center: the candidate that will still be in the cache
+        // after its remaining triangles are emitted, and has been there the
+        // longest
+        int best = -1, best_priority = -1;
+        for (int c = 0; c < cand_count; c++) {
+            int v = candidates[c];
+            if (live[v] <= 0)
+                continue;
+            int priority = 0;
+            if (time - stamp[v] + 2 * live[v] <= cache_size)
+                priority = time - stamp[v];
+            if (priority > best_priority) {
+                best_priority = priority;
+                best = v;
+            }
+        }
+        // Dead end: back up to the most recent vertex with triangles left,
+        // then take the next one in input order
+        while (best < 0 && dead_count > 0) {
+            int v = dead_end[--dead_count];
+            if (live[v] > 0)
+                best = v;
+        }
+        while (best < 0 && cursor < verts) {
+            if (live[cursor] > 0)
+                best = cursor;
+            cursor++;
+        }
+        fan = best;
+    }
+    free(adj_start);
+    free(adj);
+    free(live);
+    free(stamp);
+    free(dead_end);
+    free(candidates);
+    free(emitted);
+}
+
+// 1 if triangles t = (a, b, c) and u = (a, c, d) (indices into verts, whose
+// packed 8 bit positions are in keys) make a convex quad a, b, c, d in one
+// plane. Quantizing is affine, so this holds for the world positions too.
+static int convex_quad(const int *t, const int *u, const int *keys) {
+    int64_t p[4][3];
+    const int v[4] = {t[0], t[1], t[2], u[2]};
+    for (int k = 0; k < 4; k++)
+        for (int a = 0; a < 3; a++)
+            p[k][a] = (keys[v[k]] >> (8 * a)) & 0xFF;
+    int64_t e[4][3], n[3];
+    for (int k = 0; k < 4; k++)
+        for (int a = 0; a < 3; a++)
+            e[k][a] = p[(k + 1) & 3][a] - p[k][a];
+    // Normal of a, b, c, then every corner has to turn the same way around it
+    n[0] = e[0][1] * e[1][2] - e[0][2] * e[1][1];
+    n[1] = e[0][2] * e[1][0] - e[0][0] * e[1][2];
+    n[2] = e[0][0] * e[1][1] - e[0][1] * e[1][0];
+    if (n[0] * (p[3][0] - p[0][0]) + n[1] * (p[3][1] - p[0][1]) + n[2] * (p[3][2] - p[0][2]) != 0)
+        return 0;
+    for (int k = 0; k < 4; k++) {
+        const int64_t *e0 = e[k], *e1 = e[(k + 1) & 3];
+        int64_t turn = n[0] * (e0[1] * e1[2] - e0[2] * e1[1]) + n[1] * (e0[2] * e1[0] - e0[0] * e1[2]) +
+                       n[2] * (e0[0] * e1[1] - e0[1] * e1[0]);
+        if (turn <= 0)
+            return 0;
+    }
+    return 1;
+}
+
+// Pairs triangles of order (3 indices each) into quads. A triangle that finds
+// its partner within QUAD_WINDOW is rotated to (a, b, c), the partner is
+// rotated to (a, c, d) and moved right after it, and the first one's flag is
+// set. colors is indexed by tri_order, which is moved along with order.
+// Returns the number of quads.
+static int pair_quads(int *order, int *tri_order, int tris, const int *keys, const uint8_t *colors,
+                      uint8_t *flags) {
+    int quads = 0;
+    memset(flags, 0, tris);
+    for (int t = 0; t + 1 < tris; t++) {
+        int found = -1, rt = 0, ru = 0;
+        int *a = &order[3 * t];
+        for (int u = t + 1; u < tris && u <= t + QUAD_WINDOW && found < 0; u++) {
+            if (colors[tri_order[u]] != colors[tri_order[t]])
+                continue;
+            const int *b = &order[3 * u];
+            // Shared edge, in opposite directions: a[r + 2] -> a[r] in t is
+            // a[r] -> a[r + 2] in u
+            for (int r = 0; r < 3 && found < 0; r++)
+                for (int s = 0; s < 3 && found < 0; s++) {
+                    if (b[s] != a[r] || b[(s + 1) % 3] != a[(r + 2) % 3])
+                        continue;
+                    const int tv[3] = {a[r], a[(r + 1) % 3], a[(r + 2) % 3]};
+                    const int uv[3] = {b[s], b[(s + 1) % 3], b[(s + 2) % 3]};
+                    if (convex_quad(tv, uv, keys)) {
+                        found = u;
+                        rt = r;
+                        ru = s;
+                    }
+                }
+        }
+        if (found < 0)
+            continue;
+        int tv[3], uv[3];
+        for (int k = 0; k < 3; k++) {
+            tv[k] = a[(rt + k) % 3];
+            uv[k] = order[3 * found + (ru + k) % 3];
+        }
+        int u_order = tri_order[found];
+        memmove(&order[3 * (t + 2)], &order[3 * (t + 1)], 3 * (found - t - 1) * sizeof(int));
+        memmove(&tri_order[t + 2], &tri_order[t + 1], (found - t - 1) * sizeof(int));
+        memcpy(&order[3 * t], tv, sizeof(tv));
+        memcpy(&order[3 * (t + 1)], uv, sizeof(uv));
+        tri_order[t + 1] = u_order;
+        flags[t] = MESH_TRI_QUAD;
+        quads++;
+        t++;
+    }
+    return quads;
+}
+
+typedef struct {
+    int tris, dropped, positions, quads;
+    float acmr_before, acmr_after, max_error;
+} ObjectStats;
+
+static void compile_object(const InObject *in, MeshObject *o, ObjectStats *st) {
+    memset(st, 0, sizeof(*st));
+    float lo[3] = {INFINITY, INFINITY, INFINITY}, hi[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (int i = 0; i < in->tri_count; i++)
+        for (int k = 0; k < 3; k++)
+            for (int a = 0; a < 3; a++) {
+                float p = positions[in_tris[in->first_tri + i].p[k]][a];
+                lo[a] = fminf(lo[a], p);
+                hi[a] = fmaxf(hi[a], p);
+            }
+    for (int a = 0; a < 3; a++) {
+        o->offset[a] = lo[a];
+        o->scale[a] = hi[a] > lo[a] ? (hi[a] - lo[a]) / 255.0f : 1.0f;
+    }
+
+    // Quantize, and merge positions that land on the same 8 bit point. The
+    // map is indexed by the packed point, 16M entries, so keep it around.
+    static int *local_of;
+    if (!local_of) {
+        local_of = malloc((1 << 24) * sizeof(int));
+        memset(local_of, 0xFF, (1 << 24) * sizeof(int));
+    }
+    int *keys = malloc(3 * in->tri_count * sizeof(int));
+    int *idx = malloc(3 * in->tri_count * sizeof(int));
+    uint8_t *colors = malloc(in->tri_count);
+    int verts = 0, tris = 0;
+    for (int i = 0; i < in->tri_count; i++) {
+        const InTri *t = &in_tris[in->first_tri + i];
+        int v[3];
+        for (int k = 0; k < 3; k++) {
+            const float *p = positions[t->p[k]];
+            int key = 0;
+            for (int a = 0; a < 3; a++) {
+                int q = (int)floorf((p[a] - o->offset[a]) / o->scale[a] + 0.5f);
+                q = q < 0 ? 0 : q > 255 ? 255 : q;
+                key |= q << (8 * a);
+                st->max_error = fmaxf(st->max_error, fabsf(o->offset[a] + o->scale[a] * q - p[a]));
+            }
+            if (local_of[key] < 0) {
+                local_of[key] = verts;
+                keys[verts++] = key;
+            }
+            v[k] = local_of[key];
+        }
+        if (v[0] == v[1] || v[1] == v[2] || v[2] == v[0]) {
+            st->dropped++;
+            continue;
+        }
+        memcpy(&idx[3 * tris], v, sizeof(v));
+        colors[tris++] = t->color;
+    }
+    for (int i = 0; i < verts; i++)
+        local_of[keys[i]] = -1;
+    if (verts > 65536) {
+        fprintf(stderr, "Object %s has %d vertices after merging, the limit is 65536. Split it up.\n", in->name,
+                verts);
+        exit(1);
+    }
+
+    int *stamp = malloc((verts > 0 ? verts : 1) * sizeof(int));
+    int *tri_order = malloc((tris > 0 ? tris : 1) * sizeof(int));
+    int *order = malloc((tris > 0 ? 3 * tris : 1) * sizeof(int));
+    st->acmr_before = acmr(idx, tris, stamp, verts);
+    tipsify(idx, tris, verts, tri_order);
+    for (int t = 0; t < tris; t++)
+        memcpy(&order[3 * t], &idx[3 * tri_order[t]], 3 * sizeof(int));
+    st->acmr_after = acmr(order, tris, stamp, verts);
+    // Tipsify is greedy, and can come out slightly behind a mesh that was
+    // already in strip order
+    if (st->acmr_after > st->acmr_before) {
+        for (int t = 0; t < tris; t++)
+            tri_order[t] = t;
+        memcpy(order, idx, 3 * tris * sizeof(int));
+        st->acmr_after = st->acmr_before;
+    }
+    uint8_t *flags = malloc(tris > 0 ? tris : 1);
+    memset(flags, 0, tris);
+    if (make_quads) {
+        st->quads = pair_quads(order, tri_order, tris, keys, colors, flags);
+        st->acmr_after = acmr(order, tris, stamp, verts);
+    }
+    free(stamp);
+
+    // Number vertices in order of first use
+    int *renumber = malloc((verts > 0 ? verts : 1) * sizeof(int));
+    for (int v = 0; v < verts; v++)
+        renumber[v] = -1;
+    o->first_vertex = vertex_count;
+    o->first_triangle = triangle_count;
+    int used_verts = 0;
+    vertices = realloc(vertices, (vertex_count + verts + 1) * sizeof(*vertices));
+    triangles = realloc(triangles, (triangle_count + tris + 1) * sizeof(*triangles));
+    for (int t = 0; t < tris; t++) {
+        MeshTriangle *mt = &triangles[triangle_count + t];
+        for (int k = 0; k < 3; k++) {
+            int v = order[3 * t + k];
+            if (renumber[v] < 0) {
+                renumber[v] = used_verts++;
+                MeshVertex *mv = &vertices[vertex_count + renumber[v]];
+                mv->x = keys[v] & 0xFF;
+                mv->y = (keys[v] >> 8) & 0xFF;
+                mv->z = (keys[v] >> 16) & 0xFF;
+                mv->pad = 0;
+            }
+            mt->v[k] = (uint16_t)renumber[v];
+        }
+        mt->color = colors[tri_order[t]];
+        mt->flags = flags[t];
+    }
+    o->vertex_count = used_verts;
+    o->triangle_count = tris;
+
+    uint8_t qlo[3] = {255, 255, 255}, qhi[3] = {0, 0, 0};
+    for (int v = 0; v < used_verts; v++) {
+        const MeshVertex *mv = &vertices[vertex_count + v];
+        const uint8_t q[3] = {mv->x, mv->y, mv->z};
+        for (int a = 0; a < 3; a++) {
+            qlo[a] = q[a] < qlo[a] ? q[a] : qlo[a];
+            qhi[a] = q[a] > qhi[a] ? q[a] : qhi[a];
+        }
+    }
+    for (int a = 0; a < 3; a++) {
+        o->bounds_min[a] = used_verts ? o->offset[a] + o->scale[a] * qlo[a] : o->offset[a];
+        o->bounds_max[a] = used_verts ? o->offset[a] + o->scale[a] * qhi[a] : o->offset[a];
+    }
+    vertex_count += used_verts;
+    triangle_count += tris;
+    st->tris = tris;
+    st->positions = used_verts;
+
+    free(keys);
+    free(idx);
+    free(colors);
+    free(order);
+    free(tri_order);
+    free(renumber);
+    free(flags);
+}
+
+// The whole file: header, then the three tables. Returns the size in bytes.
+static size_t build(uint8_t **out) {
+    MeshHeader h = {0};
+    h.magic = MESH_MAGIC;
+    h.version = MESH_FORMAT_VERSION;
+    h.object_count = in_object_count;
+    h.vertex_count = vertex_count;
+    h.triangle_count = triangle_count;
+    h.objects_offset = sizeof(MeshHeader);
+    h.vertices_offset = h.objects_offset + in_object_count * sizeof(MeshObject);
+    h.triangles_offset = h.vertices_offset + vertex_count * sizeof(MeshVertex);
+    size_t size = h.triangles_offset + triangle_count * sizeof(MeshTriangle);
+    size = (size + 3) & ~(size_t)3;
+    uint8_t *b = calloc(size, 1);
+    memcpy(b, &h, sizeof(h));
+    memcpy(b + h.objects_offset, objects, in_object_count * sizeof(MeshObject));
+    memcpy(b + h.vertices_offset, vertices, vertex_count * sizeof(MeshVertex));
+    memcpy(b + h.triangles_offset, triangles, triangle_count * sizeof(MeshTriangle));
+    *out = b;
+    return size;
+}
+
+static void write_outputs(const char *name, const char *cmdline, const uint8_t *b, size_t size) {
+    char file[256], guard[256];
+    snprintf(file, sizeof(file), "mesh_%s.bin", name);
+    FILE *f = fopen(file, "wb");
+    if (!f || fwrite(b, 1, size, f) != size) {
+        perror(file);
+        exit(1);
+    }
+    fclose(f);
+    printf("Wrote %s\n", file);
+
+    snprintf(file, sizeof(file), "mesh_%s.h", name);
+    snprintf(guard, sizeof(guard), "MESH_%s_H", name);
+    for (char *p = guard; *p; p++) {
+        if (*p >= 'a' && *p <= 'z')
+            *p -= 'a' - 'A';
+        else if (!(*p >= 'A' && *p <= 'Z') && !(*p >= '0' && *p <= '9'))
+            *p = '_';
+    }
+    f = fopen(file, "w");
+    if (!f) {
+        perror(file);
+        exit(1);
+    }
+    fprintf(f, "#ifndef %s\n#define %s\n\n", guard, guard);
+    fprintf(f, "// Generated by meshc.c (%s), do not edit.\n", cmdline);
+    fprintf(f, "// %d objects, %d vertices, %d triangles in the format of mesh_format.h,\n", in_object_count,
+            vertex_count, triangle_count);
+    fprintf(f, "// version %d. Build with -DHDMI_MESH='\"%s\"'.\n", MESH_FORMAT_VERSION, file);
+    for (int i = 0; i < in_object_count; i++)
+        fprintf(f, "//   %-24s %6u vertices %6u triangles\n", in_objects[i].name, objects[i].vertex_count,
+                objects[i].triangle_count);
+    fprintf(f, "\n#include <stdint.h>\n\n");
+    fprintf(f, "static const uint32_t mesh_data[] = {\n");
+    for (size_t i = 0; i < size; i += 4) {
+        uint32_t w = b[i] | b[i + 1] << 8 | b[i + 2] << 16 | (uint32_t)b[i + 3] << 24;
+        fprintf(f, "%s0x%08X,%s", i % 32 == 0 ? "    " : "", w, i % 32 == 28 || i + 4 == size ? "\n" : " ");
+    }
+    fprintf(f, "};\n\n#endif // %s\n", guard);
+    fclose(f);
+    printf("Wrote %s\n", file);
+}
+
+int main(int argc, char **argv) {
+    int fit_cube = 0;
+    const char *path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-f") == 0)
+            fit_cube = 1;
+        else if (strcmp(argv[i], "-t") == 0)
+            make_quads = 0;
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+            cache_size = atoi(argv[++i]);
+        else if (argv[i][0] != '-' && !path)
+            path = argv[i];
+        else
+            path = NULL, i = argc;
+    }
+    if (!path || cache_size < 3) {
+        fprintf(stderr, "Usage: %s [-f] [-t] [-c cache] <model.obj>\n", argv[0]);
+        return 1;
+    }
+
+    // Model name: the file name without directory or extension
+    char name[NAME_LEN];
+    const char *base = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    snprintf(name, sizeof(name), "%s", base);
+    if (strrchr(name, '.'))
+        *strrchr(name, '.') = 0;
+    char cmdline[256];
+    snprintf(cmdline, sizeof(cmdline), "meshc%s%s -c %d %s", fit_cube ? " -f" : "", make_quads ? "" : " -t",
+             cache_size, base);
+
+    read_obj(path);
+    if (in_tri_count == 0) {
+        fprintf(stderr, "%s has no faces\n", path);
+        return 1;
+    }
+    if (fit_cube)
+        fit();
+
+    printf("%-24s %8s %8s %8s %7s %7s %7s %8s %6s\n", "object", "tris", "verts", "dropped", "reuse", "acmr_in",
+           "acmr", "max_err", "quads");
+    int dropped = 0, quads = 0;
+    float misses_before = 0.0f, misses_after = 0.0f;
+    for (int i = 0; i < in_object_count; i++) {
+        ObjectStats st;
+        compile_object(&in_objects[i], &objects[i], &st);
+        printf("%-24s %8d %8d %8d %7.2f %7.3f %7.3f %8.3f %6d\n", in_objects[i].name, st.tris, st.positions,
+               st.dropped, st.positions ? 3.0f * st.tris / st.positions : 0.0f, st.acmr_before, st.acmr_after,
+               st.max_error, st.quads);
+        dropped += st.dropped;
+        quads += st.quads;
+        misses_before += st.acmr_before * st.tris;
+        misses_after += st.acmr_after * st.tris;
+    }
+
+    uint8_t *blob;
+    size_t size = build(&blob);
+    printf("\n%d faces in, %d triangles out (%d collapsed by quantization), %d objects\n", in_tri_count,
+           triangle_count, dropped, in_object_count);
+    printf("%d OBJ positions, %d vertices after quantizing and merging\n", position_count, vertex_count);
+    printf("Vertex reuse: %.2f triangle corners per vertex\n", vertex_count ? 3.0f * triangle_count / vertex_count
+                                                                             : 0.0f);
+    printf("Vertex cache (FIFO, %d entries): %.3f misses per triangle in OBJ order, %.3f after reordering\n",
+           cache_size, triangle_count ? misses_before / triangle_count : 0.0f,
+           triangle_count ? misses_after / triangle_count : 0.0f);
+    printf("%d quads, %d of the triangles are drawn as halves of one\n", quads, 2 * quads);
+    printf("%zu bytes, %.2f bytes per triangle (10 as triangle soup like cornell_box)\n", size,
+           triangle_count ? (double)size / triangle_count : 0.0);
+    write_outputs(name, cmdline, blob, size);
+    free(blob);
+    return 0;
+}
@@ -0,0 +1,145 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Frame stage profiler. Build with HDMI_PROFILE defined to time the stages of
+// the render loop, otherwise every macro here compiles to nothing.
+//
+//   PROF_INIT();                 once at startup
+//   PROF_START(PROF_CULL);       around each piece of work
+//   PROF_STOP(PROF_CULL);
+//   PROF_FRAME_END();            once per frame
+//
+// Time is added up per stage over a frame. Every PROF_PRINT_FRAMES frames the
+// min/avg/max of those per-frame totals is printed in microseconds and the
+// stats start over. On the MicroBlaze the time comes from the first AXI timer,
+// on the host (testbench.c) from clock_gettime.
+
+#ifdef HDMI_PROFILE
+
+#include <stdint.h>
+
+#ifndef PROF_PRINT_FRAMES
+#define PROF_PRINT_FRAMES 300
+#endif
+
+enum {
+  PROF_VIEW_PROJ, // view and projection matrix build
+  PROF_TRANSFORM, // per-triangle matrix multiplies and perspective divide
+  PROF_CULL,      // frustum and degenerate w tests
+  PROF_PACK,      // area reciprocal and fixed point conversion
+  PROF_SUBMIT,    // writing the packet to the registers, ring or DMA buffer
+  PROF_FRAME,     // the whole frame, start to end
+  PROF_NUM_STAGES
+};
+
+static const char *const prof_names[PROF_NUM_STAGES] = {
+    "view_proj", "transform", "cull", "pack", "submit", "frame"};
+
+#ifdef __MICROBLAZE__
+#include "xil_printf.h"
+#include "xtmrctr.h"
+
+typedef uint32_t prof_ticks_t;
+#define PROF_TICKS_PER_US (XPAR_TMRCTR_0_CLOCK_FREQ_HZ / 1000000)
+#define PROF_PRINTF xil_printf
+
+static XTmrCtr prof_timer;
+
+// Free running up counter, wraps every ~43 s at 100 MHz which is fine for
+// differences.
+static inline void prof_timer_init(void) {
+  XTmrCtr_Initialize(&prof_timer, XPAR_TMRCTR_0_DEVICE_ID);
+  XTmrCtr_SetOptions(&prof_timer, 0, XTC_AUTO_RELOAD_OPTION);
+  XTmrCtr_SetResetValue(&prof_timer, 0, 0);
+  XTmrCtr_Start(&prof_timer, 0);
+}
+
+static inline prof_ticks_t prof_now(void) {
+  return XTmrCtr_GetValue(&prof_timer, 0);
+}
+#else
+#include <stdio.h>
+#include <time.h>
+
+typedef uint64_t prof_ticks_t;
+#define PROF_TICKS_PER_US 1000
+#define PROF_PRINTF printf
+
+static inline void prof_timer_init(void) {}
+
+static inline prof_ticks_t prof_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (prof_ticks_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+#endif
+
+typedef struct {
+  prof_ticks_t start; // set by PROF_START
+  prof_ticks_t acc;   // this frame so far
+  prof_ticks_t min, max;
+  uint32_t sum_us; // per-frame totals in microseconds, so printing needs no 64 bit divide
+} prof_stage_t;
+
+static prof_stage_t prof_stages[PROF_NUM_STAGES];
+static uint32_t prof_frames;
+
+#define PROF_INIT()                                                            \
+  do {                                                                         \
+    prof_timer_init();                                                         \
+    prof_reset();                                                              \
+    PROF_START(PROF_FRAME);                                                    \
+  } while (0)
+#define PROF_START(stage) (prof_stages[stage].start = prof_now())
+#define PROF_STOP(stage)                                                       \
+  (prof_stages[stage].acc += prof_now() - prof_stages[stage].start)
+#define PROF_FRAME_END() prof_frame_end()
+
+static inline void prof_reset(void) {
+  for (int i = 0; i < PROF_NUM_STAGES; i++) {
+    prof_stages[i].acc = 0;
+    prof_stages[i].min = (prof_ticks_t)-1;
+    prof_stages[i].max = 0;
+    prof_stages[i].sum_us = 0;
+  }
+  prof_frames = 0;
+}
+
+// Plain %d on 32 bit values only, xil_printf has no field widths.
+static inline void prof_print(void) {
+  PROF_PRINTF("stage: min avg max us (%d frames)\r\n", (int)prof_frames);
+  for (int i = 0; i < PROF_NUM_STAGES; i++) {
+    prof_stage_t *s = &prof_stages[i];
+    PROF_PRINTF("%s: %d %d %d\r\n", prof_names[i], (int)(uint32_t)(s->min / PROF_TICKS_PER_US),
+                (int)(s->sum_us / prof_frames), (int)(uint32_t)(s->max / PROF_TICKS_PER_US));
+  }
+}
+
+static inline void prof_frame_end(void) {
+  PROF_STOP(PROF_FRAME);
+  for (int i = 0; i < PROF_NUM_STAGES; i++) {
+    prof_stage_t *s = &prof_stages[i];
+    if (s->acc < s->min)
+      s->min = s->acc;
+    if (s->acc > s->max)
+      s->max = s->acc;
+    s->sum_us += (uint32_t)(s->acc / PROF_TICKS_PER_US);
+    s->acc = 0;
+  }
+  if (++prof_frames == PROF_PRINT_FRAMES) {
+    prof_print();
+    prof_reset();
+  }
+  PROF_START(PROF_FRAME);
+}
+
+#else
+
+#define PROF_INIT() ((void)0)
+#define PROF_START(stage) ((void)0)
+#define PROF_STOP(stage) ((void)0)
+#define PROF_FRAME_END() ((void)0)
+
+#endif
+
+#endif // PROFILER_H
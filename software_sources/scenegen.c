@@ -0,0 +1,435 @@
+// Stress scene generator. Writes a mesh and a camera path as a C header that
+// testbench.c and the MicroBlaze build pick up with -DHDMI_SCENE, and the
+// packets main() would send for the first few frames as a $readmemh file for
+// sim_sources/scene_tb.sv.
+//
+//   gcc -O2 -o scenegen scenegen.c -lm
+//   ./scenegen <scene> [frames] [packet_frames]
+//
+// Scenes:
+//   sphere    tessellated sphere, about 2000 triangles, orbited
+//   overdraw  16 quads covering most of the screen, stacked back to front
+//   slivers   fan of 360 one degree slivers, large mostly empty bounding boxes
+//   offscreen ~400 small cubes spread over the world, camera turning on the
+//             spot in the middle so most of them fail the frustum test
+//   grid      48x48 grid of tiny triangles facing the camera
+//
+// Output: scene_<scene>.h with scene_mesh (same layout as cornell_box: three
+// vertices in 0-255 world units and an RGB332 color), scene_camera_path (x, y,
+// z and yaw per frame, 300 frames by default) and scene_<scene>.mem with one
+// 192 bit packet per line for the first packet_frames frames (2 by default),
+// each frame ending in a FENCE and a SWAP like the command ring build.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PI 3.14159265f
+#define MAX_TRIANGLES 8192
+#define MAX_FRAMES 3600
+
+typedef struct {
+    float v[3][3];
+    uint8_t color;
+} Tri;
+
+typedef struct {
+    float x, y, z, yaw;
+} Camera;
+
+static Tri tris[MAX_TRIANGLES];
+static int tri_count;
+static Camera path[MAX_FRAMES];
+
+static void add_tri(const float a[3], const float b[3], const float c[3], uint8_t color) {
+    if (tri_count == MAX_TRIANGLES) {
+        fprintf(stderr, "Too many triangles, the limit is %d\n", MAX_TRIANGLES);
+        exit(1);
+    }
+    Tri *t = &tris[tri_count++];
+    memcpy(t->v[0], a, sizeof(t->v[0]));
+    memcpy(t->v[1], b, sizeof(t->v[1]));
+    memcpy(t->v[2], c, sizeof(t->v[2]));
+    t->color = color;
+}
+
+static void add_quad(const float a[3], const float b[3], const float c[3], const float d[3], uint8_t color) {
+    add_tri(a, b, c, color);
+    add_tri(a, c, d, color);
+}
+
+static uint8_t rgb332(int r, int g, int b) {
+    return (uint8_t)((r & 7) << 5 | (g & 7) << 2 | (b & 3));
+}
+
+// Yaw that points the camera at (x, z). The view matrix in main() looks down
+// (-sin(yaw), 0, cos(yaw)).
+static float look_at(const Camera *c, float x, float z) {
+    return atan2f(-(x - c->x), z - c->z);
+}
+
+// ===== PROJECTION =====
+// Same matrices and packing as main() in hdmi_text_controller.c
+
+static void view_proj(const Camera *c, float out[16]) {
+    float cy = cosf(c->yaw), sy = sinf(c->yaw);
+    const float view[16] = {cy,  0.0f, sy, -(cy * c->x + sy * c->z),
+                            0.0f, 1.0f, 0.0f, -c->y,
+                            -sy, 0.0f, cy, -(-sy * c->x + cy * c->z),
+                            0.0f, 0.0f, 0.0f, 1.0f};
+    const float proj[16] = {1.299f, 0.0f, 0.0f, 0.0f,
+                            0.0f, 1.732f, 0.0f, 0.0f,
+                            0.0f, 0.0f, 1.003f, -1.003f,
+                            0.0f, 0.0f, 1.0f, 0.0f};
+    for (int r = 0; r < 4; r++)
+        for (int col = 0; col < 4; col++) {
+            float dot = 0.0f;
+            for (int k = 0; k < 4; k++)
+                dot += proj[4 * r + k] * view[4 * k + col];
+            out[4 * r + col] = dot;
+        }
+}
+
+// Clip space position of a mesh vertex, after rounding to the 8 bit mesh
+static void to_clip(const float mvp[16], const float v[3], float out[4]) {
+    float in[4] = {roundf(v[0]), roundf(v[1]), roundf(v[2]), 1.0f};
+    for (int r = 0; r < 4; r++) {
+        out[r] = 0.0f;
+        for (int k = 0; k < 4; k++)
+            out[r] += mvp[4 * r + k] * in[k];
+    }
+}
+
+// Fills the packet main() would send, returns 0 if main() would cull it
+static int pack(const float mvp[16], const Tri *t, uint32_t pkt[6]) {
+    float clip[3][4];
+    for (int j = 0; j < 3; j++)
+        to_clip(mvp, t->v[j], clip[j]);
+
+    int all_left = 1, all_right = 1, all_bottom = 1, all_top = 1, all_near = 1, all_far = 1;
+    for (int j = 0; j < 3; j++) {
+        all_left &= clip[j][0] < -clip[j][3];
+        all_right &= clip[j][0] > clip[j][3];
+        all_bottom &= clip[j][1] < -clip[j][3];
+        all_top &= clip[j][1] > clip[j][3];
+        all_near &= clip[j][2] < 0;
+        all_far &= clip[j][2] > clip[j][3];
+    }
+    if (all_left || all_right || all_bottom || all_top || all_near || all_far)
+        return 0;
+    if (clip[0][3] <= 0.0001f || clip[1][3] <= 0.0001f || clip[2][3] <= 0.0001f)
+        return 0;
+
+    uint16_t vert[9];
+    uint32_t x[3], y[3];
+    for (int j = 0; j < 3; j++) {
+        x[j] = (uint32_t)((clip[j][0] / clip[j][3] + 1.0f) * 160.0f);
+        y[j] = (uint32_t)((1.0f - clip[j][1] / clip[j][3]) * 120.0f);
+        vert[3 * j] = x[j];
+        vert[3 * j + 1] = y[j];
+        vert[3 * j + 2] = (uint16_t)(clip[j][2] / clip[j][3] * 255.0f);
+    }
+    float r_area = 2.0f / (x[0] * (y[1] - y[2]) + x[1] * (y[2] - y[0]) + x[2] * (y[0] - y[1]));
+    if (r_area < 0)
+        r_area *= -1;
+
+    pkt[0] = (uint32_t)vert[1] << 16 | vert[0];
+    pkt[1] = (uint32_t)vert[3] << 16 | vert[2];
+    pkt[2] = (uint32_t)vert[5] << 16 | vert[4];
+    pkt[3] = (uint32_t)vert[7] << 16 | vert[6];
+    pkt[4] = (uint32_t)t->color << 16 | vert[8];
+    pkt[5] = (uint32_t)(int32_t)(r_area * (1 << 24));
+    return 1;
+}
+
+// Twice the signed screen area. The rasterizer only fills triangles where this
+// is positive.
+static float screen_area(const Camera *c, const Tri *t) {
+    float mvp[16], clip[3][4], sx[3], sy[3];
+    view_proj(c, mvp);
+    for (int j = 0; j < 3; j++) {
+        to_clip(mvp, t->v[j], clip[j]);
+        sx[j] = (clip[j][0] / clip[j][3] + 1.0f) * 160.0f;
+        sy[j] = (1.0f - clip[j][1] / clip[j][3]) * 120.0f;
+    }
+    return sx[0] * (sy[1] - sy[2]) + sx[1] * (sy[2] - sy[0]) + sx[2] * (sy[0] - sy[1]);
+}
+
+static void flip(Tri *t) {
+    float tmp[3];
+    memcpy(tmp, t->v[1], sizeof(tmp));
+    memcpy(t->v[1], t->v[2], sizeof(tmp));
+    memcpy(t->v[2], tmp, sizeof(tmp));
+}
+
+// Winds triangles first..tri_count-1 so they are drawn from the first camera
+// position. Only for geometry that always faces the camera.
+static void face_camera(int first) {
+    for (int i = first; i < tri_count; i++)
+        if (screen_area(&path[0], &tris[i]) < 0)
+            flip(&tris[i]);
+}
+
+// ===== SCENES =====
+
+static void orbit(int frames, float cx, float cy, float cz, float radius, float turns) {
+    for (int f = 0; f < frames; f++) {
+        float a = 2 * PI * turns * f / frames;
+        path[f].x = cx + radius * cosf(a);
+        path[f].y = cy;
+        path[f].z = cz + radius * sinf(a);
+        path[f].yaw = look_at(&path[f], cx, cz);
+    }
+}
+
+static void gen_sphere(int frames) {
+    const int stacks = 32, slices = 32;
+    const float c = 127.5f, r = 100.0f;
+    orbit(frames, c, c, c, 230.0f, 1.0f);
+    for (int i = 0; i < stacks; i++) {
+        float t0 = PI * i / stacks, t1 = PI * (i + 1) / stacks;
+        for (int j = 0; j < slices; j++) {
+            float p0 = 2 * PI * j / slices, p1 = 2 * PI * (j + 1) / slices;
+            float a[3] = {c + r * sinf(t0) * cosf(p0), c + r * cosf(t0), c + r * sinf(t0) * sinf(p0)};
+            float b[3] = {c + r * sinf(t0) * cosf(p1), c + r * cosf(t0), c + r * sinf(t0) * sinf(p1)};
+            float d[3] = {c + r * sinf(t1) * cosf(p0), c + r * cosf(t1), c + r * sinf(t1) * sinf(p0)};
+            float e[3] = {c + r * sinf(t1) * cosf(p1), c + r * cosf(t1), c + r * sinf(t1) * sinf(p1)};
+            uint8_t color = rgb332(7 - i * 8 / stacks, j * 8 / slices, 2);
+            // The poles only need one triangle per slice
+            if (i != 0)
+                add_tri(a, b, e, color);
+            if (i != stacks - 1)
+                add_tri(a, e, d, color);
+        }
+    }
+    // Closed mesh: wind every triangle the same way round as the one nearest
+    // the first camera, so the rasterizer drops the back faces
+    int nearest = 0;
+    float best = 1e9f;
+    for (int i = 0; i < tri_count; i++) {
+        float dx = tris[i].v[0][0] - path[0].x, dy = tris[i].v[0][1] - path[0].y, dz = tris[i].v[0][2] - path[0].z;
+        if (dx * dx + dy * dy + dz * dz < best) {
+            best = dx * dx + dy * dy + dz * dz;
+            nearest = i;
+        }
+    }
+    if (screen_area(&path[0], &tris[nearest]) < 0)
+        for (int i = 0; i < tri_count; i++)
+            flip(&tris[i]);
+}
+
+static void gen_overdraw(int frames) {
+    for (int f = 0; f < frames; f++) {
+        path[f].x = 127.5f + 10.0f * sinf(2 * PI * f / frames);
+        path[f].y = 127.5f;
+        path[f].z = -180.0f;
+        path[f].yaw = 0.0f;
+    }
+    // Back to front, so every layer passes the depth test. main() doesn't
+    // clip, so the front layer stays just inside the screen.
+    for (int l = 15; l >= 0; l--) {
+        float z = 20.0f + 6.0f * l;
+        float a[3] = {16, 28, z}, b[3] = {239, 28, z}, c[3] = {239, 227, z}, d[3] = {16, 227, z};
+        add_quad(a, b, c, d, rgb332(l / 2, 7 - l / 2, l & 3));
+    }
+    face_camera(0);
+}
+
+static void gen_slivers(int frames) {
+    for (int f = 0; f < frames; f++) {
+        path[f].x = 127.5f;
+        path[f].y = 127.5f;
+        // Far enough back that the whole fan is on screen
+        path[f].z = -140.0f + 30.0f * sinf(2 * PI * f / frames);
+        path[f].yaw = 0.0f;
+    }
+    for (int i = 0; i < 360; i++) {
+        float a0 = 2 * PI * i / 360, a1 = 2 * PI * (i + 1) / 360;
+        float c[3] = {127.5f, 127.5f, 128.0f};
+        float p[3] = {127.5f + 127.0f * cosf(a0), 127.5f + 127.0f * sinf(a0), 128.0f};
+        float q[3] = {127.5f + 127.0f * cosf(a1), 127.5f + 127.0f * sinf(a1), 128.0f};
+        add_tri(c, p, q, rgb332(i % 8, (i / 8) % 8, i % 4));
+    }
+    face_camera(0);
+}
+
+static void add_cube(float x, float y, float z, float s, uint8_t color) {
+    float v[8][3];
+    for (int i = 0; i < 8; i++) {
+        v[i][0] = x + (i & 1 ? s : 0);
+        v[i][1] = y + (i & 2 ? s : 0);
+        v[i][2] = z + (i & 4 ? s : 0);
+    }
+    // Outward facing, counter-clockwise seen from outside
+    add_quad(v[0], v[2], v[3], v[1], color); // -z
+    add_quad(v[4], v[5], v[7], v[6], color); // +z
+    add_quad(v[0], v[4], v[6], v[2], color); // -x
+    add_quad(v[1], v[3], v[7], v[5], color); // +x
+    add_quad(v[0], v[1], v[5], v[4], color); // -y
+    add_quad(v[2], v[6], v[7], v[3], color); // +y
+}
+
+static void gen_offscreen(int frames) {
+    // One full turn at ground level, about a fifth of the world is in view
+    for (int f = 0; f < frames; f++) {
+        path[f].x = 127.5f;
+        path[f].y = 12.0f;
+        path[f].z = 127.5f;
+        path[f].yaw = 2 * PI * f / frames;
+    }
+    srand(385);
+    for (int i = 0; i < 20; i++)
+        for (int j = 0; j < 20; j++) {
+            float s = 4.0f + (float)(rand() % 5);
+            uint8_t color = (uint8_t)(rand() & 0xFF);
+            // Keep clear of the camera
+            if (i >= 9 && i <= 10 && j >= 9 && j <= 10)
+                continue;
+            add_cube(3.0f + 12.5f * i, 0.0f, 3.0f + 12.5f * j, s, color);
+        }
+    // The cube faces are wound for a right handed view, the hardware may want
+    // them the other way round. Check a -z face straight ahead of the first
+    // camera, wound like add_cube does.
+    Tri probe = {{{120, 0, 200}, {120, 20, 200}, {140, 20, 200}}, 0};
+    if (screen_area(&path[0], &probe) < 0)
+        for (int i = 0; i < tri_count; i++)
+            flip(&tris[i]);
+}
+
+static void gen_grid(int frames) {
+    const int n = 48;
+    for (int f = 0; f < frames; f++) {
+        path[f].x = 127.5f + 30.0f * cosf(2 * PI * f / frames);
+        path[f].y = 127.5f + 30.0f * sinf(2 * PI * f / frames);
+        path[f].z = -160.0f;
+        path[f].yaw = 0.0f;
+    }
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < n; j++) {
+            float x0 = 255.0f * i / n, x1 = 255.0f * (i + 1) / n;
+            float y0 = 255.0f * j / n, y1 = 255.0f * (j + 1) / n;
+            float a[3] = {x0, y0, 128}, b[3] = {x1, y0, 128}, c[3] = {x1, y1, 128}, d[3] = {x0, y1, 128};
+            add_quad(a, b, c, d, rgb332(i * 8 / n, j * 8 / n, (i + j) & 3));
+        }
+    face_camera(0);
+}
+
+// ===== OUTPUT =====
+
+static int clamp8(float v) {
+    int i = (int)roundf(v);
+    return i < 0 ? 0 : i > 255 ? 255 : i;
+}
+
+static void write_header(const char *name, const char *cmdline, int frames) {
+    char file[64], guard[64];
+    snprintf(file, sizeof(file), "scene_%s.h", name);
+    snprintf(guard, sizeof(guard), "SCENE_%s_H", name);
+    for (char *p = guard; *p; p++)
+        if (*p >= 'a' && *p <= 'z')
+            *p -= 'a' - 'A';
+    FILE *f = fopen(file, "w");
+    if (!f) {
+        perror(file);
+        exit(1);
+    }
+    fprintf(f, "#ifndef %s\n#define %s\n\n", guard, guard);
+    fprintf(f, "// Generated by scenegen.c (%s), do not edit.\n", cmdline);
+    fprintf(f, "// %d triangles, %d camera frames. Build with -DHDMI_SCENE='\"%s\"'.\n\n", tri_count, frames, file);
+    fprintf(f, "#include <stdint.h>\n\n");
+    fprintf(f, "// Vertex1, Vertex2, Vertex3, RRRGGGBB, like cornell_box\n");
+    fprintf(f, "static const uint8_t scene_mesh[][10] = {\n");
+    for (int i = 0; i < tri_count; i++) {
+        const Tri *t = &tris[i];
+        fprintf(f, "    {%d,%d,%d,   %d,%d,%d,   %d,%d,%d,   0x%02X},\n", clamp8(t->v[0][0]), clamp8(t->v[0][1]),
+                clamp8(t->v[0][2]), clamp8(t->v[1][0]), clamp8(t->v[1][1]), clamp8(t->v[1][2]),
+                clamp8(t->v[2][0]), clamp8(t->v[2][1]), clamp8(t->v[2][2]), t->color);
+    }
+    fprintf(f, "};\n#define scene_triangle_count ((int)(sizeof(scene_mesh) / sizeof(scene_mesh[0])))\n\n");
+    fprintf(f, "// Camera per frame: x, y, z, yaw in radians\n");
+    fprintf(f, "static const float scene_camera_path[][4] = {\n");
+    for (int i = 0; i < frames; i++)
+        fprintf(f, "    {%.2ff, %.2ff, %.2ff, %.4ff},\n", path[i].x, path[i].y, path[i].z, path[i].yaw);
+    fprintf(f, "};\n#define scene_camera_frames ((int)(sizeof(scene_camera_path) / sizeof(scene_camera_path[0])))\n\n");
+    fprintf(f, "#endif // %s\n", guard);
+    fclose(f);
+    printf("Wrote %s\n", file);
+}
+
+// One packet per line, word 5 first, so $readmemh into a [191:0] array puts
+// word 0 in bits 31:0 like the FIFO
+static void write_packets(const char *name, int frames) {
+    char file[64];
+    snprintf(file, sizeof(file), "scene_%s.mem", name);
+    FILE *f = fopen(file, "w");
+    if (!f) {
+        perror(file);
+        exit(1);
+    }
+    fprintf(f, "// scene %s, %d frames of DRAW_TRI packets, each frame ends in FENCE and SWAP with the frame number\n",
+            name, frames);
+    int total = 0;
+    for (int fr = 0; fr < frames; fr++) {
+        float mvp[16];
+        uint32_t pkt[6];
+        int sent = 0;
+        view_proj(&path[fr], mvp);
+        // The mesh as written to the header, so the RTL sees what the firmware would
+        for (int i = 0; i < tri_count; i++) {
+            Tri t = tris[i];
+            for (int j = 0; j < 3; j++)
+                for (int k = 0; k < 3; k++)
+                    t.v[j][k] = (float)clamp8(t.v[j][k]);
+            if (!pack(mvp, &t, pkt))
+                continue;
+            fprintf(f, "%08X%08X%08X%08X%08X%08X\n", pkt[5], pkt[4], pkt[3], pkt[2], pkt[1], pkt[0]);
+            sent++;
+        }
+        fprintf(f, "%08X%08X%08X%08X%08X%08X\n", fr + 1, 0x06u << 24, 0, 0, 0, 0); // FENCE
+        fprintf(f, "%08X%08X%08X%08X%08X%08X\n", fr + 1, 0x05u << 24, 0, 0, 0, 0); // SWAP
+        printf("Frame %d: %d of %d triangles sent\n", fr, sent, tri_count);
+        total += sent + 2;
+    }
+    fclose(f);
+    printf("Wrote %s (%d packets)\n", file, total);
+}
+
+int main(int argc, char **argv) {
+    static const struct {
+        const char *name;
+        void (*gen)(int frames);
+    } scenes[] = {
+        {"sphere", gen_sphere}, {"overdraw", gen_overdraw}, {"slivers", gen_slivers},
+        {"offscreen", gen_offscreen}, {"grid", gen_grid},
+    };
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <scene> [frames] [packet_frames]\nScenes:", argv[0]);
+        for (size_t i = 0; i < sizeof(scenes) / sizeof(scenes[0]); i++)
+            fprintf(stderr, " %s", scenes[i].name);
+        fprintf(stderr, "\n");
+        return 1;
+    }
+    int frames = argc > 2 ? atoi(argv[2]) : 300;
+    int packet_frames = argc > 3 ? atoi(argv[3]) : 2;
+    if (frames < 1 || frames > MAX_FRAMES) {
+        fprintf(stderr, "frames must be 1 to %d\n", MAX_FRAMES);
+        return 1;
+    }
+    if (packet_frames < 0 || packet_frames > frames)
+        packet_frames = frames;
+
+    char cmdline[128];
+    snprintf(cmdline, sizeof(cmdline), "scenegen %s %d %d", argv[1], frames, packet_frames);
+    for (size_t i = 0; i < sizeof(scenes) / sizeof(scenes[0]); i++) {
+        if (strcmp(argv[1], scenes[i].name) != 0)
+            continue;
+        scenes[i].gen(frames);
+        write_header(scenes[i].name, cmdline, frames);
+        write_packets(scenes[i].name, packet_frames);
+        return 0;
+    }
+    fprintf(stderr, "Unknown scene %s\n", argv[1]);
+    return 1;
+}
@@ -0,0 +1,9 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+// Host stand-in for the platform files Vitis generates. There are no caches or
+// UART to set up on the host.
+static inline void init_platform(void) {}
+static inline void cleanup_platform(void) {}
+
+#endif // PLATFORM_H
@@ -0,0 +1,239 @@
+// Software-in-the-loop build of the render loop. main() from
+// hdmi_text_controller.c runs unchanged on the host, and its register accesses
+// go over AXI-Lite into a Verilator model of hdmi_text_controller_v1_0_AXI, so a
+// real camera path can be timed end to end without the board or xsim.
+//
+// The host stand-ins for the BSP headers in this directory point
+// XPAR_HDMI_TEXT_CONTROLLER_0_AXI_BASEADDR at sil_window. Xil_Out32/Xil_In32
+// become AXI-Lite transactions. Packets copied into the command ring only land
+// in sil_window, and are written to the model when the doorbell is rung, which
+// is the only point the hardware may look at them anyway.
+//
+// Time only passes on the bus: the CPU side of a frame is free, so the frame
+// rate printed is what the IP can sustain. Use the profiler (HDMI_PROFILE) for
+// the MicroBlaze's share. The VGA timing (vga_controller) is generated here.
+//
+// Build with make -C sim_sources sil, which uses the behavioral models of the
+// Xilinx IP in sim_sources/models, then run sim_sources/obj_dir/sil/sil [frames].
+// The firmware is compiled as C on its own with main renamed to
+// sil_firmware_main, and linked in.
+//
+// --gc-sections drops GetDriverandReport() and with it the USB driver, which
+// isn't part of the model.
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+
+#include "verilated.h"
+#include "Vhdmi_text_controller_v1_0_AXI.h"
+
+#include "xil_io.h"
+#include "xparameters.h"
+
+extern "C" int sil_firmware_main(void);
+
+u8 sil_window[SIL_WINDOW_BYTES];
+
+// From hdmi_text_controller.h, which can't be included twice in one program
+#define REG_RING_HEAD (6 * 4)
+#define REG_FRAME_TAG (12 * 4)
+#define REG_PERF_CTRL (16 * 4)
+#define REG_PERF_CYC_CLEAR_BUF (17 * 4)
+#define REG_PERF_CYC_RASTERIZE (20 * 4)
+#define REG_PERF_PIX_INSIDE (25 * 4)
+#define REG_PERF_CYCLES_LO (30 * 4)
+#define PERF_SNAPSHOT_RESET 0x3
+#define RING_OFFSET 0x2000
+#define RING_SLOTS 256
+#define RING_SLOT_BYTES 32
+#define PACKET_WORDS 6
+#define OP_STRIP 0x07
+#define OP_FAN 0x08
+#define VERTEX_CMD_FIRST_WORD 3
+
+#define CLOCK_HZ 100000000.0
+// 640x480 VGA: 800 x 525 pixel clocks at 25 MHz, vsync low on lines 490 and 491
+#define VGA_H_TOTAL 800
+#define VGA_V_TOTAL 525
+#define VGA_VS_START 490
+#define VGA_VS_END 492
+#define VSYNC_CYCLES (VGA_H_TOTAL * VGA_V_TOTAL * 4)
+// Give up if nothing new reaches the screen for this many vsyncs
+#define STALL_VSYNCS 16
+
+static std::unique_ptr<VerilatedContext> ctx;
+static std::unique_ptr<Vhdmi_text_controller_v1_0_AXI> top;
+static uint64_t cycles;
+static unsigned hc, vc;
+
+// Frames to run, and where the measurement started
+static uint32_t frames_wanted = 300;
+static uint32_t first_tag, last_tag;
+static uint64_t first_cycle, last_new_cycle;
+static int measuring;
+static clock_t wall_start;
+
+// One 100 MHz clock. The VGA counters step every fourth cycle.
+static void tick() {
+    top->S_AXI_ACLK = 1;
+    top->eval();
+    top->S_AXI_ACLK = 0;
+    cycles++;
+    if (cycles % 4 == 0 && ++hc == VGA_H_TOTAL) {
+        hc = 0;
+        if (++vc == VGA_V_TOTAL)
+            vc = 0;
+    }
+    top->drawX = hc;
+    top->drawY = vc;
+    top->vsync = !(vc >= VGA_VS_START && vc < VGA_VS_END);
+    top->eval();
+}
+
+// Same handshake as axi_write in axi_tb.sv: address and data together, then
+// wait for the response.
+static void axi_write(uint32_t addr, uint32_t data) {
+    top->S_AXI_AWADDR = addr;
+    top->S_AXI_WDATA = data;
+    top->S_AXI_WSTRB = 0xF;
+    top->S_AXI_AWVALID = 1;
+    top->S_AXI_WVALID = 1;
+    top->S_AXI_BREADY = 1;
+    top->eval();
+    while (top->S_AXI_AWVALID || top->S_AXI_WVALID) {
+        bool aw = top->S_AXI_AWREADY, w = top->S_AXI_WREADY;
+        tick();
+        if (aw)
+            top->S_AXI_AWVALID = 0;
+        if (w)
+            top->S_AXI_WVALID = 0;
+        top->eval();
+    }
+    while (!top->S_AXI_BVALID)
+        tick();
+    tick();
+    top->S_AXI_BREADY = 0;
+    top->eval();
+}
+
+static uint32_t axi_read(uint32_t addr) {
+    top->S_AXI_ARADDR = addr;
+    top->S_AXI_ARVALID = 1;
+    top->S_AXI_RREADY = 1;
+    top->eval();
+    while (!top->S_AXI_ARREADY)
+        tick();
+    tick();
+    top->S_AXI_ARVALID = 0;
+    top->eval();
+    while (!top->S_AXI_RVALID)
+        tick();
+    uint32_t data = top->S_AXI_RDATA;
+    tick();
+    top->S_AXI_RREADY = 0;
+    top->eval();
+    return data;
+}
+
+static uint32_t window_word(uint32_t offset) {
+    return *(volatile u32 *)&sil_window[offset];
+}
+
+static void report() {
+    double sim_s = (cycles - first_cycle) / CLOCK_HZ;
+    double wall_s = (double)(clock() - wall_start) / CLOCKS_PER_SEC;
+    uint32_t frames = last_tag - first_tag;
+
+    axi_write(REG_PERF_CTRL, PERF_SNAPSHOT_RESET);
+    uint32_t total = axi_read(REG_PERF_CYCLES_LO);
+    uint32_t clear = axi_read(REG_PERF_CYC_CLEAR_BUF);
+    uint32_t raster = axi_read(REG_PERF_CYC_RASTERIZE);
+    uint32_t inside = axi_read(REG_PERF_PIX_INSIDE);
+
+    printf("\n%u frames on screen in %.3f s simulated (%.1f s wall)\n", frames, sim_s, wall_s);
+    printf("%.2f fps, %.0f cycles per frame\n", frames / sim_s, (cycles - first_cycle) / (double)frames);
+    printf("clear_buf %.1f%%, rasterize %.1f%% of cycles, %.0f pixels drawn per frame\n",
+           100.0 * clear / total, 100.0 * raster / total, (double)inside / frames);
+}
+
+// Called on every FRAME_TAG read, which main() does once a frame while it
+// waits to stay one frame ahead of the screen.
+static void frame_tag_seen(uint32_t tag) {
+    if (!measuring) {
+        // Time from the first frame on screen, after the start-up transient
+        if (tag == 0)
+            return;
+        measuring = 1;
+        first_tag = last_tag = tag;
+        first_cycle = last_new_cycle = cycles;
+        wall_start = clock();
+        axi_write(REG_PERF_CTRL, PERF_SNAPSHOT_RESET);
+        return;
+    }
+    if (tag != last_tag) {
+        last_tag = tag;
+        last_new_cycle = cycles;
+    }
+    if (tag - first_tag >= frames_wanted) {
+        report();
+        top->final();
+        exit(0);
+    }
+}
+
+extern "C" void Xil_Out32(UINTPTR Addr, u32 Value) {
+    uint32_t offset = Addr - (UINTPTR)sil_window;
+    if (offset == REG_RING_HEAD) {
+        // Everything main() has put in the ring since the last doorbell. STRIP and
+        // FAN only have words 3-5 written, the rest of the slot is stale.
+        static uint32_t flushed = 0;
+        for (; flushed != Value; flushed++) {
+            uint32_t slot = RING_OFFSET + (flushed % RING_SLOTS) * RING_SLOT_BYTES;
+            uint32_t op = window_word(slot + 16) >> 24;
+            int first = (op == OP_STRIP || op == OP_FAN) ? VERTEX_CMD_FIRST_WORD : 0;
+            for (int w = first; w < PACKET_WORDS; w++)
+                axi_write(slot + 4 * w, window_word(slot + 4 * w));
+        }
+    }
+    axi_write(offset, Value);
+}
+
+extern "C" u32 Xil_In32(UINTPTR Addr) {
+    uint32_t offset = Addr - (UINTPTR)sil_window;
+    uint32_t data = axi_read(offset);
+    if (offset == REG_FRAME_TAG)
+        frame_tag_seen(data);
+    if (cycles - (measuring ? last_new_cycle : 0) > (uint64_t)STALL_VSYNCS * VSYNC_CYCLES) {
+        fprintf(stderr, "No new frame on screen for %d vsyncs, stopping at cycle %llu\n", STALL_VSYNCS,
+                (unsigned long long)cycles);
+        top->final();
+        exit(1);
+    }
+    return data;
+}
+
+int main(int argc, char **argv) {
+    ctx.reset(new VerilatedContext);
+    ctx->commandArgs(argc, argv);
+    top.reset(new Vhdmi_text_controller_v1_0_AXI{ctx.get()});
+    if (argc > 1 && atoi(argv[1]) > 0)
+        frames_wanted = atoi(argv[1]);
+
+    // Nothing on the AXI4-Stream port. The external memory ports never answer,
+    // so leave FB_EXTERNAL at 0.
+    top->S_AXIS_TVALID = 0;
+    top->S_AXI_AWVALID = 0;
+    top->S_AXI_WVALID = 0;
+    top->S_AXI_BREADY = 0;
+    top->S_AXI_ARVALID = 0;
+    top->S_AXI_RREADY = 0;
+    top->S_AXI_ARESETN = 0;
+    for (int i = 0; i < 16; i++)
+        tick();
+    top->S_AXI_ARESETN = 1;
+    tick();
+
+    return sil_firmware_main();
+}
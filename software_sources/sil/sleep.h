@@ -0,0 +1,7 @@
+#ifndef SLEEP_H
+#define SLEEP_H
+
+// Host stand-in for the BSP header.
+#include <unistd.h>
+
+#endif // SLEEP_H
@@ -0,0 +1,10 @@
+#ifndef XGPIO_H
+#define XGPIO_H
+
+// Host stand-in for the BSP header. main() doesn't use the GPIO, this only
+// brings in what the real header includes.
+#include "xil_types.h"
+#include "xstatus.h"
+#include "xil_printf.h"
+
+#endif // XGPIO_H
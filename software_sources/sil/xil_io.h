@@ -0,0 +1,19 @@
+#ifndef XIL_IO_H
+#define XIL_IO_H
+
+// Host stand-in for the BSP header. Register accesses go to the Verilator
+// model of the IP, see sil_main.cpp.
+#include "xil_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+u32 Xil_In32(UINTPTR Addr);
+void Xil_Out32(UINTPTR Addr, u32 Value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // XIL_IO_H
@@ -0,0 +1,9 @@
+#ifndef XIL_PRINTF_H
+#define XIL_PRINTF_H
+
+// Host stand-in for the BSP header.
+#include <stdio.h>
+
+#define xil_printf printf
+
+#endif // XIL_PRINTF_H
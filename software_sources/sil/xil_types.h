@@ -0,0 +1,18 @@
+#ifndef XIL_TYPES_H
+#define XIL_TYPES_H
+
+// Host stand-in for the BSP header, for the software-in-the-loop build (see
+// sil_main.cpp).
+#include <stdint.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef uintptr_t UINTPTR;
+typedef intptr_t INTPTR;
+
+#endif // XIL_TYPES_H
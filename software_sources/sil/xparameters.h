@@ -0,0 +1,25 @@
+#ifndef XPARAMETERS_H
+#define XPARAMETERS_H
+
+// Host stand-in for the BSP header. The IP's address space is a host array, so
+// the packets main() copies into the command ring land somewhere real.
+// sil_main.cpp forwards them to the model when the doorbell is rung.
+#include "xil_types.h"
+
+#if defined(HDMI_USE_AXI_DMA) || defined(HDMI_USE_LITE_REGS)
+#error "The software-in-the-loop build only supports the command ring"
+#endif
+
+// 2^C_S_AXI_ADDR_WIDTH bytes
+#define SIL_WINDOW_BYTES 0x4000
+
+#ifdef __cplusplus
+extern "C"
+#else
+extern
+#endif
+u8 sil_window[SIL_WINDOW_BYTES];
+
+#define XPAR_HDMI_TEXT_CONTROLLER_0_AXI_BASEADDR ((UINTPTR)sil_window)
+
+#endif // XPARAMETERS_H
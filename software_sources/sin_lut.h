@@ -0,0 +1,86 @@
+#ifndef SIN_LUT_H
+#define SIN_LUT_H
+
+// Table sin and cos used for the camera. The firmware and the testbench
+// reference both include this, so reference frames are built from the same
+// angles the firmware draws and a difference against the hardware output is
+// down to the rasterizer, not to the trig.
+
+#include <stdint.h>
+
+// Sin lookup table generated by AI
+static const float sin_lut[256] = {
+    0.000000f,  0.024541f,  0.049068f,  0.073565f,  0.098017f,  0.122411f,
+    0.146730f,  0.170962f,  0.195090f,  0.219101f,  0.242980f,  0.266713f,
+    0.290285f,  0.313682f,  0.336890f,  0.359895f,  0.382683f,  0.405241f,
+    0.427555f,  0.449611f,  0.471397f,  0.492898f,  0.514103f,  0.534998f,
+    0.555570f,  0.575808f,  0.595699f,  0.615232f,  0.634393f,  0.653173f,
+    0.671559f,  0.689541f,  0.707107f,  0.724247f,  0.740951f,  0.757209f,
+    0.773010f,  0.788346f,  0.803208f,  0.817585f,  0.831470f,  0.844854f,
+    0.857729f,  0.870087f,  0.881921f,  0.893224f,  0.903989f,  0.914210f,
+    0.923880f,  0.932993f,  0.941544f,  0.949528f,  0.956940f,  0.963776f,
+    0.970031f,  0.975702f,  0.980785f,  0.985278f,  0.989177f,  0.992480f,
+    0.995185f,  0.997290f,  0.998795f,  0.999699f,  1.000000f,  0.999699f,
+    0.998795f,  0.997290f,  0.995185f,  0.992480f,  0.989177f,  0.985278f,
+    0.980785f,  0.975702f,  0.970031f,  0.963776f,  0.956940f,  0.949528f,
+    0.941544f,  0.932993f,  0.923880f,  0.914210f,  0.903989f,  0.893224f,
+    0.881921f,  0.870087f,  0.857729f,  0.844854f,  0.831470f,  0.817585f,
+    0.803208f,  0.788346f,  0.773010f,  0.757209f,  0.740951f,  0.724247f,
+    0.707107f,  0.689541f,  0.671559f,  0.653173f,  0.634393f,  0.615232f,
+    0.595699f,  0.575808f,  0.555570f,  0.534998f,  0.514103f,  0.492898f,
+    0.471397f,  0.449611f,  0.427555f,  0.405241f,  0.382683f,  0.359895f,
+    0.336890f,  0.313682f,  0.290285f,  0.266713f,  0.242980f,  0.219101f,
+    0.195090f,  0.170962f,  0.146730f,  0.122411f,  0.098017f,  0.073565f,
+    0.049068f,  0.024541f,  0.000000f,  -0.024541f, -0.049068f, -0.073565f,
+    -0.098017f, -0.122411f, -0.146730f, -0.170962f, -0.195090f, -0.219101f,
+    -0.242980f, -0.266713f, -0.290285f, -0.313682f, -0.336890f, -0.359895f,
+    -0.382683f, -0.405241f, -0.427555f, -0.449611f, -0.471397f, -0.492898f,
+    -0.514103f, -0.534998f, -0.555570f, -0.575808f, -0.595699f, -0.615232f,
+    -0.634393f, -0.653173f, -0.671559f, -0.689541f, -0.707107f, -0.724247f,
+    -0.740951f, -0.757209f, -0.773010f, -0.788346f, -0.803208f, -0.817585f,
+    -0.831470f, -0.844854f, -0.857729f, -0.870087f, -0.881921f, -0.893224f,
+    -0.903989f, -0.914210f, -0.923880f, -0.932993f, -0.941544f, -0.949528f,
+    -0.956940f, -0.963776f, -0.970031f, -0.975702f, -0.980785f, -0.985278f,
+    -0.989177f, -0.992480f, -0.995185f, -0.997290f, -0.998795f, -0.999699f,
+    -1.000000f, -0.999699f, -0.998795f, -0.997290f, -0.995185f, -0.992480f,
+    -0.989177f, -0.985278f, -0.980785f, -0.975702f, -0.970031f, -0.963776f,
+    -0.956940f, -0.949528f, -0.941544f, -0.932993f, -0.923880f, -0.914210f,
+    -0.903989f, -0.893224f, -0.881921f, -0.870087f, -0.857729f, -0.844854f,
+    -0.831470f, -0.817585f, -0.803208f, -0.788346f, -0.773010f, -0.757209f,
+    -0.740951f, -0.724247f, -0.707107f, -0.689541f, -0.671559f, -0.653173f,
+    -0.634393f, -0.615232f, -0.595699f, -0.575808f, -0.555570f, -0.534998f,
+    -0.514103f, -0.492898f, -0.471397f, -0.449611f, -0.427555f, -0.405241f,
+    -0.382683f, -0.359895f, -0.336890f, -0.313682f, -0.290285f, -0.266713f,
+    -0.242980f, -0.219101f, -0.195090f, -0.170962f, -0.146730f, -0.122411f,
+    -0.098017f, -0.073565f, -0.049068f, -0.024541f
+
+};
+
+#define LUT_SIZE 256
+#define LUT_SIZE_F 256.0f
+
+// Fast sin approximation with linear interpolation
+// Generated by AI
+static float sin_lookup(float radians) {
+  // Normalize to [0, 2π)
+  while (radians < 0.0f)
+    radians += 6.283185f;
+  while (radians >= 6.283185f)
+    radians -= 6.283185f;
+
+  // Map to table index (floating point)
+  float index_f = (radians / 6.283185f) * LUT_SIZE_F;
+  uint32_t index0 = (uint32_t)index_f;
+  uint32_t index1 = (index0 + 1) & (LUT_SIZE - 1); // Wrap around
+
+  // Linear interpolation
+  float frac = index_f - (float)index0;
+  return sin_lut[index0] + frac * (sin_lut[index1] - sin_lut[index0]);
+}
+
+static float cos_lookup(float radians) {
+  // cos(x) = sin(x + π/2)
+  return sin_lookup(radians + 1.570796f);
+}
+
+#endif // SIN_LUT_H
@@ -4,11 +4,31 @@
 #include <stdint.h>
 #include <math.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "profiler.h"
+#include "sin_lut.h"
 
 // Screen dimensions
 #define SCREEN_WIDTH 320
 #define SCREEN_HEIGHT 240
 
+#ifdef HDMI_PROFILE
+#define TB_FRAMES PROF_PRINT_FRAMES
+#else
+#define TB_FRAMES 1
+#endif
+
+// Build with -DHDMI_SCENE='"scene_<name>.h"' to draw a scene from scenegen.c
+// along its camera path instead of the Cornell box
+#ifdef HDMI_SCENE
+#include HDMI_SCENE
+#define MESH scene_mesh
+#define MESH_TRIANGLE_COUNT scene_triangle_count
+#else
 // Cornell Box mesh data
 static const uint8_t cornell_box[][10] = {
     // Floor (white)
@@ -54,6 +74,9 @@ static const uint8_t cornell_box[][10] = {
     {204,0,179,   204,128,230,   204,0,230,   0xFF},
 };
 #define cornell_box_triangle_count (sizeof(cornell_box) / sizeof(cornell_box[0]))
+#define MESH cornell_box
+#define MESH_TRIANGLE_COUNT cornell_box_triangle_count
+#endif
 
 // Framebuffer (ASCII art representation)
 char framebuffer[SCREEN_HEIGHT][SCREEN_WIDTH];
@@ -143,11 +166,23 @@ void display_framebuffer() {
     }
 }
 
+// Writes a screen sized RGB image as a PPM in one go. Returns 0 on failure.
+static int write_ppm(const char *filename, const uint8_t *rgb) {
+    FILE *f = fopen(filename, "wb");
+    if (!f) {
+        perror(filename);
+        return 0;
+    }
+    fprintf(f, "P6\n%d %d\n255\n", SCREEN_WIDTH, SCREEN_HEIGHT);
+    size_t bytes = (size_t)SCREEN_WIDTH * SCREEN_HEIGHT * 3;
+    int ok = fwrite(rgb, 1, bytes, f) == bytes;
+    ok &= fclose(f) == 0;
+    return ok;
+}
+
 // Save as PPM image
 void save_ppm(const char* filename) {
-    FILE* f = fopen(filename, "wb");
-    fprintf(f, "P6\n%d %d\n255\n", SCREEN_WIDTH, SCREEN_HEIGHT);
-    
+    static uint8_t rgb[SCREEN_HEIGHT][SCREEN_WIDTH][3];
     for (int y = 0; y < SCREEN_HEIGHT; y++) {
         for (int x = 0; x < SCREEN_WIDTH; x++) {
             char c = framebuffer[y][x];
@@ -157,25 +192,705 @@ void save_ppm(const char* filename) {
             else if (c == 'G') { g = 255; }   // Green
             else if (c != ' ') { r = g = b = 200; }  // White/gray
             
-            fputc(r, f); fputc(g, f); fputc(b, f);
+            rgb[y][x][0] = r; rgb[y][x][1] = g; rgb[y][x][2] = b;
         }
     }
-    fclose(f);
-    printf("Saved to %s\n", filename);
+    if (write_ppm(filename, &rgb[0][0][0]))
+        printf("Saved to %s\n", filename);
 }
 
-int main() {
-    // Camera parameters
-    float cam_x = 127.5f, cam_y = 127.5f, cam_z = -20.0f;
-    float yaw = 3.1415f / 12;
-    
-    printf("3D Renderer Test\n");
-    printf("================\n");
-    printf("Camera: (%.1f, %.1f, %.1f), Yaw: %.2f rad\n\n", cam_x, cam_y, cam_z, yaw);
-    
+// ===== CYCLE MODEL =====
+// Cycle-approximate model of the IP: the pipeline controller, edge_eq_bb and
+// the per-pixel state sequence of rasterizer.sv, at the 100 MHz AXI clock.
+// Run with --model to estimate cycles per triangle and per frame along the
+// firmware's camera path, which takes seconds instead of hours in xsim.
+// --model-trace prints the first frame per triangle in the same columns as the
+// trace CSV from axi_tb (pipeline_axi_trace.csv), so the two can be compared.
+// The per-state cycle counts below are read off the RTL and have not been
+// checked against a simulation, so the figures are estimates until they are.
+
+// Controller cycles per command, not counting the rasterizer:
+// wait_tri (pop) + decode + 3 in calc_edge (edge_start, ready_s1, edge_done)
+#define MODEL_POP_CYCLES 1
+#define MODEL_DECODE_CYCLES 1
+#define MODEL_EDGE_CYCLES 3
+// Rasterizer: halt (sees start) + edge_prods + edge_eqs, and the cycle the
+// controller sees rasterizer_done
+#define MODEL_RASTER_SETUP_CYCLES 3
+#define MODEL_RASTER_DONE_CYCLES 1
+// row_setup and row_inc
+#define MODEL_ROW_CYCLES 2
+// inside_check + col_inc for a pixel outside the triangle. Inside adds
+// barycentric, barycentric_normalize, comp_z, buf_addressing, read_zbuf, write.
+#define MODEL_PIXEL_OUT_CYCLES 2
+#define MODEL_PIXEL_IN_CYCLES 8
+// Bounding boxes up to 4x4 take the small triangle path: calc_edge ends with
+// ready_s1, then halt and the small_next that finds no pixels left, and each
+// pixel inside is small_next, barycentric_normalize, comp_z, buf_addressing,
+// read_zbuf, write, col_inc. Pixels outside cost nothing.
+#define MODEL_SMALL_EDGE_CYCLES 2
+#define MODEL_SMALL_SETUP_CYCLES 2
+#define MODEL_SMALL_PIXEL_CYCLES 7
+// An 8 pixel span of a tile row inside the triangle: inside_check and the 4
+// math states for its first pixel, the same 4 once per triangle for dzdx, then
+// span_px for a pixel nearer than its tile's depth bound or span_px, span_read,
+// span_write for any other, and col_inc at the end.
+#define MODEL_SPAN_SETUP_CYCLES 5
+#define MODEL_SPAN_DZ_CYCLES 4
+#define MODEL_SPAN_FAST_CYCLES 1
+#define MODEL_SPAN_READ_CYCLES 3
+#define MODEL_SPAN_END_CYCLES 1
+// tile_wait on the first pixel of an 8x8 tile in a frame: the tile engine writes
+// 64 pixels, or just sets the tile bit if the scanout already cleared the buffer
+#define MODEL_TILE_DIRTY_CYCLES 66
+#define MODEL_TILE_CLEAN_CYCLES 2
+// clear_buf is one cycle, except every third frame when the z epoch wraps and
+// the whole z buffer is swept
+#define MODEL_SWEEP_CYCLES (320 * 240)
+// Ring fetcher: ring_idle + 6 reads + the FIFO push, and 2 more cycles before
+// the controller sees the packet (FIFO empty flag, then triangle_valid)
+#define MODEL_RING_CYCLES 8
+#define MODEL_FIFO_LATENCY 2
+#define MODEL_FIFO_DEPTH 32
+// 800 x 525 pixel clocks at 25 MHz per frame
+#define MODEL_VSYNC_CYCLES (800 * 525 * 4)
+#define MODEL_CLOCK_HZ 100000000
+// Triangles per frame, plus FENCE and SWAP
+#define MODEL_MAX_CMDS (MESH_TRIANGLE_COUNT + 2)
+
+// A triangle as the hardware sees it, after the packet's bit widths
+typedef struct {
+    uint16_t x[3]; // 9 bits
+    uint16_t y[3]; // 8 bits
+    uint16_t z[3];
+    uint8_t color;
+    uint32_t inv_area; // 8.24
+} HwTri;
+
+// edge_eq_bb's outputs, and the bounding box after the scissor
+typedef struct {
+    int32_t a[3], b[3], c[3];
+    int bbxi, bbxf, bbyi, bbyf;
+} HwEdges;
+
+typedef struct {
+    int64_t setup;  // decode to rasterizer start, like the trace
+    int64_t raster; // cycles in the rasterize state
+    int64_t visited;
+    int64_t inside;
+    int culled;
+} ModelTri;
+
+// Sign extends the low bits of v, to match a fixed width signal
+static int64_t sext(int64_t v, int bits) {
+    int64_t m = (int64_t)1 << (bits - 1);
+    v &= ((int64_t)1 << bits) - 1;
+    return (v ^ m) - m;
+}
+
+static int imin3(int a, int b, int c) { int m = a < b ? a : b; return m < c ? m : c; }
+static int imax3(int a, int b, int c) { int m = a > b ? a : b; return m > c ? m : c; }
+
+// Projects the mesh the way main() in hdmi_text_controller.c does, down to the
+// packet fields the hardware reads. Returns the number of triangles sent.
+static int model_project(const float mvp[16], HwTri *out) {
+    int n = 0;
+    for (int i = 0; i < (int)MESH_TRIANGLE_COUNT; i++) {
+        float clip[3][4];
+        for (int j = 0; j < 3; j++) {
+            float world[4] = {(float)MESH[i][3 * j], (float)MESH[i][3 * j + 1],
+                              (float)MESH[i][3 * j + 2], 1.0f};
+            matvec4x1(mvp, world, clip[j]);
+        }
+        int all_left = 1, all_right = 1, all_bottom = 1, all_top = 1, all_near = 1, all_far = 1;
+        for (int j = 0; j < 3; j++) {
+            all_left &= clip[j][0] < -clip[j][3];
+            all_right &= clip[j][0] > clip[j][3];
+            all_bottom &= clip[j][1] < -clip[j][3];
+            all_top &= clip[j][1] > clip[j][3];
+            all_near &= clip[j][2] < 0;
+            all_far &= clip[j][2] > clip[j][3];
+        }
+        if (all_left || all_right || all_bottom || all_top || all_near || all_far)
+            continue;
+        if (clip[0][3] <= 0.0001f || clip[1][3] <= 0.0001f || clip[2][3] <= 0.0001f)
+            continue;
+        uint32_t x[3], y[3];
+        for (int j = 0; j < 3; j++) {
+            // The firmware converts to uint32_t, off-screen vertices wrap
+            x[j] = (uint32_t)(int32_t)((clip[j][0] / clip[j][3] + 1.0f) * 160.0f);
+            y[j] = (uint32_t)(int32_t)((1.0f - clip[j][1] / clip[j][3]) * 120.0f);
+            out[n].x[j] = x[j] & 0x1FF;
+            out[n].y[j] = y[j] & 0xFF;
+            out[n].z[j] = (uint16_t)(int32_t)(clip[j][2] / clip[j][3] * 255.0f);
+        }
+        // Same unsigned arithmetic as the firmware
+        float r_area = 2.0f / (x[0] * (y[1] - y[2]) + x[1] * (y[2] - y[0]) + x[2] * (y[0] - y[1]));
+        out[n].inv_area = (uint32_t)(int32_t)(r_area * (1 << 24));
+        out[n].color = MESH[i][9];
+        n++;
+    }
+    return n;
+}
+
+// edge_eq_bb, with its signal widths, and the scissor (full screen at
+// 320x240). Returns 0 if the bounding box is empty and the rasterizer is
+// skipped.
+static int hw_edges(const HwTri *t, HwEdges *h) {
+    // The products are 17 bit signed
+    for (int k = 0; k < 3; k++) {
+        int i = k, j = (k + 1) % 3;
+        h->a[k] = (int32_t)sext((int64_t)t->y[i] - t->y[j], 10);
+        h->b[k] = (int32_t)sext((int64_t)t->x[j] - t->x[i], 10);
+        h->c[k] = (int32_t)sext(sext((int64_t)t->x[i] * t->y[j], 17) - sext((int64_t)t->x[j] * t->y[i], 17), 18);
+    }
+    h->bbxi = imin3(t->x[0], t->x[1], t->x[2]);
+    h->bbxf = imax3(t->x[0], t->x[1], t->x[2]);
+    h->bbyi = imin3(t->y[0], t->y[1], t->y[2]);
+    h->bbyf = imax3(t->y[0], t->y[1], t->y[2]);
+    if (h->bbxi > 320) h->bbxi = 320;
+    if (h->bbxf > 320) h->bbxf = 320;
+    if (h->bbxf > 319) h->bbxf = 319;
+    if (h->bbyf > 239) h->bbyf = 239;
+    return h->bbxi <= h->bbxf && h->bbyi <= h->bbyf;
+}
+
+// The rasterizer's edge values at the top left of the bounding box (edge_eqs)
+static void hw_edge_start(const HwEdges *h, int32_t e[3]) {
+    for (int k = 0; k < 3; k++)
+        e[k] = (int32_t)sext((int64_t)h->a[k] * h->bbxi + (int64_t)h->b[k] * h->bbyi + h->c[k], 22);
+}
+
+// z_calc[31:16] for the edge values e, as the reference rasterizer does it
+static uint32_t model_z(const HwTri *t, const int64_t e[3]) {
+    uint32_t z = 0;
+    for (int k = 0; k < 3; k++)
+        z += (uint32_t)e[k] * t->inv_area * (uint32_t)(int16_t)t->z[k];
+    return z >> 16;
+}
+
+// One DRAW_TRI through calc_edge and the rasterizer. tile_valid holds the
+// lazy clear bits of the draw buffer (40 x 30) and tile_zmin the depth bound
+// of each tile, both are updated. Only pixels that pass the depth test lower a
+// bound, but one that fails was at least the stored depth, so taking the min
+// over every pixel inside with a z below 256 gives the same bound. Inside a
+// span the bound a pixel is tested against is one pixel stale, as in the
+// rasterizer. That only decides fast or read, and no triangle writes a pixel
+// twice, so the pixel it misses is never the one being tested.
+static void model_triangle(const HwTri *t, uint8_t *tile_valid, uint8_t *tile_zmin, int clean, ModelTri *m) {
+    HwEdges h;
+    memset(m, 0, sizeof(*m));
+    int small = imax3(t->x[0], t->x[1], t->x[2]) - imin3(t->x[0], t->x[1], t->x[2]) < 4 &&
+                imax3(t->y[0], t->y[1], t->y[2]) - imin3(t->y[0], t->y[1], t->y[2]) < 4;
+    m->setup = MODEL_DECODE_CYCLES + (small ? MODEL_SMALL_EDGE_CYCLES : MODEL_EDGE_CYCLES);
+    if (!hw_edges(t, &h)) {
+        m->culled = 1;
+        return;
+    }
+
+    int64_t cycles = (small ? MODEL_SMALL_SETUP_CYCLES : MODEL_RASTER_SETUP_CYCLES) + MODEL_RASTER_DONE_CYCLES;
+    int32_t e[3];
+    int dz_ready = 0;
+    hw_edge_start(&h, e);
+    for (int y = h.bbyi; y <= h.bbyf; y++) {
+        int64_t er[3] = {e[0], e[1], e[2]};
+        if (!small)
+            cycles += MODEL_ROW_CYCLES;
+        for (int x = h.bbxi; x <= h.bbxf; x++) {
+            int inside = er[0] >= 0 && er[1] >= 0 && er[2] >= 0;
+            uint8_t *tile = &tile_valid[(y >> 3) * 40 + (x >> 3)];
+            uint8_t *zmin = &tile_zmin[(y >> 3) * 40 + (x >> 3)];
+            if (!small && inside && (x & 7) == 0 && x + 7 <= h.bbxf && er[0] + 7 * h.a[0] >= 0 &&
+                er[1] + 7 * h.a[1] >= 0 && er[2] + 7 * h.a[2] >= 0) {
+                cycles += MODEL_SPAN_SETUP_CYCLES + MODEL_SPAN_END_CYCLES + (dz_ready ? 0 : MODEL_SPAN_DZ_CYCLES);
+                dz_ready = 1;
+                if (!*tile) {
+                    cycles += clean ? MODEL_TILE_CLEAN_CYCLES : MODEL_TILE_DIRTY_CYCLES;
+                    *tile = 1;
+                }
+                // Each span pixel reads the bound in the cycle the pixel before
+                // it is written, so it does not see that pixel's depth yet
+                uint32_t pending = 256;
+                for (int i = 0; i < 8; i++) {
+                    uint32_t z = model_z(t, er);
+                    cycles += z < *zmin ? MODEL_SPAN_FAST_CYCLES : MODEL_SPAN_READ_CYCLES;
+                    if (pending < *zmin)
+                        *zmin = (uint8_t)pending;
+                    pending = z;
+                    if (i < 7)
+                        for (int k = 0; k < 3; k++)
+                            er[k] = sext(er[k] + h.a[k], 22);
+                }
+                if (pending < *zmin)
+                    *zmin = (uint8_t)pending;
+                m->visited += 8;
+                m->inside += 8;
+                x += 7;
+            } else if (inside) {
+                m->visited++;
+                m->inside++;
+                cycles += small ? MODEL_SMALL_PIXEL_CYCLES : MODEL_PIXEL_IN_CYCLES;
+                if (!*tile) {
+                    cycles += clean ? MODEL_TILE_CLEAN_CYCLES : MODEL_TILE_DIRTY_CYCLES;
+                    *tile = 1;
+                }
+                uint32_t z = model_z(t, er);
+                if (z < *zmin)
+                    *zmin = (uint8_t)z;
+            } else if (!small) {
+                m->visited++;
+                cycles += MODEL_PIXEL_OUT_CYCLES;
+            }
+            for (int k = 0; k < 3; k++)
+                er[k] = sext(er[k] + h.a[k], 22);
+        }
+        for (int k = 0; k < 3; k++)
+            e[k] = (int32_t)sext((int64_t)e[k] + h.b[k], 22);
+    }
+    m->raster = cycles;
+}
+
+// One frame in ring mode: clear_buf, the triangles, then FENCE and SWAP. The
+// whole frame is in the ring when the buffers flip. Returns the cycles until
+// the controller reaches wait_swap.
+static int64_t model_frame(const HwTri *tris, int n, int sweep, int clean, FILE *trace, int frame) {
+    static uint8_t tile_valid[40 * 30];
+    static uint8_t tile_zmin[40 * 30];
+    static int64_t pop_at[MODEL_MAX_CMDS];
+    memset(tile_valid, 0, sizeof(tile_valid));
+    // A new epoch, every bound reads as 0xFF
+    memset(tile_zmin, 0xFF, sizeof(tile_zmin));
+
+    int64_t now = 1 + (sweep ? MODEL_SWEEP_CYCLES : 1);
+    int64_t pushed = 0;
+    for (int k = 0; k < n + 2; k++) {
+        // The ring fetcher runs ahead, until the FIFO is full
+        int64_t push = pushed + MODEL_RING_CYCLES;
+        if (k >= MODEL_FIFO_DEPTH && push <= pop_at[k - MODEL_FIFO_DEPTH])
+            push = pop_at[k - MODEL_FIFO_DEPTH] + 1;
+        pushed = push;
+        if (now < push + MODEL_FIFO_LATENCY)
+            now = push + MODEL_FIFO_LATENCY;
+        pop_at[k] = now;
+        now += MODEL_POP_CYCLES;
+        if (k >= n) {
+            // FENCE and SWAP only decode
+            now += MODEL_DECODE_CYCLES;
+            continue;
+        }
+        ModelTri m;
+        model_triangle(&tris[k], tile_valid, tile_zmin, clean, &m);
+        now += m.setup + m.raster;
+        // No depth test here, every pixel inside counts as written
+        if (trace)
+            fprintf(trace, "%d,%d,%lld,%lld,%lld,%lld,%lld,%d,0,0,0\n", k, frame, (long long)pop_at[k],
+                    (long long)m.setup, (long long)m.raster, (long long)m.visited, (long long)m.inside, m.culled);
+    }
+    return now;
+}
+
+typedef struct {
+    float x, y, z, yaw;
+} CamPose;
+
+// The camera for each frame along the path main() in hdmi_text_controller.c
+// uses, or the scene's camera path.
+static void camera_path(int frames, CamPose *out) {
+#ifndef HDMI_SCENE
+    float theta = 0.0f, dir = 0.5f, r = 100.0f;
+#endif
+    for (int frame = 0; frame < frames; frame++) {
+#ifdef HDMI_SCENE
+        const float *cam = scene_camera_path[frame % scene_camera_frames];
+        out[frame] = (CamPose){cam[0], cam[1], cam[2], cam[3]};
+#else
+        float yaw = theta + (3.1415f / 2);
+        out[frame].x = r * cos_lookup(theta);
+        out[frame].y = 127.5f;
+        out[frame].z = r * sin_lookup(theta);
+        theta += 0.001f;
+        if (yaw >= (3.1415f) / 12 || yaw <= -3.1415f / 12) dir *= -1;
+        out[frame].yaw = yaw + dir;
+#endif
+    }
+}
+
+// Projection times view, as main() builds it
+static void camera_mvp(const CamPose *cam, float mvp[16]) {
+    const float proj_mat[16] = {
+        1.299f,  0.0f,   0.0f,    0.0f,
+        0.0f,    1.732f, 0.0f,    0.0f,
+        0.0f,    0.0f,   1.003f, -1.003f,
+        0.0f,    0.0f,   1.0f,    0.0f
+    };
+    float cos_yaw = cos_lookup(cam->yaw), sin_yaw = sin_lookup(cam->yaw);
+    const float view_mat[16] = {
+        cos_yaw,  0.0f, sin_yaw, -(cos_yaw * cam->x + sin_yaw * cam->z),
+        0.0f,     1.0f, 0.0f,    -cam->y,
+        -sin_yaw, 0.0f, cos_yaw, -(-sin_yaw * cam->x + cos_yaw * cam->z),
+        0.0f,     0.0f, 0.0f,    1.0f
+    };
+    matmul4x4(proj_mat, view_mat, mvp);
+}
+
+// Walks the camera along its path and prints the predicted cycles per frame.
+static int run_model(int frames, int clean, FILE *trace) {
+    static HwTri tris[MODEL_MAX_CMDS];
+    CamPose *path = malloc(frames * sizeof(*path));
+    int64_t total = 0, worst = 0, best = INT64_MAX, shown = 0;
+
+    camera_path(frames, path);
+    if (trace)
+        fprintf(trace, "index,frame,pop_cycle,setup_cycles,raster_cycles,pixels_visited,pixels_written,culled,cut_off,indexed,quad\n");
+    for (int frame = 0; frame < frames; frame++) {
+        float mvp[16];
+        camera_mvp(&path[frame], mvp);
+
+        int n = model_project(mvp, tris);
+        // The z epoch starts at 3 out of reset, so the first frame sweeps
+        int64_t busy = model_frame(tris, n, frame % 3 == 0, clean, frame == 0 ? trace : NULL, frame);
+        // Double buffered: the frame is shown at the first vsync after it is done
+        int64_t shown_at = (busy + MODEL_VSYNC_CYCLES - 1) / MODEL_VSYNC_CYCLES * MODEL_VSYNC_CYCLES;
+        total += busy;
+        shown += shown_at;
+        if (busy > worst) worst = busy;
+        if (busy < best) best = busy;
+        if (frame < 10)
+            printf("frame %d: %d triangles, %lld cycles busy\n", frame, n, (long long)busy);
+    }
+    printf("\n%d frames, busy cycles min %lld avg %lld max %lld\n", frames, (long long)best,
+           (long long)(total / frames), (long long)worst);
+    printf("Rasterizer limit %.1f fps, displayed %.1f fps\n", (double)MODEL_CLOCK_HZ * frames / total,
+           (double)MODEL_CLOCK_HZ * frames / shown);
+    free(path);
+    return 0;
+}
+
+// ===== REFERENCE RASTERIZER =====
+// Bit exact host version of rasterizer.sv, for golden images of what the
+// hardware draws. The edge values wrap at 22 bits like e1_row, and only
+// z_calc[31:16] is kept, so all of the z arithmetic can be done modulo 2^32:
+// w = e * inv_area and z_calc = w1*z1 + w2*z2 + w3*z3 are taken in 32 bit
+// lanes, with the z inputs sign extended like $signed(z1). The 16 bit z is
+// compared against the 8 bit stored depth, and its low byte is written.
+//
+// Pixels of a row are done REF_LANES at a time with AVX2 or SSE4.1 when the
+// compiler targets them (-mavx2, -msse4.1 or -march=native), otherwise one at
+// a time. All three give the same image.
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define REF_LANES 8
+typedef __m256i ref_vec;
+#define ref_set1 _mm256_set1_epi32
+#define ref_lane_index() _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)
+#define ref_add _mm256_add_epi32
+#define ref_mul _mm256_mullo_epi32
+#define ref_or _mm256_or_si256
+#define ref_and _mm256_and_si256
+#define ref_gt _mm256_cmpgt_epi32
+#define ref_sext22(v) _mm256_srai_epi32(_mm256_slli_epi32(v, 10), 10)
+#define ref_high16(v) _mm256_srli_epi32(v, 16)
+#define ref_load_u8(p) _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(p)))
+#define ref_mask(v) _mm256_movemask_ps(_mm256_castsi256_ps(v))
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#define REF_LANES 4
+typedef __m128i ref_vec;
+#define ref_set1 _mm_set1_epi32
+#define ref_lane_index() _mm_setr_epi32(0, 1, 2, 3)
+#define ref_add _mm_add_epi32
+#define ref_mul _mm_mullo_epi32
+#define ref_or _mm_or_si128
+#define ref_and _mm_and_si128
+#define ref_gt _mm_cmpgt_epi32
+#define ref_sext22(v) _mm_srai_epi32(_mm_slli_epi32(v, 10), 10)
+#define ref_high16(v) _mm_srli_epi32(v, 16)
+#define ref_load_u8(p) _mm_cvtepu8_epi32(_mm_cvtsi32_si128(ref_load32(p)))
+#define ref_mask(v) _mm_movemask_ps(_mm_castsi128_ps(v))
+static inline int ref_load32(const uint8_t *p) { int v; memcpy(&v, p, 4); return v; }
+#else
+#define REF_LANES 1
+#endif
+
+// One render target. The buffers are padded so a vector load at the last
+// pixel stays inside them.
+typedef struct {
+    uint8_t color[SCREEN_WIDTH * SCREEN_HEIGHT + 8];
+    uint8_t depth[SCREEN_WIDTH * SCREEN_HEIGHT + 8];
+} RefTarget;
+
+// A frame as it starts with SCANOUT_CLEAR: the color buffer is black and every
+// depth is from an older epoch, which reads as 0xFF.
+static void ref_clear(RefTarget *rt) {
+    memset(rt->color, 0, sizeof(rt->color));
+    memset(rt->depth, 0xFF, sizeof(rt->depth));
+}
+
+static inline uint32_t ref_wrap22(uint32_t v) {
+    return (uint32_t)((int32_t)(v << 10) >> 10);
+}
+
+// Draws one DRAW_TRI. Returns the number of pixels written.
+static int ref_triangle(RefTarget *rt, const HwTri *t) {
+    HwEdges h;
+    if (!hw_edges(t, &h))
+        return 0;
+    int32_t e[3];
+    hw_edge_start(&h, e);
+    // $signed(z1) in barycentric_normalize
+    uint32_t z[3] = {(uint32_t)(int16_t)t->z[0], (uint32_t)(int16_t)t->z[1], (uint32_t)(int16_t)t->z[2]};
+    int written = 0;
+
+    for (int y = h.bbyi; y <= h.bbyf; y++) {
+        uint8_t *color = &rt->color[y * SCREEN_WIDTH];
+        uint8_t *depth = &rt->depth[y * SCREEN_WIDTH];
+        int x = h.bbxi;
+#if REF_LANES > 1
+        ref_vec lane = ref_lane_index();
+        ref_vec ev[3], av[3], zv[3];
+        for (int k = 0; k < 3; k++) {
+            av[k] = ref_set1(h.a[k] * REF_LANES);
+            ev[k] = ref_add(ref_set1(e[k]), ref_mul(ref_set1(h.a[k]), lane));
+            zv[k] = ref_set1((int32_t)z[k]);
+        }
+        ref_vec inv_area = ref_set1((int32_t)t->inv_area);
+        ref_vec end = ref_set1(h.bbxf + 1);
+        ref_vec xv = ref_add(ref_set1(x), lane);
+        ref_vec step = ref_set1(REF_LANES);
+        for (; x <= h.bbxf; x += REF_LANES) {
+            ref_vec e1 = ref_sext22(ev[0]), e2 = ref_sext22(ev[1]), e3 = ref_sext22(ev[2]);
+            // All three >= 0 and left of bbxf
+            ref_vec inside = ref_and(ref_gt(ref_or(ref_or(e1, e2), e3), ref_set1(-1)), ref_gt(end, xv));
+            if (ref_mask(inside)) {
+                ref_vec z_calc = ref_add(ref_add(ref_mul(ref_mul(e1, inv_area), zv[0]),
+                                                 ref_mul(ref_mul(e2, inv_area), zv[1])),
+                                         ref_mul(ref_mul(e3, inv_area), zv[2]));
+                ref_vec zz = ref_high16(z_calc);
+                int pass = ref_mask(ref_and(inside, ref_gt(ref_load_u8(&depth[x]), zz)));
+                if (pass) {
+                    int32_t zs[REF_LANES];
+                    memcpy(zs, &zz, sizeof(zs));
+                    for (int i = 0; i < REF_LANES; i++)
+                        if (pass & (1 << i)) {
+                            depth[x + i] = (uint8_t)zs[i];
+                            color[x + i] = t->color;
+                            written++;
+                        }
+                }
+            }
+            for (int k = 0; k < 3; k++)
+                ev[k] = ref_add(ev[k], av[k]);
+            xv = ref_add(xv, step);
+        }
+#else
+        uint32_t er[3] = {(uint32_t)e[0], (uint32_t)e[1], (uint32_t)e[2]};
+        for (; x <= h.bbxf; x++) {
+            uint32_t e1 = ref_wrap22(er[0]), e2 = ref_wrap22(er[1]), e3 = ref_wrap22(er[2]);
+            if ((int32_t)(e1 | e2 | e3) >= 0) {
+                uint32_t z_calc = e1 * t->inv_area * z[0] + e2 * t->inv_area * z[1] + e3 * t->inv_area * z[2];
+                uint32_t zz = z_calc >> 16;
+                if (zz < depth[x]) {
+                    depth[x] = (uint8_t)zz;
+                    color[x] = t->color;
+                    written++;
+                }
+            }
+            for (int k = 0; k < 3; k++)
+                er[k] += (uint32_t)h.a[k];
+        }
+#endif
+        for (int k = 0; k < 3; k++)
+            e[k] = (int32_t)sext((int64_t)e[k] + h.b[k], 22);
+    }
+    return written;
+}
+
+// FNV-1a over the color buffer, to compare frames without keeping images
+static uint32_t ref_checksum(const RefTarget *rt) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; i++)
+        hash = (hash ^ rt->color[i]) * 16777619u;
+    return hash;
+}
+
+// RGB332 widened the way the HDMI output and the testbench BMPs do it
+// rgb is scratch space for the widened image, so threads can each bring their own.
+static void ref_save_ppm(const RefTarget *rt, const char *filename, uint8_t rgb[SCREEN_WIDTH * SCREEN_HEIGHT * 3]) {
+    for (int i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; i++) {
+        uint8_t c = rt->color[i];
+        rgb[3 * i] = c & 0xE0;
+        rgb[3 * i + 1] = (c << 3) & 0xE0;
+        rgb[3 * i + 2] = (c << 6) & 0xC0;
+    }
+    write_ppm(filename, rgb);
+}
+
+// Renders frames along the camera path with the reference rasterizer and
+// prints a checksum per frame. With a prefix every frame is also written to
+// <prefix>NNNN.ppm.
+static int run_golden(int frames, const char *prefix) {
+    static HwTri tris[MODEL_MAX_CMDS];
+    static RefTarget rt;
+    static uint8_t rgb[SCREEN_WIDTH * SCREEN_HEIGHT * 3];
+    CamPose *path = malloc(frames * sizeof(*path));
+    int64_t pixels = 0;
+
+    camera_path(frames, path);
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int frame = 0; frame < frames; frame++) {
+        float mvp[16];
+        camera_mvp(&path[frame], mvp);
+        int n = model_project(mvp, tris);
+        ref_clear(&rt);
+        int written = 0;
+        for (int i = 0; i < n; i++)
+            written += ref_triangle(&rt, &tris[i]);
+        pixels += written;
+        printf("frame %d: %d triangles, %d pixels written, checksum %08x\n", frame, n, written, ref_checksum(&rt));
+        if (prefix) {
+            char name[256];
+            snprintf(name, sizeof(name), "%s%04d.ppm", prefix, frame);
+            ref_save_ppm(&rt, name, rgb);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double s = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    printf("\n%d frames in %.3f s (%.0f fps, %.1f Mpixels/s written, %d lanes)\n", frames, s, frames / s,
+           pixels / s * 1e-6, REF_LANES);
+    free(path);
+    return 0;
+}
+
+// ===== BATCH RENDERER =====
+// Replays the camera path headless on every core: frames are handed out one
+// at a time to a pool of threads, each with its own render target, which run
+// the firmware's transform and culling and then the reference rasterizer.
+// Reports geometry throughput and cull ratios, for checking the geometry
+// stage on a development machine.
+
+typedef struct {
+    const CamPose *path;
+    int frames;
+    const char *prefix;
+    int raster;
+    atomic_int *next_frame;
+    // Totals for this thread
+    int64_t frames_done, triangles_in, triangles_sent, triangles_empty, pixels;
+    double geometry_s, raster_s, write_s;
+} BatchWorker;
+
+static double elapsed_s(const struct timespec *t0, const struct timespec *t1) {
+    return (t1->tv_sec - t0->tv_sec) + (t1->tv_nsec - t0->tv_nsec) * 1e-9;
+}
+
+static void *batch_worker(void *arg) {
+    BatchWorker *w = arg;
+    HwTri *tris = malloc(MODEL_MAX_CMDS * sizeof(*tris));
+    RefTarget *rt = malloc(sizeof(*rt));
+    uint8_t *rgb = w->prefix ? malloc(SCREEN_WIDTH * SCREEN_HEIGHT * 3) : NULL;
+
+    for (int frame; (frame = atomic_fetch_add(w->next_frame, 1)) < w->frames;) {
+        struct timespec t0, t1, t2;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        float mvp[16];
+        camera_mvp(&w->path[frame], mvp);
+        int n = model_project(mvp, tris);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+
+        if (w->raster) {
+            ref_clear(rt);
+            for (int i = 0; i < n; i++) {
+                HwEdges h;
+                if (!hw_edges(&tris[i], &h))
+                    w->triangles_empty++;
+                else
+                    w->pixels += ref_triangle(rt, &tris[i]);
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t2);
+        w->geometry_s += elapsed_s(&t0, &t1);
+        w->raster_s += elapsed_s(&t1, &t2);
+
+        if (w->raster && w->prefix) {
+            char name[256];
+            snprintf(name, sizeof(name), "%s%04d.ppm", w->prefix, frame);
+            ref_save_ppm(rt, name, rgb);
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            w->write_s += elapsed_s(&t2, &t1);
+        }
+        w->frames_done++;
+        w->triangles_in += MESH_TRIANGLE_COUNT;
+        w->triangles_sent += n;
+    }
+    free(rgb);
+    free(rt);
+    free(tris);
+    return NULL;
+}
+
+// raster 0 stops after the transform and culling, prefix writes PPMs.
+static int run_batch(int frames, int threads, int raster, const char *prefix) {
+    CamPose *path = malloc(frames * sizeof(*path));
+    BatchWorker *workers = calloc(threads, sizeof(*workers));
+    pthread_t *ids = malloc(threads * sizeof(*ids));
+    atomic_int next_frame = 0;
+
+    // The path is built up frame by frame like main() does, so do it up front
+    camera_path(frames, path);
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < threads; i++) {
+        workers[i] = (BatchWorker){
+            .path = path, .frames = frames, .prefix = prefix, .raster = raster, .next_frame = &next_frame};
+        if (pthread_create(&ids[i], NULL, batch_worker, &workers[i]) != 0) {
+            fprintf(stderr, "Could not start thread %d\n", i);
+            return 1;
+        }
+    }
+    BatchWorker sum = {0};
+    for (int i = 0; i < threads; i++) {
+        pthread_join(ids[i], NULL);
+        sum.frames_done += workers[i].frames_done;
+        sum.triangles_in += workers[i].triangles_in;
+        sum.triangles_sent += workers[i].triangles_sent;
+        sum.triangles_empty += workers[i].triangles_empty;
+        sum.pixels += workers[i].pixels;
+        sum.geometry_s += workers[i].geometry_s;
+        sum.raster_s += workers[i].raster_s;
+        sum.write_s += workers[i].write_s;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double wall = elapsed_s(&t0, &t1);
+
+    printf("%lld frames on %d threads in %.3f s, %.0f fps\n", (long long)sum.frames_done, threads, wall,
+           sum.frames_done / wall);
+    printf("Geometry: %.2f M vertices/s, %.2f M triangles/s (%.2f M vertices/s per thread)\n",
+           3.0 * sum.triangles_in / wall * 1e-6, sum.triangles_in / wall * 1e-6,
+           3.0 * sum.triangles_in / sum.geometry_s * 1e-6);
+    printf("Culled: %.1f%% by the frustum and w tests", 100.0 * (sum.triangles_in - sum.triangles_sent) / sum.triangles_in);
+    if (raster)
+        printf(", %.1f%% more with an empty bounding box", 100.0 * sum.triangles_empty / sum.triangles_in);
+    printf("\n");
+    if (raster)
+        printf("Thread time: geometry %.1f%%, raster %.1f%%, PPM writes %.1f%%, %.1f M pixels written/s\n",
+               100.0 * sum.geometry_s / (threads * wall), 100.0 * sum.raster_s / (threads * wall),
+               100.0 * sum.write_s / (threads * wall), sum.pixels / wall * 1e-6);
+    free(ids);
+    free(workers);
+    free(path);
+    return 0;
+}
+
+
+// One frame of the software renderer into the framebuffer, from the camera at
+// (cam_x, cam_y, cam_z) turned by yaw. Gives back the triangle counts.
+static void render_frame(float cam_x, float cam_y, float cam_z, float yaw, int *rendered, int *culled) {
     // View matrix
-    float cos_yaw = cosf(yaw);
-    float sin_yaw = sinf(yaw);
+    PROF_START(PROF_VIEW_PROJ);
+    float cos_yaw = cos_lookup(yaw);
+    float sin_yaw = sin_lookup(yaw);
     float tx = -(cos_yaw * cam_x + sin_yaw * cam_z);
     float ty = -cam_y;
     float tz = -(-sin_yaw * cam_x + cos_yaw * cam_z);
@@ -198,6 +913,7 @@ int main() {
     // Combined MVP
     float mvp[16];
     matmul4x4(proj_mat, view_mat, mvp);
+    PROF_STOP(PROF_VIEW_PROJ);
     
     // Clear framebuffer
     clear_framebuffer();
@@ -207,14 +923,14 @@ int main() {
     int triangles_culled = 0;
     
     // Process each triangle
-    for (int i = 0; i < cornell_box_triangle_count; i++) {
+    for (int i = 0; i < MESH_TRIANGLE_COUNT; i++) {
         // World space vertices
-        float world_v1[4] = {(float)cornell_box[i][0], (float)cornell_box[i][1], 
-                             (float)cornell_box[i][2], 1.0f};
-        float world_v2[4] = {(float)cornell_box[i][3], (float)cornell_box[i][4], 
-                             (float)cornell_box[i][5], 1.0f};
-        float world_v3[4] = {(float)cornell_box[i][6], (float)cornell_box[i][7], 
-                             (float)cornell_box[i][8], 1.0f};
+        float world_v1[4] = {(float)MESH[i][0], (float)MESH[i][1], 
+                             (float)MESH[i][2], 1.0f};
+        float world_v2[4] = {(float)MESH[i][3], (float)MESH[i][4], 
+                             (float)MESH[i][5], 1.0f};
+        float world_v3[4] = {(float)MESH[i][6], (float)MESH[i][7], 
+                             (float)MESH[i][8], 1.0f};
         // Calculate two edges
         // float edge1[3] = {world_v2[0] - world_v1[0], world_v2[1] - world_v1[1],
         //                   world_v2[2] - world_v1[2]};
@@ -240,12 +956,15 @@ int main() {
         //   continue; // Skip this triangle
         // }
         // Transform to clip space
+        PROF_START(PROF_TRANSFORM);
         float clip1[4], clip2[4], clip3[4];
         matvec4x1(mvp, world_v1, clip1);
         matvec4x1(mvp, world_v2, clip2);
         matvec4x1(mvp, world_v3, clip3);
+        PROF_STOP(PROF_TRANSFORM);
         
         // Frustum culling
+        PROF_START(PROF_CULL);
         int all_left   = (clip1[0] < -clip1[3] && clip2[0] < -clip2[3] && clip3[0] < -clip3[3]);
         int all_right  = (clip1[0] >  clip1[3] && clip2[0] >  clip2[3] && clip3[0] >  clip3[3]);
         int all_bottom = (clip1[1] < -clip1[3] && clip2[1] < -clip2[3] && clip3[1] < -clip3[3]);
@@ -254,17 +973,21 @@ int main() {
         int all_far    = (clip1[2] > clip1[3] && clip2[2] > clip2[3] && clip3[2] > clip3[3]);
         
         if (all_left || all_right || all_bottom || all_top || all_near || all_far) {
+            PROF_STOP(PROF_CULL);
             triangles_culled++;
             continue;
         }
         
         // Check for degenerate w
         if (clip1[3] <= 0.0001f || clip2[3] <= 0.0001f || clip3[3] <= 0.0001f) {
+            PROF_STOP(PROF_CULL);
             triangles_culled++;
             continue;
         }
+        PROF_STOP(PROF_CULL);
         
         // Perspective divide
+        PROF_START(PROF_TRANSFORM);
         float x1_ndc = clip1[0] / clip1[3];
         float y1_ndc = clip1[1] / clip1[3];
         float x2_ndc = clip2[0] / clip2[3];
@@ -279,14 +1002,79 @@ int main() {
         int y2_screen = (int)((1.0f - y2_ndc) * 120.0f);
         int x3_screen = (int)((x3_ndc + 1.0f) * 160.0f);
         int y3_screen = (int)((1.0f - y3_ndc) * 120.0f);
+        PROF_STOP(PROF_TRANSFORM);
         
-        // Draw triangle
-        uint8_t color = cornell_box[i][9];
+        // Draw triangle, which stands in for sending the packet to the hardware
+        PROF_START(PROF_SUBMIT);
+        uint8_t color = MESH[i][9];
         draw_triangle(x1_screen, y1_screen, x2_screen, y2_screen, 
                      x3_screen, y3_screen, color);
+        PROF_STOP(PROF_SUBMIT);
         
         triangles_rendered++;
     }
+
+    *rendered = triangles_rendered;
+    *culled = triangles_culled;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && (strcmp(argv[1], "--model") == 0 || strcmp(argv[1], "--model-trace") == 0)) {
+        // --model [frames] [dirty]: dirty assumes SCANOUT_CLEAR is off
+        int frames = argc > 2 ? atoi(argv[2]) : 600;
+        int clean = !(argc > 3 && strcmp(argv[3], "dirty") == 0);
+        if (frames <= 0) {
+            fprintf(stderr, "%s: frames must be at least 1\n", argv[1]);
+            return 1;
+        }
+        return run_model(frames, clean, strcmp(argv[1], "--model-trace") == 0 ? stdout : NULL);
+    }
+    if (argc > 1 && strcmp(argv[1], "--golden") == 0) {
+        // --golden [frames] [prefix]: bit exact frames, written as PPMs with a prefix
+        int frames = argc > 2 ? atoi(argv[2]) : 600;
+        if (frames <= 0) {
+            fprintf(stderr, "%s: frames must be at least 1\n", argv[1]);
+            return 1;
+        }
+        return run_golden(frames, argc > 3 ? argv[3] : NULL);
+    }
+    if (argc > 1 && (strcmp(argv[1], "--batch") == 0 || strcmp(argv[1], "--batch-geometry") == 0)) {
+        // --batch [frames] [threads] [prefix]: threads defaults to one per core.
+        // --batch-geometry skips the rasterizer.
+        int frames = argc > 2 ? atoi(argv[2]) : 3000;
+        int threads = argc > 3 && atoi(argv[3]) > 0 ? atoi(argv[3]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if (frames <= 0) {
+            fprintf(stderr, "%s: frames must be at least 1\n", argv[1]);
+            return 1;
+        }
+        return run_batch(frames, threads, strcmp(argv[1], "--batch") == 0,
+                         argc > 4 ? argv[4] : NULL);
+    }
+
+    // Camera parameters
+#ifdef HDMI_SCENE
+    float cam_x = scene_camera_path[0][0], cam_y = scene_camera_path[0][1], cam_z = scene_camera_path[0][2];
+    float yaw = scene_camera_path[0][3];
+#else
+    float cam_x = 127.5f, cam_y = 127.5f, cam_z = -20.0f;
+    float yaw = 3.1415f / 12;
+#endif
+    
+    printf("3D Renderer Test\n");
+    printf("================\n");
+    printf("Camera: (%.1f, %.1f, %.1f), Yaw: %.2f rad\n\n", cam_x, cam_y, cam_z, yaw);
+    
+    // Render statistics
+    int triangles_rendered = 0;
+    int triangles_culled = 0;
+
+    // With HDMI_PROFILE the frame is drawn PROF_PRINT_FRAMES times so the
+    // profiler has something to average over
+    PROF_INIT();
+    for (int frame = 0; frame < TB_FRAMES; frame++) {
+        render_frame(cam_x, cam_y, cam_z, yaw, &triangles_rendered, &triangles_culled);
+        PROF_FRAME_END();
+    }
     
     // Display results
     display_framebuffer();
@@ -294,7 +1082,7 @@ int main() {
     printf("\nStatistics:\n");
     printf("  Triangles rendered: %d\n", triangles_rendered);
     printf("  Triangles culled: %d\n", triangles_culled);
-    printf("  Total triangles: %d\n", cornell_box_triangle_count);
+    printf("  Total triangles: %d\n", MESH_TRIANGLE_COUNT);
     
     // Save to image file
     save_ppm("output.ppm");